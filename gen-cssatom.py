@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# gen-cssatom.py
+#   生成 source/common/cssatom.h 和 cssatom.c 中的属性名称表 (完美 hash).
+#   修改下面的 CSS_ATOM_NAMES 后运行:
+#     $ python3 gen-cssatom.py
+#
+#   hash:  h = FNV-1a(name), bucket = h & (BUCKETS - 1), slot = ((h * 0x9E3779B1) >> 24) ^ disp[bucket]
+#   与 cssatom.c 中的 cssAtomHash() 和 cssAtomKnownFind() 一致.
+#
+#   同时生成 source/common/cssparse.c 中的状态关键字表 (CssBitFlag), CSS_BITFLAG_NAMES 按位的顺序,
+#   必须与 cssparse.h 中的 CssBitFlag 一致, 最多 16 个.
+#   hash:  h = p[0] | p[len/2] << 8 | p[len-1] << 16 | len << 24, slot = (h * CSS_BITFLAG_HASH_MUL) >> 27
+#   与 cssparse.c 中的 cssGetKeyBitFlag() 一致.
+#
+import os
+import sys
+
+CSS_ATOM_NAMES = """
+align-content align-items align-self animation
+background background-color background-image background-position background-repeat background-size
+border border-bottom border-color border-left border-radius border-right border-style border-top border-width
+bottom box-shadow box-sizing
+clip clip-path clip-rule color color-interpolation cursor
+direction display dominant-baseline
+fill fill-color fill-opacity fill-rule fill-style filter flex flex-direction flex-wrap float
+font font-family font-size font-stretch font-style font-variant font-weight
+height justify-content left letter-spacing line-height
+margin margin-bottom margin-left margin-right margin-top
+marker marker-end marker-mid marker-start mask max-height max-width min-height min-width mix-blend-mode
+opacity outline outline-color outline-style outline-width overflow
+padding padding-bottom padding-left padding-right padding-top paint-order pointer-events position
+right shape-rendering stop-color stop-opacity
+stroke stroke-dasharray stroke-dashoffset stroke-linecap stroke-linejoin stroke-miterlimit stroke-opacity stroke-width
+text-align text-anchor text-decoration text-overflow text-rendering text-shadow text-transform
+top transform transform-origin transition
+vector-effect vertical-align visibility white-space width word-spacing writing-mode z-index
+""".split()
+
+CSS_BITFLAG_NAMES = """
+readonly hidden hilight pickup dragging deleting fault flash zoomin zoomout panning
+""".split()
+
+SLOTS = 256
+BUCKETS = 64
+
+BITFLAG_SLOTS = 32
+BITFLAG_NAME_MAX = 15
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+HEADER = os.path.join(ROOT, "source", "common", "cssatom.h")
+SOURCE = os.path.join(ROOT, "source", "common", "cssatom.c")
+PARSER = os.path.join(ROOT, "source", "common", "cssparse.c")
+BEGIN = "// BEGIN gen-cssatom.py"
+END = "// END gen-cssatom.py"
+
+
+def fnv1a(name):
+    h = 2166136261
+    for c in name.encode("ascii"):
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def slot_of(h):
+    return ((h * 0x9E3779B1) & 0xFFFFFFFF) >> 24
+
+
+def perfect_hash(names):
+    buckets = [[] for _ in range(BUCKETS)]
+    for atom, name in enumerate(names, 1):
+        h = fnv1a(name)
+        buckets[h & (BUCKETS - 1)].append((atom, slot_of(h)))
+
+    slots = [0] * SLOTS
+    disp = [0] * BUCKETS
+
+    for b in sorted(range(BUCKETS), key=lambda b: -len(buckets[b])):
+        for d in range(SLOTS):
+            cand = [s ^ d for _, s in buckets[b]]
+            if len(set(cand)) == len(cand) and all(slots[s] == 0 for s in cand):
+                for (atom, _), s in zip(buckets[b], cand):
+                    slots[s] = atom
+                disp[b] = d
+                break
+        else:
+            sys.exit("Error: no displacement for bucket %d, increase SLOTS or BUCKETS" % b)
+    return slots, disp
+
+
+def bitflag_key(name):
+    p = name.encode("ascii")
+    n = len(p)
+    return p[0] | p[n >> 1] << 8 | p[n - 1] << 16 | n << 24
+
+
+def bitflag_hash(names):
+    keys = [bitflag_key(n) for n in names]
+    if len(set(keys)) != len(keys):
+        sys.exit("Error: bitflag names with same first, middle and last char and length")
+    # 固定的序列, 结果可以重现
+    mul = 0x9E3779B1
+    for _ in range(1 << 20):
+        slots = [(k * mul & 0xFFFFFFFF) >> 27 for k in keys]
+        if len(set(slots)) == len(slots):
+            return mul, slots
+        mul = (mul * 1103515245 + 12345) & 0xFFFFFFFF | 1
+    sys.exit("Error: no multiplier for bitflag names")
+
+
+def replace_region(path, text):
+    with open(path, encoding="utf-8") as f:
+        src = f.read()
+    begin = src.index(BEGIN)
+    end = src.index(END)
+    src = src[:src.index("\n", begin) + 1] + text + src[end:]
+    with open(path, "w", encoding="utf-8", newline="\n") as f:
+        f.write(src)
+
+
+def ident(name):
+    return "css_atom_" + name.replace("-", "_")
+
+
+def main():
+    names = sorted(set(CSS_ATOM_NAMES))
+    if len(names) >= SLOTS:
+        sys.exit("Error: too many names")
+    slots, disp = perfect_hash(names)
+
+    width = max(len(ident(n)) for n in names) + 1
+    lines = ["    %-*s = 0," % (width, "css_atom_none")]
+    for atom, name in enumerate(names, 1):
+        lines.append("    %-*s = %d," % (width, ident(name), atom))
+    lines.append("    %-*s = %d   // 第一个动态 atom" % (width, "css_atom_known_end", len(names) + 1))
+    replace_region(HEADER, "\n".join(lines) + "\n")
+
+    out = []
+    out.append("#define CSS_ATOM_SLOTS    %d" % SLOTS)
+    out.append("#define CSS_ATOM_BUCKETS  %d" % BUCKETS)
+    out.append("")
+    out.append("// 已知名称表的 hash, 打包的 keys 只能在相同的表下使用")
+    out.append("#define CSS_ATOM_VOCABULARY  0x%08XU" % fnv1a("\n".join(names)))
+    out.append("")
+    out.append("static const char * const css_atom_known_names[] = {")
+    out.append("    0,")
+    for name in names:
+        out.append('    "%s",' % name)
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t css_atom_known_lengths[] = {")
+    lengths = [0] + [len(n) for n in names]
+    for i in range(0, len(lengths), 16):
+        out.append("    " + ", ".join("%2d" % n for n in lengths[i:i + 16]) + ",")
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t css_atom_disp[CSS_ATOM_BUCKETS] = {")
+    for i in range(0, BUCKETS, 16):
+        out.append("    " + ", ".join("%3d" % d for d in disp[i:i + 16]) + ",")
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t css_atom_slots[CSS_ATOM_SLOTS] = {")
+    for i in range(0, SLOTS, 16):
+        out.append("    " + ", ".join("%3d" % s for s in slots[i:i + 16]) + ",")
+    out.append("};")
+    replace_region(SOURCE, "\n".join(out) + "\n")
+
+    flags = CSS_BITFLAG_NAMES
+    if len(flags) > 16 or len(set(flags)) != len(flags) or max(len(n) for n in flags) > BITFLAG_NAME_MAX:
+        sys.exit("Error: at most 16 different bitflag names, at most %d chars" % BITFLAG_NAME_MAX)
+    mul, bslots = bitflag_hash(flags)
+
+    table = [None] * BITFLAG_SLOTS
+    for bit, (name, slot) in enumerate(zip(flags, bslots)):
+        table[slot] = (name, bit)
+
+    out = []
+    out.append("static const char* css_bitflag_array[] = {")
+    for name in flags:
+        out.append('    "%s",' % name)
+    out.append("    0")
+    out.append("};")
+    out.append("")
+    out.append("#define CSS_BITFLAG_SLOTS     %d" % BITFLAG_SLOTS)
+    out.append("#define CSS_BITFLAG_NAME_MAX  %d" % BITFLAG_NAME_MAX)
+    out.append("#define CSS_BITFLAG_HASH_MUL  0x%08XU" % mul)
+    out.append("")
+    out.append("// 空的 slot 长度为 0")
+    out.append("static const struct {")
+    out.append("    uint8_t length;")
+    out.append("    uint16_t flag;")
+    out.append("    char name[CSS_BITFLAG_NAME_MAX + 1];")
+    out.append("} css_bitflag_slots[CSS_BITFLAG_SLOTS] = {")
+    for e in table:
+        if e:
+            out.append('    { %d, 0x%04X, "%s" },' % (len(e[0]), 1 << e[1], e[0]))
+        else:
+            out.append('    { 0, 0, "" },')
+    out.append("};")
+    replace_region(PARSER, "\n".join(out) + "\n")
+
+    print("%d names, %d slots, %d buckets; %d bitflags, multiplier 0x%08X" % (len(names), SLOTS, BUCKETS, len(flags), mul))
+
+
+if __name__ == "__main__":
+    main()
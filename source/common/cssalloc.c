@@ -0,0 +1,344 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssalloc.c
+ * @brief 可替换的内存分配器和 bump arena
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 23:20:15
+ * @date 2026-10-16 23:20:15
+ *
+ * @note
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cssalloc.h"
+#include "smallregex.h"
+
+
+#if defined(_MSC_VER)
+#   define CSS_THREAD_LOCAL  __declspec(thread)
+#else
+#   define CSS_THREAD_LOCAL  __thread
+#endif
+
+
+static void * cssDefaultAlloc(void *userData, size_t size)
+{
+    (void)userData;
+    return malloc(size);
+}
+
+
+static void * cssDefaultRealloc(void *userData, void *ptr, size_t size)
+{
+    (void)userData;
+    return realloc(ptr, size);
+}
+
+
+static void cssDefaultFree(void *userData, void *ptr)
+{
+    (void)userData;
+    free(ptr);
+}
+
+
+static const CssAllocator css_default_allocator = {
+    0, cssDefaultAlloc, cssDefaultRealloc, cssDefaultFree
+};
+
+
+// 每个线程各自的分配器, 以及转给 smallregex 的副本
+static CSS_THREAD_LOCAL const CssAllocator *css_allocator = 0;
+static CSS_THREAD_LOCAL struct regex_allocator css_regex_allocator;
+
+
+const CssAllocator * CssSetAllocator(const CssAllocator *allocator)
+{
+    const CssAllocator *old = CssGetAllocator();
+
+    if (allocator && allocator != &css_default_allocator) {
+        css_allocator = allocator;
+        css_regex_allocator.udata = allocator->userData;
+        css_regex_allocator.alloc = allocator->alloc;
+        css_regex_allocator.realloc = allocator->realloc;
+        css_regex_allocator.free = allocator->free;
+        regex_set_allocator(&css_regex_allocator);
+    }
+    else {
+        css_allocator = 0;
+        regex_set_allocator(0);
+    }
+    return old;
+}
+
+
+const CssAllocator * CssGetAllocator(void)
+{
+    return css_allocator ? css_allocator : &css_default_allocator;
+}
+
+
+void * CssMemAlloc(const CssAllocator *allocator, size_t size)
+{
+    if (!allocator) {
+        allocator = CssGetAllocator();
+    }
+    void *ptr = allocator->alloc(allocator->userData, size);
+    if (!ptr) {
+        printf("Error: Out of memory\n");
+        abort();
+    }
+    return ptr;
+}
+
+
+void * CssMemRealloc(const CssAllocator *allocator, void *ptr, size_t size)
+{
+    if (!allocator) {
+        allocator = CssGetAllocator();
+    }
+    ptr = allocator->realloc(allocator->userData, ptr, size);
+    if (!ptr) {
+        printf("Error: Out of memory\n");
+        abort();
+    }
+    return ptr;
+}
+
+
+void CssMemFree(const CssAllocator *allocator, void *ptr)
+{
+    if (ptr) {
+        if (!allocator) {
+            allocator = CssGetAllocator();
+        }
+        allocator->free(allocator->userData, ptr);
+    }
+}
+
+
+#define CSS_ARENA_BLOCKSIZE  0x10000
+
+// 每次分配前面的头, 记录分配的大小 (realloc 需要). 16 字节对齐
+#define CSS_ARENA_ALIGN      16
+
+typedef struct CssArenaBlock {
+    struct CssArenaBlock *next;
+    size_t size;    // data[] 的大小
+    size_t used;
+    size_t __align_dummy;
+    char data[0];
+} CssArenaBlock;
+
+typedef struct {
+    size_t size;
+    size_t __align_dummy;
+} CssArenaChunk;
+
+struct CssArenaData {
+    CssAllocator allocator;
+    const CssAllocator *backing;  // 块和 arena 本身从它分配
+    CssArenaBlock *blocks;  // 当前块在最前
+    size_t blockSize;
+    size_t used;
+    size_t reserved;
+};
+
+
+static size_t cssArenaRound(size_t size)
+{
+    return (size + CSS_ARENA_ALIGN - 1) / CSS_ARENA_ALIGN * CSS_ARENA_ALIGN;
+}
+
+
+static CssArenaBlock * cssArenaAddBlock(CssArena arena, size_t size)
+{
+    if (size < arena->blockSize) {
+        size = arena->blockSize;
+    }
+    CssArenaBlock *block = (CssArenaBlock *) arena->backing->alloc(arena->backing->userData, sizeof(CssArenaBlock) + size);
+    if (!block) {
+        return 0;
+    }
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->reserved += size;
+    return block;
+}
+
+
+static void * cssArenaAlloc(void *userData, size_t size)
+{
+    CssArena arena = (CssArena) userData;
+    CssArenaBlock *block = arena->blocks;
+    size_t need = sizeof(CssArenaChunk) + cssArenaRound(size);
+
+    if (!block || block->size - block->used < need) {
+        block = cssArenaAddBlock(arena, need);
+        if (!block) {
+            return 0;
+        }
+    }
+
+    CssArenaChunk *chunk = (CssArenaChunk *) (block->data + block->used);
+    chunk->size = size;
+    block->used += need;
+    arena->used += need;
+    return chunk + 1;
+}
+
+
+// 是否当前块的最后一次分配
+static int cssArenaIsLast(CssArena arena, const CssArenaChunk *chunk)
+{
+    const CssArenaBlock *block = arena->blocks;
+    return block && (const char *) (chunk + 1) + cssArenaRound(chunk->size) == block->data + block->used;
+}
+
+
+static void * cssArenaRealloc(void *userData, void *ptr, size_t size)
+{
+    CssArena arena = (CssArena) userData;
+
+    if (!ptr) {
+        return cssArenaAlloc(userData, size);
+    }
+
+    CssArenaChunk *chunk = (CssArenaChunk *) ptr - 1;
+
+    // 最后一次分配: 原地扩展或者缩小
+    if (cssArenaIsLast(arena, chunk)) {
+        CssArenaBlock *block = arena->blocks;
+        size_t oldSize = cssArenaRound(chunk->size);
+        size_t newSize = cssArenaRound(size);
+
+        if (newSize <= oldSize || block->size - block->used >= newSize - oldSize) {
+            block->used = block->used - oldSize + newSize;
+            arena->used = arena->used - oldSize + newSize;
+            chunk->size = size;
+            return ptr;
+        }
+    }
+
+    void *newPtr = cssArenaAlloc(userData, size);
+    if (newPtr) {
+        memcpy(newPtr, ptr, chunk->size < size ? chunk->size : size);
+    }
+    return newPtr;
+}
+
+
+static void cssArenaFreeChunk(void *userData, void *ptr)
+{
+    CssArena arena = (CssArena) userData;
+
+    if (ptr) {
+        CssArenaChunk *chunk = (CssArenaChunk *) ptr - 1;
+        if (cssArenaIsLast(arena, chunk)) {
+            size_t need = sizeof(CssArenaChunk) + cssArenaRound(chunk->size);
+            arena->blocks->used -= need;
+            arena->used -= need;
+        }
+    }
+}
+
+
+CssArena CssArenaNew(const CssAllocator *backing, size_t blockSize)
+{
+    if (!backing) {
+        backing = CssGetAllocator();
+    }
+    CssArena arena = (CssArena) CssMemAlloc(backing, sizeof(struct CssArenaData));
+    memset(arena, 0, sizeof(struct CssArenaData));
+    arena->backing = backing;
+    arena->allocator.userData = arena;
+    arena->allocator.alloc = cssArenaAlloc;
+    arena->allocator.realloc = cssArenaRealloc;
+    arena->allocator.free = cssArenaFreeChunk;
+    arena->blockSize = blockSize ? cssArenaRound(blockSize) : CSS_ARENA_BLOCKSIZE;
+    return arena;
+}
+
+
+void CssArenaFree(CssArena arena)
+{
+    if (arena) {
+        while (arena->blocks) {
+            CssArenaBlock *next = arena->blocks->next;
+            CssMemFree(arena->backing, arena->blocks);
+            arena->blocks = next;
+        }
+        CssMemFree(arena->backing, arena);
+    }
+}
+
+
+void CssArenaReset(CssArena arena)
+{
+    // 多个块时合并为一个, 之后同样大小的解析不再申请新块
+    if (arena->blocks && arena->blocks->next) {
+        size_t reserved = arena->reserved;
+        while (arena->blocks) {
+            CssArenaBlock *next = arena->blocks->next;
+            CssMemFree(arena->backing, arena->blocks);
+            arena->blocks = next;
+        }
+        arena->reserved = 0;
+        if (!cssArenaAddBlock(arena, reserved)) {
+            printf("Error: Out of memory\n");
+            abort();
+        }
+    }
+    if (arena->blocks) {
+        arena->blocks->used = 0;
+    }
+    arena->used = 0;
+}
+
+
+size_t CssArenaGetUsed(const CssArena arena)
+{
+    return arena->used;
+}
+
+
+size_t CssArenaGetReserved(const CssArena arena)
+{
+    return arena->reserved;
+}
+
+
+const CssAllocator * CssArenaGetAllocator(CssArena arena)
+{
+    return &arena->allocator;
+}
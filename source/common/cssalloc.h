@@ -0,0 +1,92 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssalloc.h
+ * @brief 可替换的内存分配器和 bump arena
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 23:20:15
+ * @date 2026-10-16 23:20:15
+ *
+ * @note
+ *   分配器按线程设置: CssSetAllocator() 只影响当前线程之后的分配,
+ *   同时设置 smallregex 的分配器 (regex_set_allocator). 默认使用 malloc/realloc/free.
+ *   CssKeyArray 和 CssString 记住创建时的分配器, CssKeyArrayFree() 和
+ *   CssStringFree() 总是还给它, 不受之后 CssSetAllocator() 的影响.
+ *   分配器必须在它分配的内存全部释放之前保持有效.
+ */
+#ifndef CSS_ALLOC_H__
+#define CSS_ALLOC_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+
+typedef struct CssAllocator {
+    void *userData;
+    void * (*alloc)(void *userData, size_t size);
+    void * (*realloc)(void *userData, void *ptr, size_t size);
+    void (*free)(void *userData, void *ptr);
+} CssAllocator;
+
+
+// 设置当前线程的分配器, 0 恢复为 malloc. 返回原来的分配器
+extern const CssAllocator * CssSetAllocator(const CssAllocator *allocator);
+
+// 当前线程的分配器, 不会返回 0
+extern const CssAllocator * CssGetAllocator(void);
+
+// 使用 allocator 分配 (0 为当前线程的分配器). 内存不足时直接退出
+extern void * CssMemAlloc(const CssAllocator *allocator, size_t size);
+extern void * CssMemRealloc(const CssAllocator *allocator, void *ptr, size_t size);
+extern void CssMemFree(const CssAllocator *allocator, void *ptr);
+
+
+// bump arena: 从大块内存中顺序分配, free 只回收最后一次分配.
+//   一次 CssArenaReset() 释放全部分配, 保留内存供下次使用. 不是线程安全的.
+typedef struct CssArenaData *CssArena;
+
+// 块从 backing 分配 (0 为当前线程的分配器), 它必须比 arena 活得长.
+//   blockSize 为每次申请的块大小, 0 使用 64 KB
+extern CssArena CssArenaNew(const CssAllocator *backing, size_t blockSize);
+extern void CssArenaFree(CssArena arena);
+extern void CssArenaReset(CssArena arena);
+
+// 自上次 reset 以来分配出去的字节数, 和从 backing 申请的字节数
+extern size_t CssArenaGetUsed(const CssArena arena);
+extern size_t CssArenaGetReserved(const CssArena arena);
+
+// 从 arena 分配的分配器, 用于 CssSetAllocator()
+extern const CssAllocator * CssArenaGetAllocator(CssArena arena);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CSS_ALLOC_H__ */
@@ -0,0 +1,363 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssatom.c
+ * @brief 属性名称 atom: 已知属性的完美 hash 表和未知名称的动态表
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 23:52:06
+ * @date 2026-10-16 23:52:06
+ *
+ * @note
+ *   已知属性的表由 gen-cssatom.py 生成, 不要手工修改.
+ *   动态表只增加不删除: 条目先写好再发布 slot, 查找不加锁; 增加条目时用自旋锁.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cssatom.h"
+#include "cssthread.h"
+
+
+// BEGIN gen-cssatom.py
+#define CSS_ATOM_SLOTS    256
+#define CSS_ATOM_BUCKETS  64
+
+// 已知名称表的 hash, 打包的 keys 只能在相同的表下使用
+#define CSS_ATOM_VOCABULARY  0xE1097281U
+
+static const char * const css_atom_known_names[] = {
+    0,
+    "align-content",
+    "align-items",
+    "align-self",
+    "animation",
+    "background",
+    "background-color",
+    "background-image",
+    "background-position",
+    "background-repeat",
+    "background-size",
+    "border",
+    "border-bottom",
+    "border-color",
+    "border-left",
+    "border-radius",
+    "border-right",
+    "border-style",
+    "border-top",
+    "border-width",
+    "bottom",
+    "box-shadow",
+    "box-sizing",
+    "clip",
+    "clip-path",
+    "clip-rule",
+    "color",
+    "color-interpolation",
+    "cursor",
+    "direction",
+    "display",
+    "dominant-baseline",
+    "fill",
+    "fill-color",
+    "fill-opacity",
+    "fill-rule",
+    "fill-style",
+    "filter",
+    "flex",
+    "flex-direction",
+    "flex-wrap",
+    "float",
+    "font",
+    "font-family",
+    "font-size",
+    "font-stretch",
+    "font-style",
+    "font-variant",
+    "font-weight",
+    "height",
+    "justify-content",
+    "left",
+    "letter-spacing",
+    "line-height",
+    "margin",
+    "margin-bottom",
+    "margin-left",
+    "margin-right",
+    "margin-top",
+    "marker",
+    "marker-end",
+    "marker-mid",
+    "marker-start",
+    "mask",
+    "max-height",
+    "max-width",
+    "min-height",
+    "min-width",
+    "mix-blend-mode",
+    "opacity",
+    "outline",
+    "outline-color",
+    "outline-style",
+    "outline-width",
+    "overflow",
+    "padding",
+    "padding-bottom",
+    "padding-left",
+    "padding-right",
+    "padding-top",
+    "paint-order",
+    "pointer-events",
+    "position",
+    "right",
+    "shape-rendering",
+    "stop-color",
+    "stop-opacity",
+    "stroke",
+    "stroke-dasharray",
+    "stroke-dashoffset",
+    "stroke-linecap",
+    "stroke-linejoin",
+    "stroke-miterlimit",
+    "stroke-opacity",
+    "stroke-width",
+    "text-align",
+    "text-anchor",
+    "text-decoration",
+    "text-overflow",
+    "text-rendering",
+    "text-shadow",
+    "text-transform",
+    "top",
+    "transform",
+    "transform-origin",
+    "transition",
+    "vector-effect",
+    "vertical-align",
+    "visibility",
+    "white-space",
+    "width",
+    "word-spacing",
+    "writing-mode",
+    "z-index",
+};
+
+static const uint8_t css_atom_known_lengths[] = {
+     0, 13, 11, 10,  9, 10, 16, 16, 19, 17, 15,  6, 13, 12, 11, 13,
+    12, 12, 10, 12,  6, 10, 10,  4,  9,  9,  5, 19,  6,  9,  7, 17,
+     4, 10, 12,  9, 10,  6,  4, 14,  9,  5,  4, 11,  9, 12, 10, 12,
+    11,  6, 15,  4, 14, 11,  6, 13, 11, 12, 10,  6, 10, 10, 12,  4,
+    10,  9, 10,  9, 14,  7,  7, 13, 13, 13,  8,  7, 14, 12, 13, 11,
+    11, 14,  8,  5, 15, 10, 12,  6, 16, 17, 14, 15, 17, 14, 12, 10,
+    11, 15, 13, 14, 11, 14,  3,  9, 16, 10, 13, 14, 10, 11,  5, 12,
+    12,  7,
+};
+
+static const uint8_t css_atom_disp[CSS_ATOM_BUCKETS] = {
+      0,   2,   0,   0,   0,   0,   0,   1,   6,   8,   0,   0,   1,   1,   0,   0,
+      2,   0,   0,   0,   0,   1,   0,   1,   1,   0,   0,   4,   0,   0,   0,   1,
+      1,   0,   0,   0,   1,   0,   0,   0,   0,   1,   0,   0,   0,   1,   0,  13,
+      2,   0,   2,   1,   0,   1,   3,   3,   0,   0,   0,   0,   0,   0,   0,   1,
+};
+
+static const uint8_t css_atom_slots[CSS_ATOM_SLOTS] = {
+      0,   0,   0,  27,  94,   8,  62,  75,  10,   0,  90,   0,  69,   0,  47,  16,
+      0,   0,   0,   0,   0,   0,   0,  18,   7,   0,   0,   0,   0,  57,  30,   0,
+     40,  63,   0,   0,   0,  80,  34,  83, 105,  67,   0,   0,   0, 106, 101,  48,
+      0, 110,  92,   0,   0,   0,   0,   0,  55,  53,   0,   0,   0,  97,  11,  14,
+      0,   2,   0,   0,  88,  82,   0,  86,   0,   0,   6,  41,   0,   0,  31,  70,
+     21,   0,  84, 112,   0,   0,  85,   0,  50,  76,  59,  39, 103,  23,  32,  95,
+      0,   0,   0,  54,   0,   0,  81,   0, 113,   0,   4,   0,  49,  71,   0,  73,
+      0,  24,  19,  52,   0,  20,   0,   0,   0,   3,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   9, 111, 100, 104,   0,   0,   0,   0,  91,   0,  61,   0,   0,
+      0,   0,  56, 108,  77,  36,   0,   0,   0,   0,   0,  65,  60,  96,   0, 109,
+      0,  29,   0,  37,   0,   0,   0,  25,   0,   0,   0,   0,   0,   0,   0,  33,
+     26,  78,   0,   0,   0,  35,   0,   0,  79,  28,  66,  15,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,  89,  13,   0,   0,   0,   0,  68,   0,   0,   0,
+      0,  17,  46, 102,  45,  64,  74,   0,   0,   0,   0,   0,   0,   0,  43,  12,
+      0,   0,   0,   0,   0,   0,  38,   0,   0,  22,  72,   1,   0,  58,  44,   0,
+      0, 107,  42,   0,  93,   0,   0,   0,   0,  51,   5,  99,   0,   0,  87,  98,
+};
+// END gen-cssatom.py
+
+
+// 动态表: 开放寻址, 装载因子不超过 1/2
+#define CSS_ATOM_DYNAMIC_SLOTS  (CSS_ATOM_DYNAMIC_MAX * 2)
+
+typedef struct {
+    const char *name;
+    uint32_t hash;
+    int len;
+} CssAtomEntry;
+
+// css_atom_dynamic[atom - css_atom_known_end]
+static CssAtomEntry css_atom_dynamic[CSS_ATOM_DYNAMIC_MAX];
+
+// 动态 atom, 0 表示空
+static int32_t css_atom_dynamic_slots[CSS_ATOM_DYNAMIC_SLOTS];
+
+static int32_t css_atom_dynamic_count = 0;
+static int32_t css_atom_dynamic_lock = 0;
+
+
+static inline int cssAtomKnownFind(const char *name, int len, uint32_t h)
+{
+    int slot = (int)((h * 0x9E3779B1U) >> 24) ^ css_atom_disp[h & (CSS_ATOM_BUCKETS - 1)];
+    int atom = css_atom_slots[slot];
+
+    if (atom && css_atom_known_lengths[atom] == len && !memcmp(css_atom_known_names[atom], name, len)) {
+        return atom;
+    }
+    return css_atom_none;
+}
+
+
+static int cssAtomDynamicFind(const char *name, int len, uint32_t h)
+{
+    uint32_t slot = h & (CSS_ATOM_DYNAMIC_SLOTS - 1);
+    int32_t atom;
+
+    while ((atom = CssAtomicLoad(&css_atom_dynamic_slots[slot])) != 0) {
+        const CssAtomEntry *entry = &css_atom_dynamic[atom - css_atom_known_end];
+        if (entry->hash == h && entry->len == len && !memcmp(entry->name, name, len)) {
+            return atom;
+        }
+        slot = (slot + 1) & (CSS_ATOM_DYNAMIC_SLOTS - 1);
+    }
+    return css_atom_none;
+}
+
+
+int CssAtomFindKnown(const char *name, int len)
+{
+    if (len <= 0 || len > CSS_ATOM_NAME_MAX) {
+        return css_atom_none;
+    }
+    return cssAtomKnownFind(name, len, CssHashFnv1a(name, len));
+}
+
+
+int CssAtomFind(const char *name, int len)
+{
+    if (len <= 0 || len > CSS_ATOM_NAME_MAX) {
+        return css_atom_none;
+    }
+
+    uint32_t h = CssHashFnv1a(name, len);
+    int atom = cssAtomKnownFind(name, len, h);
+    if (atom == css_atom_none && CssAtomicLoad(&css_atom_dynamic_count) > 0) {
+        atom = cssAtomDynamicFind(name, len, h);
+    }
+    return atom;
+}
+
+
+int CssAtomIntern(const char *name, int len)
+{
+    if (len <= 0 || len > CSS_ATOM_NAME_MAX) {
+        return css_atom_none;
+    }
+
+    uint32_t h = CssHashFnv1a(name, len);
+    int atom = cssAtomKnownFind(name, len, h);
+    if (atom != css_atom_none) {
+        return atom;
+    }
+
+    atom = cssAtomDynamicFind(name, len, h);
+    if (atom != css_atom_none) {
+        return atom;
+    }
+
+    CssSpinLock(&css_atom_dynamic_lock);
+
+    // 其他线程可能刚加入了同一个名称
+    atom = cssAtomDynamicFind(name, len, h);
+
+    int count = css_atom_dynamic_count;
+    if (atom == css_atom_none && count < CSS_ATOM_DYNAMIC_MAX) {
+        // 名称与进程同生命周期, 不使用线程的分配器 (可能是 arena)
+        char *copy = (char *) malloc(len + 1);
+        if (!copy) {
+            printf("Error: out of memory\n");
+            abort();
+        }
+        memcpy(copy, name, len);
+        copy[len] = 0;
+
+        CssAtomEntry *entry = &css_atom_dynamic[count];
+        entry->name = copy;
+        entry->hash = h;
+        entry->len = len;
+
+        uint32_t slot = h & (CSS_ATOM_DYNAMIC_SLOTS - 1);
+        while (css_atom_dynamic_slots[slot] != 0) {
+            slot = (slot + 1) & (CSS_ATOM_DYNAMIC_SLOTS - 1);
+        }
+
+        atom = css_atom_known_end + count;
+        CssAtomicStore(&css_atom_dynamic_count, count + 1);
+        CssAtomicStore(&css_atom_dynamic_slots[slot], atom);
+    }
+
+    CssSpinUnlock(&css_atom_dynamic_lock);
+    return atom;
+}
+
+
+const char * CssAtomGetName(int atom, int *len)
+{
+    if (atom > css_atom_none && atom < css_atom_known_end) {
+        if (len) {
+            *len = css_atom_known_lengths[atom];
+        }
+        return css_atom_known_names[atom];
+    }
+
+    if (atom >= css_atom_known_end && atom - css_atom_known_end < CssAtomicLoad(&css_atom_dynamic_count)) {
+        const CssAtomEntry *entry = &css_atom_dynamic[atom - css_atom_known_end];
+        if (len) {
+            *len = entry->len;
+        }
+        return entry->name;
+    }
+    return 0;
+}
+
+
+int CssAtomGetCount(void)
+{
+    return css_atom_known_end + CssAtomicLoad(&css_atom_dynamic_count);
+}
+
+
+uint32_t CssAtomVocabulary(void)
+{
+    return CSS_ATOM_VOCABULARY;
+}
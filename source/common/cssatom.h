@@ -0,0 +1,202 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssatom.h
+ * @brief 属性名称 atom: 已知属性的完美 hash 表和未知名称的动态表
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 23:52:06
+ * @date 2026-10-16 23:52:06
+ *
+ * @note
+ *   每个属性名称对应一个整数 (atom). 已知的属性 (CssAtom, 由 gen-cssatom.py 生成) 查表, 不加锁.
+ *   解析时只写入已知的 atom (见 CssKeyGetAtom), 未知的名称为 css_atom_none,
+ *   因此 keys (包括打包的映像) 中的 atom 在其他进程中也有效.
+ *   动态表由调用者按需使用 (CssAtomIntern): 全局, 只增加不删除, 只在当前进程中有效.
+ *   名称按字节比较 (区分大小写), 与 strncmp 一致.
+ */
+#ifndef CSS_ATOM_H__
+#define CSS_ATOM_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+typedef enum {
+// BEGIN gen-cssatom.py
+    css_atom_none                 = 0,
+    css_atom_align_content        = 1,
+    css_atom_align_items          = 2,
+    css_atom_align_self           = 3,
+    css_atom_animation            = 4,
+    css_atom_background           = 5,
+    css_atom_background_color     = 6,
+    css_atom_background_image     = 7,
+    css_atom_background_position  = 8,
+    css_atom_background_repeat    = 9,
+    css_atom_background_size      = 10,
+    css_atom_border               = 11,
+    css_atom_border_bottom        = 12,
+    css_atom_border_color         = 13,
+    css_atom_border_left          = 14,
+    css_atom_border_radius        = 15,
+    css_atom_border_right         = 16,
+    css_atom_border_style         = 17,
+    css_atom_border_top           = 18,
+    css_atom_border_width         = 19,
+    css_atom_bottom               = 20,
+    css_atom_box_shadow           = 21,
+    css_atom_box_sizing           = 22,
+    css_atom_clip                 = 23,
+    css_atom_clip_path            = 24,
+    css_atom_clip_rule            = 25,
+    css_atom_color                = 26,
+    css_atom_color_interpolation  = 27,
+    css_atom_cursor               = 28,
+    css_atom_direction            = 29,
+    css_atom_display              = 30,
+    css_atom_dominant_baseline    = 31,
+    css_atom_fill                 = 32,
+    css_atom_fill_color           = 33,
+    css_atom_fill_opacity         = 34,
+    css_atom_fill_rule            = 35,
+    css_atom_fill_style           = 36,
+    css_atom_filter               = 37,
+    css_atom_flex                 = 38,
+    css_atom_flex_direction       = 39,
+    css_atom_flex_wrap            = 40,
+    css_atom_float                = 41,
+    css_atom_font                 = 42,
+    css_atom_font_family          = 43,
+    css_atom_font_size            = 44,
+    css_atom_font_stretch         = 45,
+    css_atom_font_style           = 46,
+    css_atom_font_variant         = 47,
+    css_atom_font_weight          = 48,
+    css_atom_height               = 49,
+    css_atom_justify_content      = 50,
+    css_atom_left                 = 51,
+    css_atom_letter_spacing       = 52,
+    css_atom_line_height          = 53,
+    css_atom_margin               = 54,
+    css_atom_margin_bottom        = 55,
+    css_atom_margin_left          = 56,
+    css_atom_margin_right         = 57,
+    css_atom_margin_top           = 58,
+    css_atom_marker               = 59,
+    css_atom_marker_end           = 60,
+    css_atom_marker_mid           = 61,
+    css_atom_marker_start         = 62,
+    css_atom_mask                 = 63,
+    css_atom_max_height           = 64,
+    css_atom_max_width            = 65,
+    css_atom_min_height           = 66,
+    css_atom_min_width            = 67,
+    css_atom_mix_blend_mode       = 68,
+    css_atom_opacity              = 69,
+    css_atom_outline              = 70,
+    css_atom_outline_color        = 71,
+    css_atom_outline_style        = 72,
+    css_atom_outline_width        = 73,
+    css_atom_overflow             = 74,
+    css_atom_padding              = 75,
+    css_atom_padding_bottom       = 76,
+    css_atom_padding_left         = 77,
+    css_atom_padding_right        = 78,
+    css_atom_padding_top          = 79,
+    css_atom_paint_order          = 80,
+    css_atom_pointer_events       = 81,
+    css_atom_position             = 82,
+    css_atom_right                = 83,
+    css_atom_shape_rendering      = 84,
+    css_atom_stop_color           = 85,
+    css_atom_stop_opacity         = 86,
+    css_atom_stroke               = 87,
+    css_atom_stroke_dasharray     = 88,
+    css_atom_stroke_dashoffset    = 89,
+    css_atom_stroke_linecap       = 90,
+    css_atom_stroke_linejoin      = 91,
+    css_atom_stroke_miterlimit    = 92,
+    css_atom_stroke_opacity       = 93,
+    css_atom_stroke_width         = 94,
+    css_atom_text_align           = 95,
+    css_atom_text_anchor          = 96,
+    css_atom_text_decoration      = 97,
+    css_atom_text_overflow        = 98,
+    css_atom_text_rendering       = 99,
+    css_atom_text_shadow          = 100,
+    css_atom_text_transform       = 101,
+    css_atom_top                  = 102,
+    css_atom_transform            = 103,
+    css_atom_transform_origin     = 104,
+    css_atom_transition           = 105,
+    css_atom_vector_effect        = 106,
+    css_atom_vertical_align       = 107,
+    css_atom_visibility           = 108,
+    css_atom_white_space          = 109,
+    css_atom_width                = 110,
+    css_atom_word_spacing         = 111,
+    css_atom_writing_mode         = 112,
+    css_atom_z_index              = 113,
+    css_atom_known_end            = 114   // 第一个动态 atom
+// END gen-cssatom.py
+} CssAtom;
+
+
+// 动态 atom 最多的个数, 全部 atom 都小于 CSS_ATOM_MAX (16bit)
+#define CSS_ATOM_DYNAMIC_MAX  8192
+#define CSS_ATOM_MAX          (css_atom_known_end + CSS_ATOM_DYNAMIC_MAX)
+
+// 名称最长 255 字节
+#define CSS_ATOM_NAME_MAX     255
+
+
+// 只查找已知的名称 (小于 css_atom_known_end), 没有返回 css_atom_none. 解析时使用
+extern int CssAtomFindKnown(const char *name, int len);
+
+// 查找名称的 atom (包括动态表), 不修改动态表. 没有返回 css_atom_none
+extern int CssAtomFind(const char *name, int len);
+
+// 查找名称的 atom, 未知的名称加入动态表 (多线程安全). 动态 atom 不会释放, 只在当前进程中有效.
+//   动态表满了或者名称太长返回 css_atom_none
+extern int CssAtomIntern(const char *name, int len);
+
+// 已知名称表的 hash (CSS_ATOM_VOCABULARY), 打包的 keys 记录它
+extern uint32_t CssAtomVocabulary(void);
+
+// atom 的名称 (不以 '\0' 结尾时用 len), 无效的 atom 返回 0
+extern const char * CssAtomGetName(int atom, int *len);
+
+// 当前的 atom 个数 (包括 css_atom_none), 全部 atom 都小于这个值
+extern int CssAtomGetCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CSS_ATOM_H__ */
@@ -0,0 +1,197 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssbatch.c
+ * @brief 多个 CSS 文件的批量并行解析
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 21:10:08
+ * @date 2026-10-16 21:10:08
+ *
+ * @note
+ *   每个线程的队列是 cssPathFiles 中的一段 [next, end): 自己从头部取, 其他线程从尾部取.
+ *   一次只取一个文件, 队列用各自的互斥锁保护.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cssbatch.h"
+#include "cssalloc.h"
+#include "cssscan.h"
+#include "cssthread.h"
+
+
+#define CSS_BATCH_THREADS_MAX  64
+
+
+typedef struct {
+    struct CssBatchJob* job;
+    int index;
+
+    CssThreadMutex lock;
+    int next;       // 下一个自己解析的文件
+    int end;        // 队列尾部, 其他线程从这里取
+
+    CssThread thread;
+} CssBatchWorker;
+
+
+typedef struct CssBatchJob {
+    const char** cssPathFiles;
+    CssBatchResult* results;
+    int numWorkers;
+    const CssAllocator* allocator;  // 调用者的分配器, 每个线程都使用它
+    CssBatchWorker workers[CSS_BATCH_THREADS_MAX];
+} CssBatchJob;
+
+
+// 先取自己队列的头部, 再依次从其他线程队列的尾部取. 都没有返回 -1
+static int cssBatchTakeFile(CssBatchJob* job, int self)
+{
+    int k, file = -1;
+
+    for (k = 0; k < job->numWorkers && file < 0; k++) {
+        CssBatchWorker* w = &job->workers[(self + k) % job->numWorkers];
+
+        CssThreadMutexLock(&w->lock);
+        if (w->next < w->end) {
+            file = (k == 0) ? w->next++ : --w->end;
+        }
+        CssThreadMutexUnlock(&w->lock);
+    }
+    return file;
+}
+
+
+static CssKeyArray cssBatchParseFile(const char* cssPathFile)
+{
+    FILE* cssfile = fopen(cssPathFile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", cssPathFile);
+        return 0;
+    }
+
+    CssString cssString = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!cssString) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", cssPathFile);
+        return 0;
+    }
+
+    // 成功时 cssString 由 keys 拥有
+    CssKeyArray keys = CssStringParse(cssString);
+    if (!keys) {
+        printf("Error: CssStringParse() failed. cssfile=%s\n", cssPathFile);
+        CssStringFree(cssString);
+    }
+    return keys;
+}
+
+
+static void cssBatchWorkerRun(void* arg)
+{
+    CssBatchWorker* w = (CssBatchWorker*)arg;
+    CssBatchJob* job = w->job;
+    int file;
+
+    // 每个文件的 CssString 和 keys 都从调用者的分配器分配
+    CssSetAllocator(job->allocator);
+
+    while ((file = cssBatchTakeFile(job, w->index)) >= 0) {
+        CssBatchResult* result = &job->results[file];
+        struct timespec t0, t1;
+
+        timespec_get(&t0, TIME_UTC);
+        result->keys = cssBatchParseFile(job->cssPathFiles[file]);
+        timespec_get(&t1, TIME_UTC);
+
+        result->elapsedMs = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1000000.0;
+        result->thread = w->index;
+    }
+}
+
+
+int CssParseBatch(const char* cssPathFiles[], int numPaths, int numThreads, CssBatchResult results[])
+{
+    int k, numParsed = 0;
+
+    if (numPaths <= 0) {
+        return 0;
+    }
+
+    int numWorkers = (numThreads < numPaths) ? numThreads : numPaths;
+    if (numWorkers > CSS_BATCH_THREADS_MAX) {
+        numWorkers = CSS_BATCH_THREADS_MAX;
+    }
+    if (numWorkers < 1) {
+        numWorkers = 1;
+    }
+
+    CssBatchJob* job = (CssBatchJob*) CssMemAlloc(0, sizeof(CssBatchJob));
+    memset(job, 0, sizeof(CssBatchJob));
+
+    job->allocator = CssGetAllocator();
+    job->cssPathFiles = cssPathFiles;
+    job->results = results;
+    job->numWorkers = numWorkers;
+
+    memset(results, 0, sizeof(CssBatchResult) * numPaths);
+
+    for (k = 0; k < numWorkers; k++) {
+        CssBatchWorker* w = &job->workers[k];
+        w->job = job;
+        w->index = k;
+        w->next = (int)((long long)numPaths * k / numWorkers);
+        w->end = (int)((long long)numPaths * (k + 1) / numWorkers);
+        CssThreadMutexInit(&w->lock);
+    }
+
+    // 自动选择扫描方式时, 先在当前线程中选定, 避免多个线程同时设置
+    CssScanGetLevel();
+
+    // 当前线程作为第 0 个线程
+    for (k = 1; k < numWorkers; k++) {
+        CssThreadStart(&job->workers[k].thread, cssBatchWorkerRun, &job->workers[k]);
+    }
+    cssBatchWorkerRun(&job->workers[0]);
+    for (k = 1; k < numWorkers; k++) {
+        CssThreadJoin(&job->workers[k].thread);
+    }
+
+    for (k = 0; k < numWorkers; k++) {
+        CssThreadMutexUninit(&job->workers[k].lock);
+    }
+    CssMemFree(job->allocator, job);
+
+    for (k = 0; k < numPaths; k++) {
+        if (results[k].keys) {
+            numParsed++;
+        }
+    }
+    return numParsed;
+}
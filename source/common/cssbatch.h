@@ -0,0 +1,65 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssbatch.h
+ * @brief 多个 CSS 文件的批量并行解析
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 21:10:08
+ * @date 2026-10-16 21:10:08
+ *
+ * @note
+ *   固定数目的线程解析一组文件. 文件先平均分给每个线程, 线程做完自己的文件后
+ *   从其他线程的队列尾部取 (work stealing), 少数大文件不会让其他线程空闲.
+ *   每个文件的解析同 CssStringNewFromFile() + CssStringParse().
+ */
+#ifndef CSS_BATCH_H__
+#define CSS_BATCH_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include "cssparse.h"
+
+
+typedef struct {
+    CssKeyArray keys;    // 失败为 0, 使用完由调用者 CssKeyArrayFree()
+    double elapsedMs;    // 读文件和解析的耗时 (毫秒)
+    int thread;          // 解析该文件的线程 (0 ... numThreads-1)
+} CssBatchResult;
+
+
+// 用 numThreads 个线程解析 numPaths 个文件, results 与 cssPathFiles 一一对应.
+//   所有线程都使用调用者的分配器 (CssSetAllocator), 它必须可以在多个线程中同时使用 (arena 不可以).
+// 返回成功解析的文件数
+extern int CssParseBatch(const char* cssPathFiles[], int numPaths, int numThreads, CssBatchResult results[]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CSS_BATCH_H__ */
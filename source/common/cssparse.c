@@ -36,10 +36,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
 #include "cssparse.h"
-#include "smallregex.h"
+#include "cssalloc.h"
+#include "cssatom.h"
+#include "cssscan.h"
+#include "cssthread.h"
 
 
 #ifdef _DEBUG
@@ -50,13 +64,15 @@
 
 
 #define CssCheckNumKeys(keys)  do { \
-        if (keys >= CSS_KEYINDEX_INVALID_4096) { \
+        if (keys >= CSS_KEYINDEX_INVALID) { \
             printf("Error: Keys is too many (%d).\n", keys); \
             abort(); \
         } \
     } while(0)
 
 
+// 状态关键字 (CssBitFlag 的名称) 和它们的完美 hash 表, 由 gen-cssatom.py 生成
+// BEGIN gen-cssatom.py
 static const char* css_bitflag_array[] = {
     "readonly",
     "hidden",
@@ -72,7 +88,63 @@ static const char* css_bitflag_array[] = {
     0
 };
 
+#define CSS_BITFLAG_SLOTS     32
+#define CSS_BITFLAG_NAME_MAX  15
+#define CSS_BITFLAG_HASH_MUL  0xCA7FA579U
+
+// 空的 slot 长度为 0
+static const struct {
+    uint8_t length;
+    uint16_t flag;
+    char name[CSS_BITFLAG_NAME_MAX + 1];
+} css_bitflag_slots[CSS_BITFLAG_SLOTS] = {
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 6, 0x0002, "hidden" },
+    { 0, 0, "" },
+    { 7, 0x0200, "zoomout" },
+    { 6, 0x0008, "pickup" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 8, 0x0020, "deleting" },
+    { 7, 0x0400, "panning" },
+    { 5, 0x0040, "fault" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 8, 0x0001, "readonly" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 5, 0x0080, "flash" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 6, 0x0100, "zoomin" },
+    { 8, 0x0010, "dragging" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+    { 7, 0x0004, "hilight" },
+    { 0, 0, "" },
+    { 0, 0, "" },
+};
+// END gen-cssatom.py
+
 
+#ifdef CSS_KEYFIELD_WIDE
+struct CssKeyField {
+    unsigned int flags : 16;  // 16 个标记位
+    unsigned int type : 8;    // 类型
+    unsigned int : 8;
+    unsigned int length : 16; // 名称长度
+    unsigned int : 16;
+    uint32_t offset;
+    uint32_t keyidx;          // 如果当前是 class, 这个值为定义 class 的 {key:value ...} 的索引位置
+};
+#else
 struct CssKeyField {
     unsigned int flags : 16;  // 16 个标记位
     unsigned int type : 8;    // 类型
@@ -80,17 +152,57 @@ struct CssKeyField {
     unsigned int offset : 20;  // <= 0xFFFFF
     unsigned int keyidx : 12;  // 如果当前是 class, 这个值为定义 class 的 {key:value ...} 的索引位置
 };
+#endif
 
+typedef char CssKeyFieldSizeCheck[(sizeof(struct CssKeyField) == CSS_KEYFIELD_BYTES) ? 1 : -1];
 
-typedef struct CssKeyArrayData {
-    struct CssStringBuffer *cssString;
 
+// 数组头补齐到 CSS_KEYARRAY_HEAD_BYTES: 打包的映像从 64 字节边界开始时, keys 也从 64 字节边界开始
+#define CSS_KEYARRAY_HEAD_BYTES  128
+
+typedef struct CssKeyArrayData {
     union {
-        struct CssStringBuffer *__align_dummy;
+        char __head_pad[CSS_KEYARRAY_HEAD_BYTES];
 
         struct {
-            int32_t  UsedKeys;
-            int32_t  SizeKeys;
+            // 拥有的输入串, 只读解析时为 0
+            struct CssStringBuffer *cssString;
+
+            // keys 引用的文本: cssString->sbbuf, 调用者的只读缓冲或者文件映射
+            const char *cssText;
+
+            // 拥有的文件映射 (长度为 cssLen), 没有时为 0
+            const char *cssMapped;
+
+            // 创建时的分配器, 扩展和释放都使用它
+            const CssAllocator *allocator;
+
+            // 打包 (CssKeyArrayPack): packed 为 CSS_KEYARRAY_PACKED_MAGIC, 不使用上面的指针.
+            //   文本在数组头之后 textOffset 字节处, 整个映像 packedSize 字节,
+            //   分配的内存块开始于数组头之前 blockOffset 字节
+            uint32_t packed;
+            uint32_t packedSize;
+            uint32_t textOffset;
+            uint32_t blockOffset;
+
+            // class 名称索引 (CssClassIndex): 打包时在数组头之后 indexOffset 字节处 (0 表示没有),
+            //   否则在第一次查询时创建, 由 index 指向
+            uint32_t indexOffset;
+
+            // 打包时的已知属性名称表 (CssAtomVocabulary), 不同的表中 atom 不同
+            uint32_t atomVocabulary;
+
+            const void *index;
+
+            union {
+                struct CssStringBuffer *__align_dummy[2];
+
+                struct {
+                    uint32_t cssLen;
+                    int32_t  UsedKeys;
+                    int32_t  SizeKeys;
+                };
+            };
         };
     };
 
@@ -98,37 +210,105 @@ typedef struct CssKeyArrayData {
 } CssKeyArrayHead;
 
 
+#define CSS_KEYARRAY_PACKED_MAGIC  0x4B435343   // "CSCK"
+
+// 打包时 keys 和文本按 cache line 对齐
+#define CSS_KEYARRAY_PACKED_ALIGN  64
+
+typedef char CssKeyArrayHeadSizeCheck[(sizeof(CssKeyArrayHead) == CSS_KEYARRAY_HEAD_BYTES &&
+    CSS_KEYARRAY_HEAD_BYTES % CSS_KEYARRAY_PACKED_ALIGN == 0) ? 1 : -1];
+
+
+// class 名称索引, 只包含偏移, 可以随打包的映像复制.
+//   每种 class 类型 (class, id, asterisk) 一个开放寻址的表, 每个名称占一项,
+//   记录这个名称的第一个 key. next[i] 是与 key i 同类型同名称的下一个 key, -1 结束
+#define CSS_CLASS_INDEX_TYPES  3
+
+typedef struct {
+    uint32_t indexSize;
+    int32_t  numKeys;
+    uint32_t tableMask[CSS_CLASS_INDEX_TYPES];
+    uint32_t tableOffset[CSS_CLASS_INDEX_TYPES];    // int32_t[tableMask + 1], 从索引开始的偏移
+    uint32_t nextOffset;                            // int32_t[numKeys]
+
+    // 数字 id ("#0", "#12345", 没有前导 0, 不超过 UINT32_MAX): id 到第一个 key.
+    //   idRange 不太大时为 int32_t[idRange] (下标 id - idMin), 否则为 CssIdSlot[idMask + 1] 的开放寻址表
+    uint32_t idCount;
+    uint32_t idMin;
+    uint32_t idRange;                               // 0 表示使用开放寻址表
+    uint32_t idMask;
+    uint32_t idOffset;
+} CssClassIndex;
+
+
+typedef struct {
+    uint32_t id;
+    int32_t  key;   // -1 表示空
+} CssIdSlot;
+
+
 static CssKeyArrayHead * CssKeyArrayHeadData(CssKeyArray cssKeys)
 {
     return (CssKeyArrayHead *) ((char*)cssKeys - sizeof(struct CssKeyArrayData));
 }
 
 
-static int CssStyleClassSplit(const char *str, int len, const char *outstrs[], int outstrslen[], int maxoutnum)
+static CssKeyArray CssCreateKeysArray(int num, CssString cssString, const char* cssText, size_t cssLen)
 {
-    int num;
-    const char *start, *end;
+    if (num >= CSS_KEYINDEX_INVALID) {
+        printf("Error: too many keys(=%d)\n", num);
+        return 0;
+    }
 
-    num = 0;
-    start = str;
-    end = start;
-    while (num < maxoutnum && end - str < len) {
-        if (*end == 32) {
-            outstrs[num] = start;
-            outstrslen[num] = (int)(end++ - start);
-            start = end;
-            num++;
-        }
-        else {
-            end++;
-        }
+    size_t bsize = sizeof(CssKeyArrayHead) + num * sizeof(struct CssKeyField);
+    CssKeyArrayHead * data = (CssKeyArrayHead *) CssMemAlloc(0, bsize);
+    memset(data, 0, bsize);
+
+    data->allocator = CssGetAllocator();
+    data->cssString = cssString;
+    data->cssText = cssText;
+    data->cssLen = (uint32_t)cssLen;
+    data->SizeKeys = (int32_t)num;
+    data->UsedKeys = 0;
+
+    return data->keysArray;
+}
+
+
+// 在数组尾部追加 numAdd 个 key, 空间不够时按 2 倍扩展 (最多 CSS_KEYINDEX_INVALID - 1 个)
+// 返回第一个新 key 的指针. *pKeys 可能被 realloc 改变. 超过上限时退出
+static struct CssKeyField* CssKeyArrayAppend(CssKeyArray* pKeys, int numAdd)
+{
+    CssKeyArrayHead* data = CssKeyArrayHeadData(*pKeys);
+
+    // 先比较再相加, 不会溢出
+    if (numAdd < 0 || numAdd >= CSS_KEYINDEX_INVALID - data->UsedKeys) {
+        printf("Error: Keys is too many (%d + %d).\n", data->UsedKeys, numAdd);
+        abort();
     }
-    if (*start) {
-        outstrs[num] = start;
-        outstrslen[num] = (int)(end - start);
-        num++;
+    int numKeys = data->UsedKeys + numAdd;
+
+    if (numKeys > data->SizeKeys) {
+        // 0 个 key 的数组从 1 开始扩展
+        int sizeKeys = (data->SizeKeys > 0) ? data->SizeKeys : 1;
+        while (sizeKeys < numKeys) {
+            if (sizeKeys >= CSS_KEYINDEX_INVALID / 2) {
+                sizeKeys = CSS_KEYINDEX_INVALID - 1;
+                break;
+            }
+            sizeKeys *= 2;
+        }
+
+        data = (CssKeyArrayHead*) CssMemRealloc(data->allocator, data, sizeof(CssKeyArrayHead) + sizeKeys * sizeof(struct CssKeyField));
+        memset(&data->keysArray[data->SizeKeys], 0, (sizeKeys - data->SizeKeys) * sizeof(struct CssKeyField));
+
+        data->SizeKeys = (int32_t)sizeKeys;
+        *pKeys = data->keysArray;
     }
-    return num;
+
+    struct CssKeyField* keyField = &data->keysArray[data->UsedKeys];
+    data->UsedKeys = (int32_t)numKeys;
+    return keyField;
 }
 
 
@@ -137,34 +317,58 @@ static int cssKeyTypeIsClass(char keytype)
     return (keytype == css_type_class || keytype == css_type_id || keytype == css_type_asterisk) ? 1 : 0;
 }
 
-static int cssGetKeyBitFlag(const char* classflag, int flaglen)
+// 状态关键字只精确匹配 ("hid" 和 "hiddenx" 都不是 hidden). 完美 hash 只需要比较一个 slot
+static inline int cssGetKeyBitFlag(const char* classflag, int flaglen)
 {
-    if (flaglen < 4 || flaglen > 10) {
+    if (flaglen < 1 || flaglen > CSS_BITFLAG_NAME_MAX) {
         return css_bitflag_none;
     }
 
-    for (int i = 0; css_bitflag_array[i] != 0; i++) {
-        if (!strncmp(css_bitflag_array[i], classflag, flaglen)) {
-            return (CssBitFlag)(1 << i);
+    const unsigned char* p = (const unsigned char*)classflag;
+    uint32_t h = (uint32_t)p[0] | (uint32_t)p[flaglen >> 1] << 8 | (uint32_t)p[flaglen - 1] << 16 | (uint32_t)flaglen << 24;
+    int slot = (int)((h * CSS_BITFLAG_HASH_MUL) >> 27);
+
+    return (css_bitflag_slots[slot].length == flaglen && !memcmp(css_bitflag_slots[slot].name, classflag, flaglen)) ?
+        css_bitflag_slots[slot].flag : css_bitflag_none;
+}
+
+
+// 只读解析时跳过选择器中的注释: p 为有效的 "/*" 返回其后第一个 "*/" 之后的位置, 否则返回 p.
+//   lastComment 为全文最后一个 "*/" 的位置, 原地解析时为 0 (注释已经被改写为空格)
+static const char* cssSkipComment(const char* p, const char* end, const char* lastComment)
+{
+    if (lastComment && p + 2 <= lastComment && p + 1 < end && p[0] == '/' && p[1] == '*') {
+        const char* q = p + 1;
+        while (!(q[0] == '*' && q[1] == '/')) {
+            q++;
         }
+        return q + 2;
     }
-
-    return css_bitflag_none;
+    return p;
 }
 
 
-static int cssParseClassFlags(const char* start, int len, int offsets[], int lengths[], int classflags[], int nsize)
+// 选择器分词, 计算每个 class 的状态 flags. 返回词的数目;
+//   大于 nsize 时数组中只有前 nsize 个词, 也没有计算 flags, 调用者需要用更大的数组重新调用
+static int cssParseClassFlags(const char* start, int len, int offsets[], int lengths[], int classflags[], int nsize, const char* lastComment)
 {
     const char* p = start;
     const char* end = start + len;
     const char* str = 0;
+    const char* q;
     int n = 0;
 
-    while (len-- > 0 && n < nsize) {
-        if (*p == ' ' || *p == ',' || *p == '|' || *p == '\0') {
+    while (p < end) {
+        // 只读解析时 [\t \r " '] 没有被改写为空格, 注释也作为分隔
+        q = cssSkipComment(p, end, lastComment);
+
+        if (q != p || *p == ' ' || *p == ',' || *p == '|' || *p == '\0' ||
+            *p == 9 || *p == 13 || *p == 34 || *p == 39) {
             if (str) {
-                offsets[n] = (int)(str - start);
-                lengths[n] = (int)(p - str);
+                if (n < nsize) {
+                    offsets[n] = (int)(str - start);
+                    lengths[n] = (int)(p - str);
+                }
                 n++;
                 str = 0;
             }
@@ -173,15 +377,21 @@ static int cssParseClassFlags(const char* start, int len, int offsets[], int len
             str = p;
         }
 
-        p++;
+        p = (q != p) ? q : p + 1;
     }
 
     if (str) {
-        offsets[n] = (int)(str - start);
-        lengths[n] = (int)(p - str);
+        if (n < nsize) {
+            offsets[n] = (int)(str - start);
+            lengths[n] = (int)(p - str);
+        }
         n++;
     }
 
+    if (n > nsize) {
+        return n;
+    }
+
     /**
     * .a .b C D E  {...} -- both class a and b have all props C D E
     * .a, .b c d e {...} -- only class b has props C D E
@@ -206,8 +416,9 @@ static int cssParseClassFlags(const char* start, int len, int offsets[], int len
 
             // 如果是类, 查找后面逗号第一次出现的位置 stop
             const char* stop = str + len0;
-            while (stop != end && *stop != ',') {
-                stop++;
+            while (stop < end && *stop != ',') {
+                q = cssSkipComment(stop, end, lastComment);
+                stop = (q != stop) ? q : stop + 1;
             }
 
             // 查找后面的 key
@@ -236,15 +447,52 @@ static int cssParseClassFlags(const char* start, int len, int offsets[], int len
 }
 
 
-static int setCssKeyField(const char* cssString, struct CssKeyField* keyField, CssKeyType keytype, char* begin, int length)
+// 选择器的分词结果: 一般在栈上的数组中, 超过 256 个词时从堆上分配
+typedef struct {
+    int* offsets;
+    int* lengths;
+    int* keyflags;
+    int buf[3][CSS_VALUELEN_INVALID_256];
+} CssClassTokens;
+
+
+static int cssClassTokensParse(CssClassTokens* tokens, const char* begin, int length, const char* lastComment)
+{
+    tokens->offsets = tokens->buf[0];
+    tokens->lengths = tokens->buf[1];
+    tokens->keyflags = tokens->buf[2];
+
+    int n = cssParseClassFlags(begin, length, tokens->offsets, tokens->lengths, tokens->keyflags, CSS_VALUELEN_INVALID_256, lastComment);
+    if (n > CSS_VALUELEN_INVALID_256) {
+        int* heap = (int*) CssMemAlloc(0, sizeof(int) * 3 * (size_t)n);
+        tokens->offsets = heap;
+        tokens->lengths = heap + n;
+        tokens->keyflags = heap + 2 * (size_t)n;
+        n = cssParseClassFlags(begin, length, tokens->offsets, tokens->lengths, tokens->keyflags, n, lastComment);
+    }
+    return n;
+}
+
+
+static void cssClassTokensFree(CssClassTokens* tokens)
+{
+    if (tokens->offsets != tokens->buf[0]) {
+        CssMemFree(0, tokens->offsets);
+    }
+}
+
+
+static int setCssKeyField(const char* cssString, CssKeyArray* pKeys, CssKeyType keytype, const char* begin, int length, const char* lastComment)
 {
+    struct CssKeyField* keyField;
+
     int outkeys = 0;
 
-    char* end = begin + length - 1;
+    const char* end = begin + length - 1;
 
-    // 剔除头部无效字符
+    // 剔除头部无效字符 (属性集末尾的 '}' 与 ';' 等同)
     while (length > 0) {
-        if (*begin == ':' || *begin == ';' || *begin == ' ') {
+        if (*begin == ':' || *begin == ';' || *begin == '}' || *begin == ' ') {
             begin++;
             length--;
             continue;
@@ -263,45 +511,45 @@ static int setCssKeyField(const char* cssString, struct CssKeyField* keyField, C
     }
 
     if (cssKeyTypeIsClass(keytype)) {
-        int offsets[CSS_VALUELEN_INVALID_256];
-        int lengths[CSS_VALUELEN_INVALID_256];
-        int keyflags[CSS_VALUELEN_INVALID_256];
+        CssClassTokens tokens;
 
-        int numFlags = cssParseClassFlags(begin, length, offsets, lengths, keyflags, CSS_VALUELEN_INVALID_256);
+        int numFlags = cssClassTokensParse(&tokens, begin, length, lastComment);
 
         for (int k = 0; k < numFlags; k++) {
-            const char* classkey = begin + offsets[k];
-            int keyflag = keyflags[k];
+            const char* classkey = begin + tokens.offsets[k];
+            int keyflag = tokens.keyflags[k];
             if (keyflag >= 0) {
-                if (lengths[k] < CSS_VALUELEN_INVALID_256) {
-                    if (keyField) {
-                        keyField[outkeys].type = keytype;
-                        keyField[outkeys].flags = keyflag;
-                        keyField[outkeys].offset = (int)(classkey - cssString);
-                        keyField[outkeys].length = lengths[k];
-                    }
+                if (tokens.lengths[k] < CSS_VALUELEN_INVALID) {
+                    keyField = CssKeyArrayAppend(pKeys, 1);
+                    keyField->type = keytype;
+                    keyField->flags = keyflag;
+                    keyField->offset = (int)(classkey - cssString);
+                    keyField->length = tokens.lengths[k];
                     outkeys++;
                 }
                 else {
-                    printf("Error: css key has too many chars: %.*s\n", lengths[k], classkey);
+                    printf("Error: css key has too many chars: %.*s\n", tokens.lengths[k], classkey);
                     abort();
                 }
             }
         }
+
+        cssClassTokensFree(&tokens);
     }
     else {
-        if (length < CSS_VALUELEN_INVALID_256) {
-            if (keyField) {
-                keyField->offset = (unsigned int)(begin - cssString);
-                keyField->length = (unsigned int)length;
-                keyField->type = (unsigned int)keytype;
-                keyField->flags = css_bitflag_none;
-            }
+        if (length < CSS_VALUELEN_INVALID) {
+            keyField = CssKeyArrayAppend(pKeys, 1);
+            keyField->offset = (unsigned int)(begin - cssString);
+            keyField->length = (unsigned int)length;
+            keyField->type = (unsigned int)keytype;
+
+            // 属性名称的 flags 是它的 atom (见 cssatom.h), 只查已知的名称, 不修改全局的动态表
+            keyField->flags = (keytype == css_type_key) ? CssAtomFindKnown(begin, length) : css_bitflag_none;
 
             outkeys = 1;
         }
         else {
-            printf("Error: css key has too many chars: %s\n", begin);
+            printf("Error: css key has too many chars: %.*s\n", length, begin);
             abort();
         }
     }
@@ -310,7 +558,7 @@ static int setCssKeyField(const char* cssString, struct CssKeyField* keyField, C
 }
 
 
-// 检查并设置索引
+// 检查并设置索引. 分词时空的 {} 的 class 的 keyidx 标记为非 0, 这里改为 0 (没有属性)
 // 成功返回 UsedKeys, 失败返回 0
 static int CssKeyArrayBuild(const char* cssString, CssKeyArray cssKeys, int numKeys)
 {
@@ -318,11 +566,11 @@ static int CssKeyArrayBuild(const char* cssString, CssKeyArray cssKeys, int numK
     struct CssKeyField* start = cssKeys;
     struct CssKeyField* offkey = start;
 
-    if (numKeys < 2 || !cssKeyTypeIsClass(offkey->type)) {
+    if (numKeys < 1 || !cssKeyTypeIsClass(offkey->type)) {
         return 0;
     }
 
-    while (++offkey != NotKey) {
+    for (; offkey != NotKey; offkey++) {
         if (!cssKeyTypeIsClass(offkey->type)) { // offkey meets {k:v}
             // {} key 的索引必须为 0
             offkey->keyidx = 0;
@@ -334,6 +582,10 @@ static int CssKeyArrayBuild(const char* cssString, CssKeyArray cssKeys, int numK
                 DEBUG_ASSERT(start == offkey)
             }
         }
+        else if (offkey->keyidx) { // offkey meets class of {}
+            offkey->keyidx = 0;
+            start = offkey + 1;
+        }
         else { // offkey meets class
             if (!cssKeyTypeIsClass(start->type)) {
                 start = offkey;
@@ -347,183 +599,364 @@ static int CssKeyArrayBuild(const char* cssString, CssKeyArray cssKeys, int numK
 }
 
 
-static CssKeyArray CssCreateKeysArray(int num, CssString cssString)
+// 返回最后一个 "*/" 的位置, 没有返回 -1
+static int cssLastCommentEnd(const char* css, int cssLen)
 {
-    if (num >= CSS_KEYINDEX_INVALID_4096) {
-        printf("Error: too many keys(=%d)\n", num);
-        return 0;
+    int i = cssLen - 1;
+    while (i > 0) {
+        if (css[i] == '/' && css[i - 1] == '*') {
+            return i - 1;
+        }
+        i--;
     }
+    return -1;
+}
 
-    size_t bsize = sizeof(CssKeyArrayHead) + num * sizeof(struct CssKeyField);
-    CssKeyArrayHead * data = (CssKeyArrayHead *) malloc(bsize);
-    if (! data) {
-        printf("Error: Out of memory\n");
-        abort();
+
+// 分词器状态
+typedef enum {
+    css_token_selector = 0,   // 选择器: 上一个 '}' 之后到 '{' 之前
+    css_token_block = 1,      // 属性集: "{ key: value; ... }"
+    css_token_skip = 2,       // 没有选择器的 {...}, 跳过
+    css_token_comment = 3     // 注释: "/* ... */"
+} CssTokenState;
+
+
+// 只读解析时跟踪当前片段剔除头尾无效字符后的范围 (与 setCssKeyField 的剔除规则一致),
+// 注释内容不计入
+typedef struct {
+    int first;    // 第一个有效字符位置, -1 表示没有
+    int last;     // 最后一个有效字符位置
+} CssSpanTrim;
+
+
+// [from, to) 之间都是非结构字符, 其中只有空格是无效字符
+static void cssSpanTrimGap(CssSpanTrim* span, const char* css, int from, int to)
+{
+    int p;
+
+    if (span->first < 0) {
+        while (from < to && css[from] == ' ') {
+            from++;
+        }
+        if (from == to) {
+            return;
+        }
+        span->first = from;
     }
-    memset(data, 0, bsize);
 
-    data->cssString = cssString;
-    data->SizeKeys = (int32_t)num;
-    data->UsedKeys = 0;
+    p = to - 1;
+    while (p >= from && css[p] == ' ') {
+        p--;
+    }
+    if (p >= from) {
+        span->last = p;
+    }
+}
 
-    return data->keysArray;
+
+// c 是规范化之后的结构字符: 头部剔除 [: ; } 空格], 尾部剔除 [; } 空格]
+static void cssSpanTrimChar(CssSpanTrim* span, char c, int pos)
+{
+    if (c != ' ' && c != ';' && c != '}') {
+        if (span->first < 0 && c != ':') {
+            span->first = pos;
+        }
+        span->last = pos;
+    }
 }
 
 
-static int cssParseKeys(CssString cssString, CssKeyArray outKeys)
+// 按跟踪的范围添加 key, 全部无效时为 end 位置的空串
+static int cssSpanKeyField(const char* css, CssKeyArray* pKeys, CssKeyType keytype, const CssSpanTrim* span, int end, const char* lastComment)
 {
-    int p, q, len;
-    char tmpChar, * markStr;
+    if (span->first < 0) {
+        return setCssKeyField(css, pKeys, keytype, css + end, 0, lastComment);
+    }
+    return setCssKeyField(css, pKeys, keytype, css + span->first, span->last - span->first + 1, lastComment);
+}
 
-    char* css, * begin, * end, * start, * next;
-    int keys = 0;
 
-    const int SizeKeys = CssKeyArrayGetSize(outKeys);
+// SAX: 选择器中的每个 class 调用 on_rule_begin. 返回非 0 停止解析
+static int cssSaxRuleBegin(const char* css, const CssSaxHandler* sax, CssKeyType keytype, const CssSpanTrim* span, const char* lastComment)
+{
+    CssClassTokens tokens;
+    int stop = 0;
 
-    int cssLen = cssString->sblen;
+    const char* begin = css + span->first;
 
-    css = cssString->sbbuf;
-    while (*css) {
-        tmpChar = *css;
-        if (tmpChar == 9 || tmpChar == 13 || tmpChar == 34 || tmpChar == 39) {
-            // 用空格替代字符: [\t \r " ']
-            *css = 32;  // space
-        }
-        else if (tmpChar == 10) {
-            // 用 ; 替代换行符: [\n]
-            *css = 59;
-        }
-        css++;
+    int numFlags = cssClassTokensParse(&tokens, begin, span->last - span->first + 1, lastComment);
+
+    for (int k = 0; k < numFlags && !stop; k++) {
+        stop = tokens.keyflags[k] >= 0 && sax->on_rule_begin(sax->userData, keytype, begin + tokens.offsets[k], tokens.lengths[k], tokens.keyflags[k]);
     }
 
-    // 用空格替换注释: "/* ... */"
-    struct small_regex* recomment = regex_compile("/\\*.*?\\*/");
-    css = cssString->sbbuf;
-    while (*css) {
-        p = regex_matchp(recomment, css);
-        if (p < 0) {
-            break;
-        }
-        start = css + p;
-        next = strstr(start, "*/") + 2;
-        len = (unsigned int)(next - start);
+    cssClassTokensFree(&tokens);
+    return stop;
+}
 
-        while (len-- > 0) {
-            *start++ = 32;
-        }
-        css = next;
+
+// SAX: 按 key 和 value 的片段调用 on_declaration. 返回非 0 停止解析
+static int cssSaxDeclaration(const char* css, const CssSaxHandler* sax, const CssSpanTrim* keySpan, int colon, const CssSpanTrim* valSpan, int end)
+{
+    const char* key = css + colon;
+    const char* value = css + end;
+    int keyLen = 0, valueLen = 0;
+
+    if (keySpan->first >= 0) {
+        key = css + keySpan->first;
+        keyLen = keySpan->last - keySpan->first + 1;
+    }
+    if (valSpan->first >= 0) {
+        value = css + valSpan->first;
+        valueLen = valSpan->last - valSpan->first + 1;
     }
-    regex_free(recomment);
+    return sax->on_declaration(sax->userData, key, keyLen, value, valueLen);
+}
 
-    // 查找每个属性集: "{ key: value; ... }"
-    struct small_regex* reclass = regex_compile("{.*?}");
-    struct small_regex* rekey = regex_compile(":.*?;");
 
-    css = cssString->sbbuf;
-    while (*css) {
-        p = regex_matchp(reclass, css);
-        if (p < 0) {
-            break;
-        }
+// 单次向前扫描的字节状态机, 不回溯.
+//   原地解析 (wcss == css): 输入中的 [\t \r " '] 被改写为空格, [\n] 被改写为 ';',
+//   注释被改写为空格.
+//   只读解析 (wcss == 0): 不写输入, 规范化只在分词时进行, 头尾剔除由 CssSpanTrim 完成.
+//   注释从 "/*" 开始, 到其后第一个 "*/" 结束. 如果后面再没有 "*/",
+//   则 "/*" 不作为注释处理. 文本在 cssLen 或者第一个 '\0' 处结束.
+//   textLen >= cssLen: 判断 "/*" 是否成立时查找 "*/" 的范围 (流式解析时包含后面的输入).
+//   lastComment: 已知的最后一个 "*/" 的位置 (相对 css, 没有为 -1), -2 表示在 textLen 范围内查找.
+//   sax 不为 0 时 (只读解析) 不生成 keys, 直接回调, 返回闭合的 class 规则数, 被停止返回 -1.
+//   生成 keys 时返回 keys 数目, 末尾未闭合的 {...} 被丢弃, 空的 {} 只有选择器的 class, 索引由 CssKeyArrayBuild() 设置.
+static int cssParseKeys(const char* css, int cssLen, int textLen, int lastComment, char* wcss, CssKeyArray* pKeys, const CssSaxHandler* sax)
+{
+    char c;
+
+    CssTokenState state = css_token_selector;
+    CssTokenState commentRet = css_token_selector;
+
+    CssSpanTrim span = { -1, -1 };     // 当前片段: 选择器, key 或者 value
+    CssSpanTrim keySpan = { -1, -1 };  // 遇到 ':' 时保存的 key 片段
+
+    uint64_t mask;
+    int base, i;
+    int next = 0;          // 小于 next 的位置已经处理过
+    int prev = -1;         // 上一个处理过的结构字符位置
+    int commentBegin = 0;  // 注释 "/*" 的位置
+    int classBegin = -1;   // 选择器名起始位置
+    int declBegin = 0;     // 当前属性 key 起始位置
+    int colon = -1;        // 当前属性 ':' 位置
+    int blockKeys = 0;     // 进入 {} 之前的 keys 数目
+    int ruleKeys = 0;      // 进入 {} 之后的 keys 数目 (包含选择器的 class)
+    int keys = 0;
+    int rules = 0;         // SAX: 闭合的 class 规则数
 
-        start = css + p;
-        DEBUG_ASSERT(*start == '{')
+    // 只读解析时传给 cssParseClassFlags
+    const char* lastCommentPtr = (!wcss && lastComment >= 0) ? css + lastComment : 0;
 
-            next = strchr(start, '}') + 1;
-        len = (unsigned int)(next - start);
+    // 每次取 64 字节的结构字符位掩码, 只访问结构字符
+    for (base = 0; base < cssLen; base += 64) {
+        mask = CssScanMask64(css + base, (cssLen - base < 64) ? (cssLen - base) : 64);
 
-        // 获取选择器名
-        CssKeyType keytype = css_type_none;
-        begin = css;
-        while (begin < start) {
-            // 选择器名只处理 3 种情况:
-            if (cssKeyTypeIsClass(*begin)) {
-                keytype = (CssKeyType)*begin;
-                break;
+        while (mask) {
+            i = base + CssScanFirstBit(mask);
+            mask &= mask - 1;
+
+            if (i < next) {
+                continue;
             }
-            begin++;
-            p--;
-        }
 
-        if (p > 0) {
-            // 如果发现选择器
-            keys += setCssKeyField(cssString->sbbuf, ((outKeys && keys < SizeKeys) ? &outKeys[keys] : 0), keytype, begin, p);
-            CssCheckNumKeys(keys);
+            c = css[i];
+            if (c == '\0') {
+                goto end_of_css;
+            }
 
-            markStr = start + len - 1;
-            DEBUG_ASSERT(*markStr == '}');
-            *markStr = ';';
-            tmpChar = *next; *next = '\0';
+            if (c == 9 || c == 13 || c == 34 || c == 39) {
+                // 用空格替代字符: [\t \r " ']
+                c = 32;
+                if (wcss) {
+                    wcss[i] = c;
+                }
+            }
+            else if (c == 10) {
+                // 用 ; 替代换行符: [\n]
+                c = 59;
+                if (wcss) {
+                    wcss[i] = c;
+                }
+            }
 
-            start++;
-            while (start < next) {
-                // 查找属性: key : value ;
-                q = regex_matchp(rekey, start);
-                if (q < 0) {
-                    break;
+            if (state == css_token_comment) {
+                if (c == '/' && css[i - 1] == '*') {
+                    if (wcss) {
+                        // 用空格替换注释: "/* ... */"
+                        memset(wcss + commentBegin, 32, i - commentBegin + 1);
+                    }
+                    state = commentRet;
+                    prev = i;
                 }
+                continue;
+            }
 
-                begin = start + q;
-                end = strchr(begin, ';') + 1;
-                len = (unsigned int)(end - begin);
+            if (!wcss && (state == css_token_block || (state == css_token_selector && classBegin >= 0))) {
+                cssSpanTrimGap(&span, css, prev + 1, i);
+            }
+            prev = i;
+
+            switch (c) {
+            case '/':
+                if (i + 1 < cssLen && css[i + 1] == '*') {
+                    if (lastComment == -2) {
+                        const char* nul = (const char*)memchr(css + i, 0, textLen - i);
+                        lastComment = cssLastCommentEnd(css, nul ? (int)(nul - css) : textLen);
+                        if (!wcss && lastComment >= 0) {
+                            lastCommentPtr = css + lastComment;
+                        }
+                    }
+                    if (lastComment >= i + 2) {
+                        // "/*/" 也是完整注释
+                        commentBegin = i;
+                        commentRet = state;
+                        state = css_token_comment;
+                        next = i + 2;
+                        continue;
+                    }
+                }
+                break;
 
-                DEBUG_ASSERT(*begin == ':');
-                DEBUG_ASSERT(begin[len - 1] == ';');
+            case '.':
+            case '#':
+            case '*':
+                // 选择器名只处理 3 种情况
+                if (state == css_token_selector && classBegin < 0) {
+                    classBegin = i;
+                    span.first = span.last = -1;
+                }
+                break;
 
-                // set key
-                keys += setCssKeyField(cssString->sbbuf, ((outKeys && keys < SizeKeys) ? &outKeys[keys] : 0), css_type_key, start, q);
-                CssCheckNumKeys(keys);
+            case '{':
+                if (state == css_token_selector) {
+                    blockKeys = keys;
+                    if (classBegin >= 0) {
+                        if (sax) {
+                            if (sax->on_rule_begin && cssSaxRuleBegin(css, sax, (CssKeyType)css[classBegin], &span, lastCommentPtr)) {
+                                goto stop_sax;
+                            }
+                        }
+                        else if (wcss) {
+                            keys += setCssKeyField(css, pKeys, (CssKeyType)css[classBegin], css + classBegin, i - classBegin, 0);
+                        }
+                        else {
+                            keys += cssSpanKeyField(css, pKeys, (CssKeyType)css[classBegin], &span, i, lastCommentPtr);
+                        }
+                        ruleKeys = keys;
+                        state = css_token_block;
+                    }
+                    else {
+                        state = css_token_skip;
+                    }
+                    declBegin = i + 1;
+                    colon = -1;
+                    span.first = span.last = -1;
+                    continue;
+                }
+                break;
 
-                // set value
-                keys += setCssKeyField(cssString->sbbuf, ((outKeys && keys < SizeKeys) ? &outKeys[keys] : 0), css_type_value, begin, len);
-                CssCheckNumKeys(keys);
+            case ':':
+                if (state == css_token_block && colon < 0) {
+                    colon = i;
+                    keySpan = span;
+                    span.first = span.last = -1;
+                }
+                break;
 
-                start = end;
+            case ';':
+            case '}':
+                if (state == css_token_block && colon >= 0) {
+                    // 属性: key : value ;
+                    if (sax) {
+                        if (sax->on_declaration && cssSaxDeclaration(css, sax, &keySpan, colon, &span, i + 1)) {
+                            goto stop_sax;
+                        }
+                    }
+                    else if (wcss) {
+                        keys += setCssKeyField(css, pKeys, css_type_key, css + declBegin, colon - declBegin, 0);
+                        keys += setCssKeyField(css, pKeys, css_type_value, css + colon, i - colon + 1, 0);
+                    }
+                    else {
+                        keys += cssSpanKeyField(css, pKeys, css_type_key, &keySpan, colon, 0);
+                        keys += cssSpanKeyField(css, pKeys, css_type_value, &span, i + 1, 0);
+                    }
+                    declBegin = i + 1;
+                    colon = -1;
+                    span.first = span.last = -1;
+                }
+                if (c == '}' && state != css_token_selector) {
+                    if (sax && state == css_token_block) {
+                        rules++;
+                        if (sax->on_rule_end && sax->on_rule_end(sax->userData)) {
+                            goto stop_sax;
+                        }
+                    }
+                    else if (state == css_token_block && keys == ruleKeys) {
+                        // 空的 {}: 选择器的 class 没有属性. keyidx 暂时标记为非 0,
+                        // CssKeyArrayBuild() 不让它们取得后面规则的属性
+                        for (int k = blockKeys; k < keys; k++) {
+                            (*pKeys)[k].keyidx = 1;
+                        }
+                    }
+                    // go to next braces: {}
+                    state = css_token_selector;
+                    classBegin = -1;
+                }
+                // ';' 和 '}' 在片段中都是无效字符
+                continue;
             }
 
-            DEBUG_ASSERT(*markStr == ';')
-                * markStr = '}';
-
-            DEBUG_ASSERT(*next == '\0')
-                * next = tmpChar;
+            if (!wcss) {
+                cssSpanTrimChar(&span, c, i);
+            }
         }
+    }
 
-        // go to next braces: {}
-        css = next;
+end_of_css:
+    if (sax) {
+        // 未闭合的 {...} 没有 on_rule_end
+        return rules;
     }
-    regex_free(rekey);
-    regex_free(reclass);
 
-    // 用户必须判断返回的 keys > 0
-    if (keys > SizeKeys) {
-        // 负值表示输入的空间不够, 其绝对值为需要的空间大小
-        return -keys;
+    if (state != css_token_selector) {
+        // 未闭合的 {...} 丢弃
+        keys = blockKeys;
+        CssKeyArrayHeadData(*pKeys)->UsedKeys = keys;
     }
+    return keys;
+
+stop_sax:
+    return -1;
+}
+
+
+// 分词并设置索引, 成功返回 keys 数目, 失败返回 0
+static int cssParseKeyArray(const char* css, int cssLen, int textLen, char* wcss, CssKeyArray* pKeys)
+{
+    int keys = cssParseKeys(css, cssLen, textLen, -2, wcss, pKeys, 0);
 
-    if (!CssKeyArrayBuild(cssString->sbbuf, outKeys, keys)) {
-        // 失败返回 0
+    if (!CssKeyArrayBuild(css, *pKeys, keys)) {
         printf("Error: CssKeyArrayBuild() failed.\n");
         return 0;
     }
-
-    // 成功返回保存 Keys 数目
-    return CssKeyArrayGetUsed(outKeys);
+    return keys;
 }
 
 
 CssString CssStringNew(const char* cssStr, size_t cssStrLen)
 {
     size_t cbSize = (cssStrLen + 16) / 16 * 16;
-    if (cbSize > CSS_STRING_BSIZE_MAX_1048576) {
+    if (cbSize > CSS_STRING_BSIZE_MAX) {
         printf("Error: size is too long\n");
         return 0;
     }
 
-    struct CssStringBuffer *sbuf = (struct CssStringBuffer *) malloc(sizeof(struct CssStringBuffer) + sizeof(char) * cbSize);
-    if (!sbuf) {
-        printf("Error: Out of memory.\n");
-        abort();
-    }
+    const CssAllocator *allocator = CssGetAllocator();
+    struct CssStringBuffer *sbuf = (struct CssStringBuffer *) CssMemAlloc(allocator, sizeof(struct CssStringBuffer) + sizeof(char) * cbSize);
 
     if (cssStr) {
         memcpy(sbuf->sbbuf, cssStr, cssStrLen);
@@ -535,6 +968,7 @@ CssString CssStringNew(const char* cssStr, size_t cssStrLen)
     sbuf->sbbuf[cssStrLen] = '\0';
     sbuf->sbsize = (uint32_t) cbSize;
     sbuf->sblen = (uint32_t) cssStrLen;
+    sbuf->allocator = allocator;
 
     return sbuf;
 }
@@ -546,7 +980,7 @@ CssString CssStringNewFromFile(FILE* cssfile)
     rewind(cssfile);
     if (fseek(cssfile, 0, SEEK_END) == 0) {
         int bsize = (int)ftell(cssfile);
-        if (bsize >= CSS_STRING_BSIZE_MAX_1048576) {
+        if (bsize >= CSS_STRING_BSIZE_MAX) {
             printf("Error: css file is too big.\n");
             return 0;
         }
@@ -567,8 +1001,79 @@ CssString CssStringNewFromFile(FILE* cssfile)
 void CssStringFree(CssString cssString)
 {
     if (cssString) {
-        free(cssString);
+        CssMemFree(cssString->allocator, cssString);
+    }
+}
+
+
+// 只读映射整个文件, 成功返回映射地址, 失败返回 0
+static const char* cssMapFile(const char* cssPathFile, size_t* fileSize)
+{
+    const char* addr = 0;
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    HANDLE hMap;
+    HANDLE hFile = CreateFileA(cssPathFile, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        printf("Error: open file failed: %s\n", cssPathFile);
+        return 0;
+    }
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || size.QuadPart >= CSS_STRING_BSIZE_MAX) {
+        printf("Error: css file is empty or too big: %s\n", cssPathFile);
+        CloseHandle(hFile);
+        return 0;
+    }
+    hMap = CreateFileMappingA(hFile, 0, PAGE_READONLY, 0, 0, 0);
+    if (hMap) {
+        addr = (const char*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMap);
+    }
+    CloseHandle(hFile);
+    *fileSize = (size_t)size.QuadPart;
+#else
+    struct stat st;
+    int flags = MAP_PRIVATE;
+    int fd = open(cssPathFile, O_RDONLY);
+    if (fd == -1) {
+        printf("Error: open file failed: %s\n", cssPathFile);
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size >= CSS_STRING_BSIZE_MAX) {
+        printf("Error: css file is empty or too big: %s\n", cssPathFile);
+        close(fd);
+        return 0;
+    }
+#ifdef MAP_POPULATE
+    // 一次建立全部页表, 解析时不再缺页
+    flags |= MAP_POPULATE;
+#endif
+    addr = (const char*)mmap(0, (size_t)st.st_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (addr == (const char*)MAP_FAILED) {
+        addr = 0;
+    }
+    else {
+        madvise((void*)addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+    }
+    *fileSize = (size_t)st.st_size;
+#endif
+
+    if (!addr) {
+        printf("Error: map file failed: %s\n", cssPathFile);
     }
+    return addr;
+}
+
+
+static void cssUnmapFile(const char* addr, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(addr);
+#else
+    munmap((void*)addr, size);
+#endif
 }
 
 
@@ -576,8 +1081,19 @@ void CssKeyArrayFree(CssKeyArray cssKeys)
 {
     if (cssKeys) {
         CssKeyArrayHead *data = CssKeyArrayHeadData(cssKeys);
+        if (data->packed == CSS_KEYARRAY_PACKED_MAGIC) {
+            // 分配器保存在映像之前
+            const CssAllocator *allocator;
+            memcpy(&allocator, (char *)data - sizeof(allocator), sizeof(allocator));
+            CssMemFree(allocator, (char *)data - data->blockOffset);
+            return;
+        }
         CssStringFree(data->cssString);
-        free(data);
+        if (data->cssMapped) {
+            cssUnmapFile(data->cssMapped, data->cssLen);
+        }
+        CssMemFree(data->allocator, (void *)data->index);
+        CssMemFree(data->allocator, data);
     }
 }
 
@@ -585,76 +1101,868 @@ void CssKeyArrayFree(CssKeyArray cssKeys)
 const char* CssKeyArrayGetString(const CssKeyArray cssKeys, unsigned int offset)
 {
     CssKeyArrayHead* data = CssKeyArrayHeadData(cssKeys);
-    return (offset < data->cssString->sblen ? &data->cssString->sbbuf[offset] : 0);
+    const char *cssText = (data->packed == CSS_KEYARRAY_PACKED_MAGIC) ? (const char *)data + data->textOffset : data->cssText;
+    return (offset < data->cssLen ? &cssText[offset] : 0);
 }
 
 
-int CssKeyArrayGetSize(const CssKeyArray cssKeys)
+static int cssClassIndexType(int keytype)
 {
-    if (cssKeys) {
-        CssKeyArrayHead* data = CssKeyArrayHeadData(cssKeys);
-        return (int) data->SizeKeys;
+    switch (keytype) {
+    case css_type_class:
+        return 0;
+    case css_type_id:
+        return 1;
+    case css_type_asterisk:
+        return 2;
+    default:
+        return -1;
     }
-    return 0;
 }
 
 
-int CssKeyArrayGetUsed(const CssKeyArray cssKeys)
+// FNV-1a, 到 '\0' 为止 (名称比较使用 strncmp)
+static uint32_t cssClassNameHash(const char *name, int len)
 {
-    if (cssKeys) {
-        CssKeyArrayHead* data = CssKeyArrayHeadData(cssKeys);
-        return (int)data->UsedKeys;
-    }
-    return 0;
+    return CssHashFnv1a(name, (int)strnlen(name, (size_t)len));
 }
 
 
-CssKeyArray CssStringParse(CssString cssString)
+// "#12345" 形式的 id 返回 1 并写入 id. 与字符串比较一致: "#012" 不是数字 id
+static int cssClassNumericId(const char *name, int len, uint32_t *id)
 {
-    int numKeys = cssParseKeys(cssString, 0);
-    if (numKeys < 0) {
-        numKeys *= -1;
-        CssKeyArray keysArray = CssCreateKeysArray(numKeys, cssString);
-        if (keysArray) {
-            if (cssParseKeys(cssString, keysArray) == numKeys) {
-                return keysArray;
-            }
-            CssKeyArrayHead* data = CssKeyArrayHeadData(keysArray);
-            data->cssString = 0;
-            CssKeyArrayFree(keysArray);
-        }
+    if (len < 2 || len > 11 || name[0] != '#' || (name[1] == '0' && len > 2)) {
+        return 0;
     }
-    return 0;
-}
-
 
-const CssKeyArrayNode CssKeyArrayGetNode(const CssKeyArray cssKeys, int index)
-{
-    int numKeys = CssKeyArrayGetUsed(cssKeys);
-    if (index < numKeys) {
-        return (CssKeyArrayNode)(cssKeys + index);
+    uint64_t value = 0;
+    for (int i = 1; i < len; i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return 0;
+        }
+        value = value * 10 + (uint64_t)(name[i] - '0');
     }
-    return 0;
+    if (value > 0xFFFFFFFFU) {
+        return 0;
+    }
+
+    *id = (uint32_t)value;
+    return 1;
 }
 
 
-CssKeyType CssKeyGetType(const CssKeyArrayNode cssKey)
+static uint32_t cssIdHash(uint32_t id)
 {
-    return cssKey->type;
+    id *= 2654435769U;
+    return id ^ (id >> 16);
 }
 
 
-int CssKeyGetFlag(const CssKeyArrayNode cssKey)
+static size_t cssClassIndexTableSize(int count)
 {
-    return (int)(cssKey->flags);
+    // 装载因子不超过 1/2
+    size_t size = 1;
+    while (size < (size_t)count * 2) {
+        size *= 2;
+    }
+    return size;
 }
 
 
-int CssKeyOffsetLength(const CssKeyArrayNode cssKeyNode, int* bOffset)
+// 计算索引的大小 (out 为 0), 或者在 out 中创建索引
+static size_t cssClassIndexBuild(const CssKeyArray cssKeys, CssClassIndex *out)
 {
-    *bOffset = (int)cssKeyNode->offset;
-    return (int)cssKeyNode->length;
-}
+    const int numKeys = CssKeyArrayGetUsed(cssKeys);
+    int counts[CSS_CLASS_INDEX_TYPES] = { 0 };
+    int i, t;
+
+    uint32_t id, idCount = 0, idMin = 0xFFFFFFFFU, idMax = 0;
+
+    for (i = 0; i < numKeys; i++) {
+        t = cssClassIndexType(cssKeys[i].type);
+        if (t >= 0) {
+            counts[t]++;
+        }
+        if (cssKeys[i].type == css_type_id &&
+            cssClassNumericId(CssKeyArrayGetString(cssKeys, cssKeys[i].offset), cssKeys[i].length, &id)) {
+            idCount++;
+            idMin = id < idMin ? id : idMin;
+            idMax = id > idMax ? id : idMax;
+        }
+    }
+
+    size_t size = sizeof(CssClassIndex);
+    uint32_t tableOffset[CSS_CLASS_INDEX_TYPES];
+    for (t = 0; t < CSS_CLASS_INDEX_TYPES; t++) {
+        tableOffset[t] = (uint32_t)size;
+        size += cssClassIndexTableSize(counts[t]) * sizeof(int32_t);
+    }
+    uint32_t nextOffset = (uint32_t)size;
+    size += (size_t)numKeys * sizeof(int32_t);
+
+    // 数字 id 比较密集 (范围不超过个数的 4 倍) 时直接用数组, 否则用开放寻址表
+    uint32_t idOffset = (uint32_t)size;
+    uint64_t idRange = idCount ? (uint64_t)idMax - idMin + 1 : 0;
+    uint32_t idSlots = 0;
+    if (idRange && idRange <= (uint64_t)idCount * 4 + 64) {
+        size += (size_t)idRange * sizeof(int32_t);
+    }
+    else {
+        idRange = 0;
+        idSlots = (uint32_t)cssClassIndexTableSize((int)idCount);
+        size += (size_t)idSlots * sizeof(CssIdSlot);
+    }
+
+    if (!out) {
+        return size;
+    }
+
+    out->indexSize = (uint32_t)size;
+    out->numKeys = numKeys;
+    out->nextOffset = nextOffset;
+    for (t = 0; t < CSS_CLASS_INDEX_TYPES; t++) {
+        out->tableOffset[t] = tableOffset[t];
+        out->tableMask[t] = (uint32_t)cssClassIndexTableSize(counts[t]) - 1;
+    }
+    out->idCount = idCount;
+    out->idMin = idCount ? idMin : 0;
+    out->idRange = (uint32_t)idRange;
+    out->idMask = idSlots ? idSlots - 1 : 0;
+    out->idOffset = idOffset;
+
+    // 全部置为 -1
+    memset((char *)out + sizeof(CssClassIndex), 0xFF, size - sizeof(CssClassIndex));
+
+    int32_t *next = (int32_t *)((char *)out + nextOffset);
+    int32_t *idArray = (int32_t *)((char *)out + idOffset);
+    CssIdSlot *idTable = (CssIdSlot *)((char *)out + idOffset);
+
+    // 从后向前插入, 同名的 key 按原来的顺序链接
+    for (i = numKeys - 1; i >= 0; i--) {
+        t = cssClassIndexType(cssKeys[i].type);
+        if (t < 0) {
+            continue;
+        }
+        int32_t *table = (int32_t *)((char *)out + tableOffset[t]);
+        const char *name = CssKeyArrayGetString(cssKeys, cssKeys[i].offset);
+        int len = cssKeys[i].length;
+        uint32_t slot = cssClassNameHash(name, len) & out->tableMask[t];
+
+        while (table[slot] >= 0) {
+            const struct CssKeyField *first = &cssKeys[table[slot]];
+            if ((int)first->length == len && !strncmp(CssKeyArrayGetString(cssKeys, first->offset), name, len)) {
+                break;
+            }
+            slot = (slot + 1) & out->tableMask[t];
+        }
+        next[i] = table[slot];
+        table[slot] = i;
+
+        // 同名的 key 已经链接, 只记录第一个
+        if (t == 1 && cssClassNumericId(name, len, &id)) {
+            if (idRange) {
+                idArray[id - idMin] = i;
+            }
+            else {
+                uint32_t k = cssIdHash(id) & out->idMask;
+                while (idTable[k].key >= 0 && idTable[k].id != id) {
+                    k = (k + 1) & out->idMask;
+                }
+                idTable[k].id = id;
+                idTable[k].key = i;
+            }
+        }
+    }
+    return size;
+}
+
+
+// 返回第一个 "#id" 的索引, 没有返回 -1
+static inline int cssClassIndexFindId(const CssClassIndex *index, uint32_t id)
+{
+    if (index->idRange) {
+        uint32_t k = id - index->idMin;
+        return (k < index->idRange) ? ((const int32_t *)((const char *)index + index->idOffset))[k] : -1;
+    }
+
+    const CssIdSlot *idTable = (const CssIdSlot *)((const char *)index + index->idOffset);
+    uint32_t k = cssIdHash(id) & index->idMask;
+    while (idTable[k].key >= 0) {
+        if (idTable[k].id == id) {
+            return idTable[k].key;
+        }
+        k = (k + 1) & index->idMask;
+    }
+    return -1;
+}
+
+
+// 返回第一个名称为 name 的 key 的索引, 没有返回 -1
+static int cssClassIndexFind(const CssKeyArray cssKeys, const CssClassIndex *index, int t, const char *name, int len)
+{
+    const int32_t *table = (const int32_t *)((const char *)index + index->tableOffset[t]);
+    uint32_t slot = cssClassNameHash(name, len) & index->tableMask[t];
+
+    while (table[slot] >= 0) {
+        const struct CssKeyField *first = &cssKeys[table[slot]];
+        if ((int)first->length == len && !strncmp(CssKeyArrayGetString(cssKeys, first->offset), name, len)) {
+            return table[slot];
+        }
+        slot = (slot + 1) & index->tableMask[t];
+    }
+    return -1;
+}
+
+
+// 打包的映像中的索引, 或者第一次调用时创建. 多个线程同时调用时只有一个索引被保留
+static const CssClassIndex * cssClassIndexGet(const CssKeyArray cssKeys)
+{
+    CssKeyArrayHead *data = CssKeyArrayHeadData(cssKeys);
+
+    if (data->packed == CSS_KEYARRAY_PACKED_MAGIC) {
+        return data->indexOffset ? (const CssClassIndex *)((const char *)data + data->indexOffset) : 0;
+    }
+
+    const void *index = CssAtomicLoadPtr(&data->index);
+    if (index) {
+        return (const CssClassIndex *)index;
+    }
+
+    CssClassIndex *built = (CssClassIndex *) CssMemAlloc(data->allocator, cssClassIndexBuild(cssKeys, 0));
+    cssClassIndexBuild(cssKeys, built);
+
+    index = CssAtomicSetPtr(&data->index, built);
+    if (index) {
+        // 另一个线程先创建了
+        CssMemFree(data->allocator, built);
+        return (const CssClassIndex *)index;
+    }
+    return built;
+}
+
+
+static size_t cssPackedAlign(size_t size)
+{
+    return (size + CSS_KEYARRAY_PACKED_ALIGN - 1) / CSS_KEYARRAY_PACKED_ALIGN * CSS_KEYARRAY_PACKED_ALIGN;
+}
+
+
+CssKeyArray CssKeyArrayPack(const CssKeyArray cssKeys)
+{
+    CssKeyArrayHead *data = CssKeyArrayHeadData(cssKeys);
+    const char *cssText = CssKeyArrayGetString(cssKeys, 0);
+
+    // 映像: 数组头, keys (对齐), 文本 (对齐, 以 '\0' 结尾), class 索引 (对齐)
+    size_t keysSize = (size_t)data->UsedKeys * sizeof(struct CssKeyField);
+    size_t textOffset = cssPackedAlign(sizeof(CssKeyArrayHead) + keysSize);
+    size_t indexOffset = cssPackedAlign(textOffset + data->cssLen + 1);
+    size_t packedSize = cssPackedAlign(indexOffset + cssClassIndexBuild(cssKeys, 0));
+
+    if (packedSize > 0xFFFFFFFF - CSS_KEYARRAY_PACKED_ALIGN) {
+        printf("Error: key array is too big to pack\n");
+        return 0;
+    }
+
+    // 映像之前保存分配器 (映像中不含指针), 多分配一个对齐单位使映像从 64 字节边界开始.
+    //   数组头的长度和各段的偏移都是 64 的倍数, 因此 keys, 文本和索引也从 64 字节边界开始
+    const CssAllocator *allocator = CssGetAllocator();
+    char *block = (char *) CssMemAlloc(allocator, sizeof(allocator) + CSS_KEYARRAY_PACKED_ALIGN + packedSize);
+    size_t imageAt = cssPackedAlign((size_t)(uintptr_t)block + sizeof(allocator)) - (size_t)(uintptr_t)block;
+
+    CssKeyArrayHead *packed = (CssKeyArrayHead *) (block + imageAt);
+    memcpy((char *)packed - sizeof(allocator), &allocator, sizeof(allocator));
+    memset(packed, 0, packedSize);
+
+    packed->packed = CSS_KEYARRAY_PACKED_MAGIC;
+    packed->packedSize = (uint32_t)packedSize;
+    packed->textOffset = (uint32_t)textOffset;
+    packed->blockOffset = (uint32_t)((char *)packed - block);
+    packed->cssLen = data->cssLen;
+    packed->UsedKeys = data->UsedKeys;
+    packed->SizeKeys = data->UsedKeys;
+    packed->atomVocabulary = CssAtomVocabulary();
+
+    memcpy(packed->keysArray, data->keysArray, keysSize);
+    if (cssText) {
+        memcpy((char *)packed + textOffset, cssText, data->cssLen);
+    }
+    packed->indexOffset = (uint32_t)indexOffset;
+    cssClassIndexBuild(packed->keysArray, (CssClassIndex *)((char *)packed + indexOffset));
+    return packed->keysArray;
+}
+
+
+const void * CssKeyArrayPackedImage(const CssKeyArray cssKeys, size_t *imageSize)
+{
+    CssKeyArrayHead *data = CssKeyArrayHeadData(cssKeys);
+    if (data->packed != CSS_KEYARRAY_PACKED_MAGIC) {
+        return 0;
+    }
+    *imageSize = data->packedSize;
+    return data;
+}
+
+
+// 索引中 int32_t[count] 的表在 indexSize 之内, 每一项为 -1 或者 [minKey, numKeys) 中的 key.
+//   开放寻址的表 (needEmpty) 至少要有一个空项, 否则查找不会结束
+static int cssPackedCheckTable(const CssClassIndex *index, uint32_t offset, uint64_t count, int needEmpty)
+{
+    if (offset < sizeof(CssClassIndex) || offset % sizeof(int32_t) || offset + count * sizeof(int32_t) > index->indexSize) {
+        return 0;
+    }
+    const int32_t *table = (const int32_t *)((const char *)index + offset);
+    for (uint64_t k = 0; k < count; k++) {
+        if (table[k] < -1 || table[k] >= index->numKeys) {
+            return 0;
+        }
+        needEmpty = needEmpty && table[k] >= 0;
+    }
+    return !needEmpty;
+}
+
+
+// 检查映像中 keys 和 class 索引里的全部偏移, 使查询不会越界或者不结束. 文本的内容不检查
+static int cssPackedCheckKeys(const CssKeyArrayHead *data)
+{
+    const struct CssKeyField *keys = data->keysArray;
+    int i, t;
+
+    for (i = 0; i < data->UsedKeys; i++) {
+        if ((uint64_t)keys[i].offset + keys[i].length > data->cssLen || keys[i].keyidx >= (uint32_t)data->UsedKeys) {
+            return 0;
+        }
+    }
+    if (!data->indexOffset) {
+        return 1;
+    }
+
+    const CssClassIndex *index = (const CssClassIndex *)((const char *)data + data->indexOffset);
+    if (index->numKeys != data->UsedKeys || index->indexSize < sizeof(CssClassIndex) ||
+        (uint64_t)data->indexOffset + index->indexSize > data->packedSize) {
+        return 0;
+    }
+
+    for (t = 0; t < CSS_CLASS_INDEX_TYPES; t++) {
+        uint32_t mask = index->tableMask[t];
+        if ((mask & (mask + 1)) || !cssPackedCheckTable(index, index->tableOffset[t], (uint64_t)mask + 1, 1)) {
+            return 0;
+        }
+    }
+
+    // next[i] 只能指向后面的 key, 链表不会循环
+    if (!cssPackedCheckTable(index, index->nextOffset, (uint64_t)index->numKeys, 0)) {
+        return 0;
+    }
+    const int32_t *next = (const int32_t *)((const char *)index + index->nextOffset);
+    for (i = 0; i < index->numKeys; i++) {
+        if (next[i] >= 0 && next[i] <= i) {
+            return 0;
+        }
+    }
+
+    if (index->idRange) {
+        return cssPackedCheckTable(index, index->idOffset, index->idRange, 0);
+    }
+
+    // CssIdSlot 的表: 每个 slot 是 {id, key}, 只检查 key
+    uint32_t mask = index->idMask;
+    uint64_t slots = (uint64_t)mask + 1;
+    if ((mask & (mask + 1)) || index->idOffset < sizeof(CssClassIndex) || index->idOffset % sizeof(int32_t) ||
+        index->idOffset + slots * sizeof(CssIdSlot) > index->indexSize) {
+        return 0;
+    }
+    const CssIdSlot *idTable = (const CssIdSlot *)((const char *)index + index->idOffset);
+    int hasEmpty = 0;
+    for (uint64_t k = 0; k < slots; k++) {
+        if (idTable[k].key < -1 || idTable[k].key >= index->numKeys) {
+            return 0;
+        }
+        hasEmpty = hasEmpty || idTable[k].key < 0;
+    }
+    return hasEmpty;
+}
+
+
+CssKeyArray CssKeyArrayAttachPacked(const void *image, size_t imageSize)
+{
+    const CssKeyArrayHead *data = (const CssKeyArrayHead *) image;
+
+    // 各段的偏移都是对齐的, 文本以 '\0' 结尾
+    if (((uintptr_t)image % sizeof(void *)) != 0 || imageSize < sizeof(CssKeyArrayHead) ||
+        data->packed != CSS_KEYARRAY_PACKED_MAGIC || data->packedSize > imageSize ||
+        data->atomVocabulary != CssAtomVocabulary() ||
+        data->UsedKeys < 0 || data->UsedKeys >= CSS_KEYINDEX_INVALID ||
+        data->textOffset % CSS_KEYARRAY_PACKED_ALIGN || data->indexOffset % CSS_KEYARRAY_PACKED_ALIGN ||
+        sizeof(CssKeyArrayHead) + (uint64_t)data->UsedKeys * sizeof(struct CssKeyField) > data->textOffset ||
+        (uint64_t)data->textOffset + data->cssLen >= data->packedSize ||
+        ((const char *)data)[data->textOffset + data->cssLen] != '\0' ||
+        (data->indexOffset && (data->indexOffset <= data->textOffset + data->cssLen ||
+            (uint64_t)data->indexOffset + sizeof(CssClassIndex) > data->packedSize)) ||
+        !cssPackedCheckKeys(data)) {
+        printf("Error: invalid packed key array\n");
+        return 0;
+    }
+    return (CssKeyArray) ((const CssKeyArrayHead *) image)->keysArray;
+}
+
+
+int CssKeyArrayGetSize(const CssKeyArray cssKeys)
+{
+    if (cssKeys) {
+        CssKeyArrayHead* data = CssKeyArrayHeadData(cssKeys);
+        return (int) data->SizeKeys;
+    }
+    return 0;
+}
+
+
+int CssKeyArrayGetUsed(const CssKeyArray cssKeys)
+{
+    if (cssKeys) {
+        CssKeyArrayHead* data = CssKeyArrayHeadData(cssKeys);
+        return (int)data->UsedKeys;
+    }
+    return 0;
+}
+
+
+CssKeyArray CssStringParse(CssString cssString)
+{
+    // 按输入长度预估 keys 数目, 不够时 CssKeyArrayAppend 自动扩展
+    int sizeKeys = (int)(cssString->sblen / 32) + 16;
+    if (sizeKeys >= CSS_KEYINDEX_INVALID) {
+        sizeKeys = CSS_KEYINDEX_INVALID - 1;
+    }
+
+    CssKeyArray keysArray = CssCreateKeysArray(sizeKeys, cssString, cssString->sbbuf, cssString->sblen);
+    if (keysArray) {
+        if (cssParseKeyArray(cssString->sbbuf, (int)cssString->sblen, (int)cssString->sblen, cssString->sbbuf, &keysArray) > 0) {
+            return keysArray;
+        }
+        CssKeyArrayHead* data = CssKeyArrayHeadData(keysArray);
+        data->cssString = 0;
+        CssKeyArrayFree(keysArray);
+    }
+    return 0;
+}
+
+
+CssKeyArray CssBufferParse(const char* cssBuf, size_t cssLen)
+{
+    return CssBufferParsePrefix(cssBuf, cssLen, cssLen);
+}
+
+
+CssKeyArray CssBufferParsePrefix(const char* cssBuf, size_t cssLen, size_t textLen)
+{
+    if (textLen >= CSS_STRING_BSIZE_MAX || cssLen > textLen) {
+        printf("Error: size is too long\n");
+        return 0;
+    }
+
+    int sizeKeys = (int)(cssLen / 32) + 16;
+    if (sizeKeys >= CSS_KEYINDEX_INVALID) {
+        sizeKeys = CSS_KEYINDEX_INVALID - 1;
+    }
+
+    // keys 直接引用 cssBuf, 不复制也不改写
+    CssKeyArray keysArray = CssCreateKeysArray(sizeKeys, 0, cssBuf, cssLen);
+    if (keysArray) {
+        if (cssParseKeyArray(cssBuf, (int)cssLen, (int)textLen, 0, &keysArray) > 0) {
+            return keysArray;
+        }
+        CssKeyArrayFree(keysArray);
+    }
+    return 0;
+}
+
+
+int CssBufferParseSax(const char* cssBuf, size_t cssLen, const CssSaxHandler* handler)
+{
+    // 没有 keys, 因此不受 CSS_STRING_BSIZE_MAX 限制, 只要位置可以用 int 表示
+    if (cssLen >= 0x7FFFFFFF) {
+        printf("Error: size is too long\n");
+        return -1;
+    }
+    return cssParseKeys(cssBuf, (int)cssLen, (int)cssLen, -2, 0, 0, handler);
+}
+
+
+// 并行解析: 每个线程预扫描输入的一段 (slice), 找出属于自己的规则边界, 解析边界之间的片段 (chunk),
+// 最后把片段的 keys 合并 (修正 offset), 由 CssKeyArrayBuild() 统一设置索引.
+
+#define CSS_PARALLEL_THREADS_MAX  64
+
+// 每个线程至少处理的字节数, 输入太短时串行解析
+#ifndef CSS_PARALLEL_SLICE_MIN
+#   define CSS_PARALLEL_SLICE_MIN    (64 * 1024)
+#endif
+
+
+// 预扫描只需要区分 4 种状态: 块内与跳过的 {...} 相同, 注释需要记住结束后的状态
+typedef enum {
+    css_split_selector = 0,
+    css_split_block = 1,
+    css_split_comment_selector = 2,
+    css_split_comment_block = 3,
+    css_split_states = 4
+} CssSplitState;
+
+
+typedef struct {
+    struct CssParallelJob* job;
+    int index;
+
+    int sliceBegin;              // 预扫描范围 [sliceBegin, sliceEnd)
+    int sliceEnd;
+    int nul;                     // slice 中第一个 '\0' 的位置, 没有为 -1
+    int sliceComment;            // slice 中最后一个 "*/" 的位置, 没有为 -1
+
+    int endState[css_split_states];    // 从每种状态开始扫描 slice, 结束时的状态
+    int firstSplit[css_split_states];  // 从每种状态开始, 第一个闭合 {...} 的 '}' 之后的位置, 没有为 -1
+
+    int textLen;                 // 第一个 '\0' 之前的长度
+    int lastComment;             // 全文最后一个 "*/" 的位置
+    int numChunks;
+    int chunkBegin;              // 解析范围 [chunkBegin, chunkEnd)
+    int chunkEnd;
+    CssKeyArray keys;            // 片段的 keys, offset 相对 chunkBegin
+    int numKeys;
+    int keyBase;                 // 在合并结果中的起始位置
+
+    CssThread thread;
+} CssParallelWorker;
+
+
+typedef struct CssParallelJob {
+    const char* css;
+    int cssLen;
+    int numWorkers;
+    const CssAllocator* allocator;  // 调用者的分配器, 每个线程都使用它
+    CssKeyArray keys;            // 合并结果
+    CssThreadBarrier barrier;
+    CssParallelWorker workers[CSS_PARALLEL_THREADS_MAX];
+} CssParallelJob;
+
+
+// 第 1 遍: slice 中的 '\0' 和最后一个 "*/"
+static void cssParallelScanComment(const CssParallelJob* job, CssParallelWorker* w)
+{
+    const char* css = job->css;
+    const char* nul = (const char*)memchr(css + w->sliceBegin, 0, w->sliceEnd - w->sliceBegin);
+    int end = nul ? (int)(nul - css) : w->sliceEnd;
+
+    w->nul = nul ? end : -1;
+    w->sliceComment = -1;
+
+    // "*/" 可以跨越 slice 的开始位置
+#if defined(__GLIBC__)
+    const char* p;
+    while (end > w->sliceBegin && (p = (const char*)memrchr(css + w->sliceBegin, '/', end - w->sliceBegin)) != 0) {
+        end = (int)(p - css);
+        if (end > 0 && p[-1] == '*') {
+            w->sliceComment = end - 1;
+            break;
+        }
+    }
+#else
+    for (int j = end - 1; j >= w->sliceBegin && j > 0; j--) {
+        if (css[j] == '/' && css[j - 1] == '*') {
+            w->sliceComment = j - 1;
+            break;
+        }
+    }
+#endif
+}
+
+
+// 第 2 遍: 与 cssParseKeys 相同的规则, 同时从 4 种状态开始扫描 slice
+static void cssParallelScanSplit(const CssParallelJob* job, CssParallelWorker* w)
+{
+    const char* css = job->css;
+    int end = (w->sliceEnd < w->textLen) ? w->sliceEnd : w->textLen;
+    int* st = w->endState;
+    int s;
+
+    for (s = 0; s < css_split_states; s++) {
+        st[s] = s;
+        w->firstSplit[s] = -1;
+    }
+
+    for (int base = w->sliceBegin; base < end; base += 64) {
+        uint64_t mask = CssScanBlockMask64(css + base, (end - base < 64) ? (end - base) : 64);
+
+        while (mask) {
+            int i = base + CssScanFirstBit(mask);
+            mask &= mask - 1;
+
+            switch (css[i]) {
+            case '{':
+                for (s = 0; s < css_split_states; s++) {
+                    if (st[s] == css_split_selector) {
+                        st[s] = css_split_block;
+                    }
+                }
+                break;
+
+            case '}':
+                for (s = 0; s < css_split_states; s++) {
+                    if (st[s] == css_split_block) {
+                        st[s] = css_split_selector;
+                        if (w->firstSplit[s] < 0) {
+                            w->firstSplit[s] = i + 1;
+                        }
+                    }
+                }
+                break;
+
+            case '/':
+                for (s = 0; s < css_split_states; s++) {
+                    if (st[s] >= css_split_comment_selector) {
+                        // 在 slice 中打开的 "/*" 之后 i 不小于它的位置 + 2; 但是假设从注释中开始的状态
+                        //   在第一个 slice 的 i == 0 处也会遇到 '/', 不能读 css[-1]
+                        if (i > 0 && css[i - 1] == '*') {
+                            st[s] -= css_split_comment_selector;
+                        }
+                    }
+                    else if (i + 1 < job->cssLen && css[i + 1] == '*' && w->lastComment >= i + 2) {
+                        st[s] += css_split_comment_selector;
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+
+// 按第 1 遍的结果计算全文的 textLen 和 lastComment.
+//   每个线程各自计算, 只写自己的 worker
+static void cssParallelResolveText(const CssParallelJob* job, CssParallelWorker* w)
+{
+    int lastComment = -1;
+
+    w->textLen = job->cssLen;
+
+    for (int k = 0; k < job->numWorkers; k++) {
+        const CssParallelWorker* slice = &job->workers[k];
+        if (slice->sliceComment > lastComment) {
+            lastComment = slice->sliceComment;
+        }
+        if (slice->nul >= 0) {
+            w->textLen = slice->nul;
+            break;
+        }
+    }
+    w->lastComment = lastComment;
+}
+
+
+// 按第 2 遍的结果从头计算每个 slice 的开始状态, 确定片段边界.
+//   第 k 个片段从第 k 个有边界的 slice 中的第一个边界开始
+static void cssParallelResolveChunk(const CssParallelJob* job, CssParallelWorker* w)
+{
+    int state = css_split_selector;
+    int chunks = 0;
+
+    w->chunkBegin = 0;
+    w->chunkEnd = w->textLen;
+
+    for (int k = 0; k < job->numWorkers && job->workers[k].sliceBegin < w->textLen; k++) {
+        const CssParallelWorker* slice = &job->workers[k];
+        int split = slice->firstSplit[state];
+
+        if (k > 0 && split >= 0 && split < w->textLen) {
+            if (chunks == w->index) {
+                w->chunkEnd = split;
+            }
+            if (++chunks == w->index) {
+                w->chunkBegin = split;
+            }
+        }
+        state = slice->endState[state];
+    }
+
+    w->numChunks = chunks + 1;
+}
+
+
+static void cssParallelWorkerRun(void* arg)
+{
+    CssParallelWorker* w = (CssParallelWorker*)arg;
+    CssParallelJob* job = w->job;
+    const char* chunk;
+    int chunkLen, k;
+
+    // 片段和合并结果的 keys 都从调用者的分配器分配
+    CssSetAllocator(job->allocator);
+
+    cssParallelScanComment(job, w);
+    CssThreadBarrierWait(&job->barrier);
+
+    cssParallelResolveText(job, w);
+    cssParallelScanSplit(job, w);
+    CssThreadBarrierWait(&job->barrier);
+
+    cssParallelResolveChunk(job, w);
+
+    w->numKeys = 0;
+    if (w->index < w->numChunks) {
+        chunk = job->css + w->chunkBegin;
+        chunkLen = w->chunkEnd - w->chunkBegin;
+
+        int sizeKeys = chunkLen / 32 + 16;
+        if (sizeKeys >= CSS_KEYINDEX_INVALID) {
+            sizeKeys = CSS_KEYINDEX_INVALID - 1;
+        }
+
+        // 片段开始于闭合的 '}' 之后, 与串行解析到此处的状态相同. 注释的判定使用全文的 lastComment
+        w->keys = CssCreateKeysArray(sizeKeys, 0, chunk, chunkLen);
+        w->numKeys = cssParseKeys(chunk, chunkLen, chunkLen,
+            (w->lastComment >= w->chunkBegin) ? w->lastComment - w->chunkBegin : -1, 0, &w->keys, 0);
+    }
+    CssThreadBarrierWait(&job->barrier);
+
+    if (w->index == 0) {
+        int numKeys = 0;
+        for (k = 0; k < w->numChunks; k++) {
+            job->workers[k].keyBase = numKeys;
+            numKeys += job->workers[k].numKeys;
+        }
+        CssCheckNumKeys(numKeys);
+
+        job->keys = CssCreateKeysArray(numKeys, 0, job->css, job->cssLen);
+        CssKeyArrayHeadData(job->keys)->UsedKeys = numKeys;
+    }
+    CssThreadBarrierWait(&job->barrier);
+
+    if (w->index < w->numChunks) {
+        struct CssKeyField* keyField = job->keys + w->keyBase;
+        memcpy(keyField, w->keys, sizeof(struct CssKeyField) * w->numKeys);
+        for (k = 0; k < w->numKeys; k++) {
+            keyField[k].offset += w->chunkBegin;
+        }
+        CssKeyArrayFree(w->keys);
+    }
+}
+
+
+CssKeyArray CssBufferParseParallel(const char* cssBuf, size_t cssLen, int numThreads)
+{
+    if (cssLen >= CSS_STRING_BSIZE_MAX) {
+        printf("Error: size is too long\n");
+        return 0;
+    }
+
+    int numWorkers = (int)(cssLen / CSS_PARALLEL_SLICE_MIN);
+    if (numWorkers > numThreads) {
+        numWorkers = numThreads;
+    }
+    if (numWorkers > CSS_PARALLEL_THREADS_MAX) {
+        numWorkers = CSS_PARALLEL_THREADS_MAX;
+    }
+    if (numWorkers < 2) {
+        return CssBufferParse(cssBuf, cssLen);
+    }
+
+    CssParallelJob* job = (CssParallelJob*) CssMemAlloc(0, sizeof(CssParallelJob));
+    memset(job, 0, sizeof(CssParallelJob));
+
+    job->allocator = CssGetAllocator();
+    job->css = cssBuf;
+    job->cssLen = (int)cssLen;
+    job->numWorkers = numWorkers;
+    CssThreadBarrierInit(&job->barrier, numWorkers);
+
+    for (int k = 0; k < numWorkers; k++) {
+        CssParallelWorker* w = &job->workers[k];
+        w->job = job;
+        w->index = k;
+        w->sliceBegin = (int)(cssLen * k / numWorkers);
+        w->sliceEnd = (int)(cssLen * (k + 1) / numWorkers);
+    }
+
+    // 自动选择扫描方式时, 先在当前线程中选定, 避免多个线程同时设置
+    CssScanGetLevel();
+
+    // 当前线程作为第 0 个线程
+    for (int k = 1; k < numWorkers; k++) {
+        CssThreadStart(&job->workers[k].thread, cssParallelWorkerRun, &job->workers[k]);
+    }
+    cssParallelWorkerRun(&job->workers[0]);
+    for (int k = 1; k < numWorkers; k++) {
+        CssThreadJoin(&job->workers[k].thread);
+    }
+
+    CssThreadBarrierUninit(&job->barrier);
+
+    CssKeyArray keysArray = job->keys;
+    CssMemFree(job->allocator, job);
+
+    if (!CssKeyArrayBuild(cssBuf, keysArray, CssKeyArrayGetUsed(keysArray))) {
+        printf("Error: CssKeyArrayBuild() failed.\n");
+        CssKeyArrayFree(keysArray);
+        return 0;
+    }
+    return keysArray;
+}
+
+
+CssKeyArray CssFileMapParse(const char* cssPathFile)
+{
+    size_t cssLen = 0;
+
+    const char* cssMapped = cssMapFile(cssPathFile, &cssLen);
+    if (!cssMapped) {
+        return 0;
+    }
+
+    CssKeyArray keysArray = CssBufferParse(cssMapped, cssLen);
+    if (!keysArray) {
+        cssUnmapFile(cssMapped, cssLen);
+        return 0;
+    }
+
+    // 映射由 keys 拥有, CssKeyArrayFree() 时解除
+    CssKeyArrayHeadData(keysArray)->cssMapped = cssMapped;
+    return keysArray;
+}
+
+
+const CssKeyArrayNode CssKeyArrayGetNode(const CssKeyArray cssKeys, int index)
+{
+    int numKeys = CssKeyArrayGetUsed(cssKeys);
+    if (index < numKeys) {
+        return (CssKeyArrayNode)(cssKeys + index);
+    }
+    return 0;
+}
+
+
+CssKeyType CssKeyGetType(const CssKeyArrayNode cssKey)
+{
+    return cssKey->type;
+}
+
+
+int CssKeyGetFlag(const CssKeyArrayNode cssKey)
+{
+    // 属性名称的 flags 保存的是 atom, 不是状态关键字
+    return (cssKey->type == css_type_key) ? css_bitflag_none : (int)(cssKey->flags);
+}
+
+
+int CssKeyGetAtom(const CssKeyArrayNode cssKey)
+{
+    return (cssKey->type == css_type_key) ? (int)(cssKey->flags) : css_atom_none;
+}
+
+
+int CssKeyOffsetLength(const CssKeyArrayNode cssKeyNode, int* bOffset)
+{
+    *bOffset = (int)cssKeyNode->offset;
+    return (int)cssKeyNode->length;
+}
 
 
 int CssKeyTypeIsClass(const CssKeyArrayNode cssKeyNode)
@@ -674,6 +1982,34 @@ int CssClassGetKeyIndex(const CssKeyArrayNode cssClassKey)
 }
 
 
+// 状态关键字之间的分隔符 ('\0' 结束)
+static const unsigned char css_bitflag_separators[256] = {
+    [' '] = 1, [','] = 1, ['|'] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['\0'] = 2
+};
+
+
+int CssKeyFlagFromString(const char* flagWords, int len)
+{
+    const unsigned char* p = (const unsigned char*)flagWords;
+    int flags = css_bitflag_none;
+    int start = 0;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        int sep = css_bitflag_separators[p[i]];
+        if (sep) {
+            // 空的词长度为 0, 不匹配
+            flags |= cssGetKeyBitFlag(flagWords + start, i - start);
+            if (sep == 2) {
+                return flags;
+            }
+            start = i + 1;
+        }
+    }
+    return flags | cssGetKeyBitFlag(flagWords + start, i - start);
+}
+
+
 int CssKeyFlagToString(int keyflag, char* outbuf, size_t bufsize)
 {
     if (keyflag > 0) {
@@ -720,13 +2056,17 @@ void CssKeyArrayPrint(const CssKeyArray cssKeys, FILE* outfd)
 
     int nk = 0;
 
-    while (nk < numKeys - 1) {
+    while (nk < numKeys) {
         CssKeyArrayNode classKeyNode = CssKeyArrayGetNode(cssKeys, nk++);
 
         if (CssKeyTypeIsClass(classKeyNode)) {
             int bflagsLen = CssKeyFlagToString(CssKeyGetFlag(classKeyNode), classKeyFlags, sizeof(classKeyFlags) / sizeof(classKeyFlags[0]));
 
             int keyIndex = CssClassGetKeyIndex(classKeyNode);
+            if (keyIndex < 0) {
+                // 没有 {key:value ...} 的 class, 不能访问 keys[-1]
+                keyIndex = numKeys;
+            }
 
             int offset = 0;
             int length = CssKeyOffsetLength(classKeyNode, &offset);
@@ -759,31 +2099,112 @@ void CssKeyArrayPrint(const CssKeyArray cssKeys, FILE* outfd)
 }
 
 
-int CssKeyArrayQueryClass(const CssKeyArray cssKeys, CssKeyType classType, const char *className, int classNameLen, CssKeyArrayNode classNodes[32])
+int CssKeyArrayQueryClassEach(const CssKeyArray cssKeys, CssKeyType classType, const char *className, int classNameLen, CssKeyNodeCallback onNode, void *userData)
 {
-    const char *styleNames[32];
-    int styleLens[32];
-    int numstyles = CssStyleClassSplit(className, classNameLen, styleNames, styleLens, sizeof(styleLens) / sizeof(styleLens[0]));
-
-    int retNodes = 0;
     const int NumKeys = CssKeyArrayGetUsed(cssKeys);
-
-    for (int n = 0; n < numstyles; n++) {
-        // 遍历每个 class
-        for (int i = 0; i < NumKeys; i++) {
-            const CssKeyArrayNode keyNode = CssKeyArrayGetNode(cssKeys, i);
-            if (CssKeyGetType(keyNode) == classType) {
-                int boffset = 0;
-                if (CssKeyOffsetLength(keyNode, &boffset) == styleLens[n]) {
-                    const char* keyName = CssKeyArrayGetString(cssKeys, boffset);
-                    if (!strncmp(keyName, styleNames[n], styleLens[n])) {
-                        if (retNodes < 32) {
-                            classNodes[retNodes++] = keyNode;
+    const int t = cssClassIndexType(classType);
+    const CssClassIndex *index = (t >= 0) ? cssClassIndexGet(cssKeys) : 0;
+    const int32_t *next = index ? (const int32_t *)((const char *)index + index->nextOffset) : 0;
+
+    const char *end = className + classNameLen;
+    const char *name = className;
+    int numNodes = 0;
+
+    // 空格分开的每个名称, 不限个数, 不复制
+    while (name < end && *name) {
+        const char *p = name;
+        while (p < end && *p && *p != 32) {
+            p++;
+        }
+        int nameLen = (int)(p - name);
+
+        if (nameLen > 0) {
+            if (index) {
+                // 按名称索引查找, 同名的 class 按顺序排列
+                for (int i = cssClassIndexFind(cssKeys, index, t, name, nameLen); i >= 0; i = next[i]) {
+                    numNodes++;
+                    if (onNode(CssKeyArrayGetNode(cssKeys, i), userData)) {
+                        return numNodes;
+                    }
+                }
+            }
+            else {
+                // 遍历每个 class
+                for (int i = 0; i < NumKeys; i++) {
+                    const CssKeyArrayNode keyNode = CssKeyArrayGetNode(cssKeys, i);
+                    int boffset = 0;
+                    if (CssKeyGetType(keyNode) == classType && CssKeyOffsetLength(keyNode, &boffset) == nameLen &&
+                        !strncmp(CssKeyArrayGetString(cssKeys, boffset), name, nameLen)) {
+                        numNodes++;
+                        if (onNode(keyNode, userData)) {
+                            return numNodes;
                         }
                     }
                 }
             }
         }
+        name = p + 1;
+    }
+    return numNodes;
+}
+
+
+typedef struct {
+    CssKeyArrayNode *nodes;
+    int maxNodes;
+    int numNodes;
+} CssQueryNodesBuffer;
+
+
+static int cssQueryNodesAdd(const CssKeyArrayNode node, void *userData)
+{
+    CssQueryNodesBuffer *buf = (CssQueryNodesBuffer *)userData;
+    if (buf->numNodes < buf->maxNodes) {
+        buf->nodes[buf->numNodes] = node;
+    }
+    buf->numNodes++;
+    return 0;
+}
+
+
+int CssKeyArrayQueryClassNodes(const CssKeyArray cssKeys, CssKeyType classType, const char *className, int classNameLen, CssKeyArrayNode *classNodes, int maxNodes)
+{
+    CssQueryNodesBuffer buf = { classNodes, classNodes ? maxNodes : 0, 0 };
+    CssKeyArrayQueryClassEach(cssKeys, classType, className, classNameLen, cssQueryNodesAdd, &buf);
+    return buf.numNodes;
+}
+
+
+int CssKeyArrayQueryClass(const CssKeyArray cssKeys, CssKeyType classType, const char *className, int classNameLen, CssKeyArrayNode classNodes[32])
+{
+    int retNodes = CssKeyArrayQueryClassNodes(cssKeys, classType, className, classNameLen, classNodes, 32);
+    return (retNodes < 32) ? retNodes : 32;
+}
+
+
+const CssKeyArrayNode CssKeyArrayQueryId(const CssKeyArray cssKeys, uint32_t id)
+{
+    const CssClassIndex *index = cssClassIndexGet(cssKeys);
+    int i = index ? cssClassIndexFindId(index, id) : -1;
+    return (i >= 0) ? (CssKeyArrayNode)(cssKeys + i) : 0;
+}
+
+
+int CssKeyArrayQueryIdNodes(const CssKeyArray cssKeys, uint32_t id, CssKeyArrayNode *idNodes, int maxNodes)
+{
+    const CssClassIndex *index = cssClassIndexGet(cssKeys);
+    if (!index) {
+        return 0;
+    }
+
+    const int32_t *next = (const int32_t *)((const char *)index + index->nextOffset);
+    int numNodes = 0;
+
+    for (int i = cssClassIndexFindId(index, id); i >= 0; i = next[i]) {
+        if (idNodes && numNodes < maxNodes) {
+            idNodes[numNodes] = CssKeyArrayGetNode(cssKeys, i);
+        }
+        numNodes++;
     }
-    return retNodes;
+    return numNodes;
 }
\ No newline at end of file
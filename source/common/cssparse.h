@@ -41,6 +41,8 @@ extern "C"
 {
 #endif
 
+#include <stdint.h>
+
 
 typedef struct CssKeyField *CssKeyArray, *CssKeyArrayNode;
 
@@ -60,9 +62,27 @@ typedef struct CssKeyField *CssKeyArray, *CssKeyArrayNode;
 #define CSS_VALUELEN_INVALID_256         0x100      // 8bit:  键值的长度最大 255 个字符: CSS_VALUELEN_INVALID - 1
 
 
+// 宽布局: 编译时定义 CSS_KEYFIELD_WIDE (make WIDE=1) 则每个 key 占 16 字节:
+//   32bit offset, 32bit keyidx, 16bit length. 库和调用者必须使用相同的定义.
+//   位置和索引都是 int, 因此实际上限为 2^31 - 1.
+// 默认的紧凑布局每个 key 占 8 字节, 上限为上面的定义.
+#ifdef CSS_KEYFIELD_WIDE
+#   define CSS_STRING_BSIZE_MAX      0x7FFFFFFF  // 31bit: 最长 2^31 - 2 字节
+#   define CSS_KEYINDEX_INVALID      0x7FFFFFFF  // 31bit: 索引=[0 ... 2^31 - 2]
+#   define CSS_VALUELEN_INVALID      0x10000     // 16bit: 键值的长度最大 65535 个字符
+#   define CSS_KEYFIELD_BYTES        16
+#else
+#   define CSS_STRING_BSIZE_MAX      CSS_STRING_BSIZE_MAX_1048576
+#   define CSS_KEYINDEX_INVALID      CSS_KEYINDEX_INVALID_4096
+#   define CSS_VALUELEN_INVALID      CSS_VALUELEN_INVALID_256
+#   define CSS_KEYFIELD_BYTES        8
+#endif
+
+
 typedef struct CssStringBuffer {
     unsigned int sbsize;
     unsigned int sblen;
+    const struct CssAllocator *allocator;  // 创建时的分配器, CssStringFree() 还给它
     char sbbuf[0];
 } *CssString;
 
@@ -99,8 +119,54 @@ extern CssString CssStringNewFromFile(FILE *cssfile);
 extern void CssStringFree(CssString cssString);
 
 extern CssKeyArray CssStringParse(CssString cssString);
+
+// 只读解析: 不复制也不改写 cssBuf, 返回的 keys 引用 cssBuf 中的原始字节.
+//   cssBuf 必须在 CssKeyArrayFree() 之前保持有效. 同一个 cssBuf 可以在多个线程中同时解析.
+//   注意: 原始字节中的 [\t \r \n " '] 和 key/value 中间的注释保留原样.
+extern CssKeyArray CssBufferParse(const char* cssBuf, size_t cssLen);
+
+// 只读解析 cssBuf 的前 cssLen 字节, 但判断注释 "/*" 是否成立时查看全部 textLen 字节.
+//   用于从更长的输入中切出一段解析 (见 cssparser.h)
+extern CssKeyArray CssBufferParsePrefix(const char* cssBuf, size_t cssLen, size_t textLen);
+
+// SAX 解析: 不生成 CssKeyArray, 由分词器直接回调. 任何回调返回非 0 都会停止解析.
+//   每个 {...}: 选择器中的每个 class 调用一次 on_rule_begin (classFlags 同 CssKeyGetFlag),
+//   然后每个属性调用一次 on_declaration, 最后调用 on_rule_end.
+//   字符串直接指向输入 (不以 '\0' 结尾), 不受 key/value 长度 255 的限制.
+//   空的 {} 也会回调 (CssKeyArray 中是没有属性的 class), 末尾未闭合的 {...} 不调用 on_rule_end.
+typedef struct CssSaxHandler {
+    void *userData;
+    int (*on_rule_begin)(void *userData, CssKeyType classType, const char *className, int nameLen, int classFlags);
+    int (*on_declaration)(void *userData, const char *key, int keyLen, const char *value, int valueLen);
+    int (*on_rule_end)(void *userData);
+} CssSaxHandler;
+
+// 返回闭合的 class 规则 ({...}) 数目, 被回调停止或者出错返回 -1
+extern int CssBufferParseSax(const char* cssBuf, size_t cssLen, const CssSaxHandler* handler);
+
+// 多线程只读解析, 结果与 CssBufferParse() 完全相同.
+//   在闭合的 {...} 之后切分输入, numThreads 个线程分别解析后合并. 输入太短时串行解析.
+//   所有线程都使用调用者的分配器 (CssSetAllocator), 它必须可以在多个线程中同时使用 (arena 不可以).
+extern CssKeyArray CssBufferParseParallel(const char* cssBuf, size_t cssLen, int numThreads);
+
+// 只读映射 (mmap) 文件并解析, 不复制文件内容. 映射由返回的 keys 拥有, CssKeyArrayFree() 时解除.
+extern CssKeyArray CssFileMapParse(const char* cssPathFile);
 extern void CssKeyArrayFree(CssKeyArray keys);
 
+// 打包: 把 keys 和它引用的文本复制到一块连续的内存中 (一次分配). 映像, keys, 文本和 class 索引
+//   都从 64 字节边界开始; 映像复制到 64 字节对齐的地址后仍然如此.
+//   结果与 cssKeys 无关, 用 CssKeyArrayFree() 释放. 打包的 keys 不能再扩展.
+extern CssKeyArray CssKeyArrayPack(const CssKeyArray cssKeys);
+
+// 打包的 keys 的内存映像 (不含任何指针), 可以直接复制, 写入文件或者共享内存. 没有打包返回 0
+extern const void * CssKeyArrayPackedImage(const CssKeyArray cssKeys, size_t *imageSize);
+
+// 使用复制来的映像 (至少指针对齐), 不复制. 映像必须由相同的构建 (相同的 CSS_KEYFIELD_WIDE,
+//   相同的已知属性名称表 CssAtomVocabulary) 生成.
+//   检查映像中 keys 和 class 索引里的全部偏移 (与 keys 的个数成线性), 不检查文本的内容.
+//   返回的 keys 只读, 不要 CssKeyArrayFree(): 由调用者释放映像. 映像无效时返回 0
+extern CssKeyArray CssKeyArrayAttachPacked(const void *image, size_t imageSize);
+
 extern const char * CssKeyArrayGetString(const CssKeyArray cssKeys, unsigned int offset);
 
 extern int CssKeyArrayGetSize(const CssKeyArray cssKeys);
@@ -108,20 +174,52 @@ extern int CssKeyArrayGetUsed(const CssKeyArray cssKeys);
 
 extern const CssKeyArrayNode CssKeyArrayGetNode(const CssKeyArray cssKeys, int index);
 extern CssKeyType CssKeyGetType(const CssKeyArrayNode cssKey);
+// class 的状态关键字 (CssBitFlag). 属性名称 (css_type_key) 返回 0 (css_bitflag_none)
 extern int CssKeyGetFlag(const CssKeyArrayNode cssKey);
+
+// 已知属性名称 (css_type_key, 名称在 CssAtom 中) 的 atom (见 cssatom.h), 解析时写入.
+//   未知的属性名称和其他节点总是返回 0 (css_atom_none): 解析不加入动态表, 因此打包的映像与进程无关.
+//   未知名称需要 atom 时由调用者使用 CssAtomIntern(), 结果不写入 keys
+extern int CssKeyGetAtom(const CssKeyArrayNode cssKey);
+
 extern int CssKeyOffsetLength(const CssKeyArrayNode cssKeyNode, int* bOffset);
 extern int CssKeyTypeIsClass(const CssKeyArrayNode cssKeyNode);
 extern int CssKeyFlagToString(int keyflag, char* outbuf, size_t buflen);
 
+// CssKeyFlagToString 的反向: 空格 (或者 , |) 分开的状态关键字转换为 CssBitFlag 的组合.
+//   关键字只精确匹配, 不认识的词忽略
+extern int CssKeyFlagFromString(const char* flagWords, int len);
+
+
 // Only for class node, to get it's {} node index or else returns: -1
 extern int CssClassGetKeyIndex(const CssKeyArrayNode cssClassKey);
 
 // 完全使用头文件 API, 展示了如何使用 cssparse 解析和输出 CSS
 extern void CssKeyArrayPrint(const CssKeyArray cssKeys, FILE* outfd);
 
-// 查询指定名称的 class 节点
+// 查询指定名称的 class 节点. className 中用空格分开多个名称, 按名称顺序返回, 最多 32 个.
+//   class, id 和 * 第一次查询时创建名称索引 (打包的 keys 已经包含索引), 之后每个名称 O(1).
+//   多个线程可以同时查询同一个 keys
 extern int CssKeyArrayQueryClass(const CssKeyArray cssKeys, CssKeyType classType, const char* className, int classNameLen, CssKeyArrayNode classNodes[32]);
 
+// 同 CssKeyArrayQueryClass, 名称和结果都不限个数, 不分配内存.
+//   按顺序对每个节点调用 onNode, onNode 返回非 0 时停止. 返回调用 onNode 的次数
+typedef int (*CssKeyNodeCallback)(const CssKeyArrayNode cssKeyNode, void *userData);
+
+extern int CssKeyArrayQueryClassEach(const CssKeyArray cssKeys, CssKeyType classType, const char* className, int classNameLen, CssKeyNodeCallback onNode, void *userData);
+
+// 同 CssKeyArrayQueryClass, 结果写入调用者的 classNodes[maxNodes], 返回全部节点的个数 (不截断).
+//   返回值大于 maxNodes 时只写入了前 maxNodes 个, 可以用更大的 classNodes 再次查询.
+//   classNodes 为 0 时只返回个数
+extern int CssKeyArrayQueryClassNodes(const CssKeyArray cssKeys, CssKeyType classType, const char* className, int classNameLen, CssKeyArrayNode *classNodes, int maxNodes);
+
+// 数字 id: 查询 "#id" (十进制, 没有前导 0) 的第一个节点, 没有返回 0. 与名称索引一起创建, 按整数查找.
+//   同 CssKeyArrayQueryClass(cssKeys, css_type_id, "#id", ...) 的第一个节点
+extern const CssKeyArrayNode CssKeyArrayQueryId(const CssKeyArray cssKeys, uint32_t id);
+
+// 同 CssKeyArrayQueryClassNodes, 查询全部 "#id" 节点, 返回节点的个数
+extern int CssKeyArrayQueryIdNodes(const CssKeyArray cssKeys, uint32_t id, CssKeyArrayNode *idNodes, int maxNodes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,367 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssparser.c
+ * @brief CSS 流式 (分块推入) 解析
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 18:30:12
+ * @date 2026-10-16 23:48:30
+ *
+ * @note
+ *   窗口中只做规则边界的划分 (与 cssParseKeys 相同的状态机), 每个规则再用
+ *   CssBufferParse() 只读解析.
+ *   注释开始符只有在其后 (至少 2 个字节之后) 还有注释结束符时才成立, 所以遇到
+ *   注释开始符时先不划分规则, 直到确认注释成立或者输入结束.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "cssparser.h"
+#include "cssalloc.h"
+#include "cssscan.h"
+
+
+#define CSS_PARSER_WINDOW_INIT  4096
+
+
+// 与 cssParseKeys 的分词器状态相同
+typedef enum {
+    css_parser_selector = 0,
+    css_parser_block = 1,
+    css_parser_skip = 2,
+    css_parser_comment = 3   // 未确认的注释: 等待 "*/"
+} CssParserState;
+
+
+struct CssParserData {
+    CssParserRuleCallback onRule;
+    void *userData;
+
+    // 创建时的分配器
+    const CssAllocator *allocator;
+
+    // 解析结果的内存, 每次解析之前 reset. 稳定之后不再向系统申请内存
+    CssArena arena;
+    CssKeyArray parsed;  // CssParserParse() 的结果
+
+    char *window;
+    size_t winSize;      // 已分配
+    size_t winMax;       // 最大
+    size_t winLen;       // 已有的输入
+
+    size_t ruleBegin;    // 当前规则在窗口中的起始位置
+    size_t scanPos;      // 下一个要扫描的位置
+
+    CssParserState state;
+    CssParserState commentRet;
+    size_t commentBegin; // "/*" 的位置
+
+    int classSeen;       // 选择器中已经有 class
+
+    int ended;           // 遇到 '\0', 输入结束
+    int failed;
+};
+
+
+static void cssParserReset(CssParser parser)
+{
+    parser->winLen = 0;
+    parser->ruleBegin = 0;
+    parser->scanPos = 0;
+    parser->state = css_parser_selector;
+    parser->commentRet = css_parser_selector;
+    parser->commentBegin = 0;
+    parser->classSeen = 0;
+    parser->ended = 0;
+    parser->failed = 0;
+}
+
+
+CssParser CssParserNew(size_t windowSize, CssParserRuleCallback onRule, void *userData)
+{
+    CssParser parser = (CssParser) CssMemAlloc(0, sizeof(struct CssParserData));
+    memset(parser, 0, sizeof(struct CssParserData));
+    parser->allocator = CssGetAllocator();
+
+    if (windowSize == 0 || windowSize > CSS_STRING_BSIZE_MAX) {
+        windowSize = CSS_STRING_BSIZE_MAX;
+    }
+
+    parser->onRule = onRule;
+    parser->userData = userData;
+    parser->winMax = windowSize;
+    parser->winSize = (windowSize < CSS_PARSER_WINDOW_INIT) ? windowSize : CSS_PARSER_WINDOW_INIT;
+    parser->window = (char *) CssMemAlloc(parser->allocator, parser->winSize);
+    parser->arena = CssArenaNew(parser->allocator, 0);
+
+    cssParserReset(parser);
+    return parser;
+}
+
+
+void CssParserFree(CssParser parser)
+{
+    if (parser) {
+        CssArenaFree(parser->arena);
+        CssMemFree(parser->allocator, parser->window);
+        CssMemFree(parser->allocator, parser);
+    }
+}
+
+
+// 上次 CssParserParse() 的结果失效
+static void cssParserResetArena(CssParser parser)
+{
+    parser->parsed = 0;
+    CssArenaReset(parser->arena);
+}
+
+
+CssKeyArray CssParserParse(CssParser parser, const char *cssBuf, size_t cssLen)
+{
+    cssParserResetArena(parser);
+    const CssAllocator *old = CssSetAllocator(CssArenaGetAllocator(parser->arena));
+
+    CssString cssString = CssStringNew(cssBuf, cssLen);
+    if (cssString) {
+        parser->parsed = CssStringParse(cssString);
+    }
+
+    CssSetAllocator(old);
+    return parser->parsed;
+}
+
+
+size_t CssParserGetMemory(const CssParser parser)
+{
+    return CssArenaGetReserved(parser->arena);
+}
+
+
+// 解析 [ruleBegin, ruleEnd) 并输出
+static int cssParserEmit(CssParser parser, size_t ruleEnd)
+{
+    // 规则的 keys 从 arena 分配, 回调期间恢复调用者的分配器
+    cssParserResetArena(parser);
+    const CssAllocator *old = CssSetAllocator(CssArenaGetAllocator(parser->arena));
+
+    // "/*/" 是否是注释取决于后面的输入, 因此查看窗口中的全部内容
+    CssKeyArray ruleKeys = CssBufferParsePrefix(parser->window + parser->ruleBegin,
+        ruleEnd - parser->ruleBegin, parser->winLen - parser->ruleBegin);
+
+    CssSetAllocator(old);
+
+    parser->ruleBegin = ruleEnd;
+
+    if (!ruleKeys) {
+        parser->failed = 1;
+        return 0;
+    }
+
+    if (parser->onRule && parser->onRule(ruleKeys, parser->userData)) {
+        parser->failed = 1;
+    }
+
+    CssKeyArrayFree(ruleKeys);
+    return 1;
+}
+
+
+// 扫描窗口 [scanPos, winLen), 划分并输出规则.
+// finishing 为 0 时, 结尾不完整的 "/" 留到下次扫描
+static int cssParserScan(CssParser parser, int finishing)
+{
+    const char *w = parser->window;
+    size_t end = parser->winLen;
+    size_t pos = parser->scanPos;
+    size_t i;
+    uint64_t mask;
+    char c;
+    int n, rules = 0;
+
+    while (pos < end && !parser->failed) {
+        n = (end - pos < 64) ? (int)(end - pos) : 64;
+        mask = CssScanMask64(w + pos, n);
+
+        while (mask && !parser->failed) {
+            i = pos + CssScanFirstBit(mask);
+            mask &= mask - 1;
+
+            c = w[i];
+            if (c == '\0') {
+                // 输入在 '\0' 处结束, 忽略后面的内容
+                parser->ended = 1;
+                parser->winLen = pos = end = i;
+                goto next_block;
+            }
+
+            if (c == 10) {
+                // 换行符等同于 ';'
+                c = 59;
+            }
+
+            if (parser->state == css_parser_comment) {
+                if (c == '/' && i >= parser->commentBegin + 3 && w[i - 1] == '*') {
+                    // 注释成立, 结束于 "/*" 之后的第一个 "*/"
+                    parser->state = parser->commentRet;
+                    if (w[parser->commentBegin + 2] == '/') {
+                        // "/*/": 注释结束于 commentBegin + 2, 重新扫描其后的内容
+                        pos = parser->commentBegin + 3;
+                        goto next_block;
+                    }
+                }
+                continue;
+            }
+
+            switch (c) {
+            case '/':
+                if (i + 1 == end) {
+                    if (!finishing) {
+                        // 需要下一个字节才能判断是不是 "/*"
+                        pos = end = i;
+                        goto next_block;
+                    }
+                }
+                else if (w[i + 1] == '*') {
+                    parser->commentBegin = i;
+                    parser->commentRet = parser->state;
+                    parser->state = css_parser_comment;
+                    pos = i + 2;
+                    goto next_block;
+                }
+                break;
+
+            case '.':
+            case '#':
+            case '*':
+                if (parser->state == css_parser_selector) {
+                    parser->classSeen = 1;
+                }
+                break;
+
+            case '{':
+                if (parser->state == css_parser_selector) {
+                    parser->state = parser->classSeen ? css_parser_block : css_parser_skip;
+                }
+                break;
+
+            case '}':
+                if (parser->state != css_parser_selector) {
+                    if (parser->state == css_parser_block) {
+                        // 空的 {} 输出没有属性的 class
+                        rules += cssParserEmit(parser, i + 1);
+                    }
+                    else {
+                        // 没有选择器的 {...} 不产生 key, 直接丢弃
+                        parser->ruleBegin = i + 1;
+                    }
+                    parser->state = css_parser_selector;
+                    parser->classSeen = 0;
+                }
+                break;
+            }
+        }
+
+        pos += n;
+
+    next_block:
+        ;
+    }
+
+    parser->scanPos = pos;
+    return rules;
+}
+
+
+int CssParserFeed(CssParser parser, const char *chunk, size_t len)
+{
+    if (parser->failed) {
+        return -1;
+    }
+    if (parser->ended || len == 0) {
+        return 0;
+    }
+
+    // 已经输出的规则移出窗口
+    if (parser->ruleBegin > 0) {
+        memmove(parser->window, parser->window + parser->ruleBegin, parser->winLen - parser->ruleBegin);
+        parser->winLen -= parser->ruleBegin;
+        parser->scanPos -= parser->ruleBegin;
+        if (parser->state == css_parser_comment) {
+            parser->commentBegin -= parser->ruleBegin;
+        }
+        parser->ruleBegin = 0;
+    }
+
+    if (parser->winLen + len > parser->winSize) {
+        size_t winSize = parser->winSize;
+        while (winSize < parser->winLen + len) {
+            winSize *= 2;
+        }
+        if (winSize > parser->winMax) {
+            winSize = parser->winMax;
+        }
+        if (parser->winLen + len > winSize) {
+            printf("Error: css rule is too big for window (%zu bytes).\n", parser->winMax);
+            parser->failed = 1;
+            return -1;
+        }
+
+        parser->window = (char *) CssMemRealloc(parser->allocator, parser->window, winSize);
+        parser->winSize = winSize;
+    }
+
+    memcpy(parser->window + parser->winLen, chunk, len);
+    parser->winLen += len;
+
+    int rules = cssParserScan(parser, 0);
+    return parser->failed ? -1 : rules;
+}
+
+
+int CssParserFinish(CssParser parser)
+{
+    int rules = 0;
+
+    if (!parser->failed) {
+        rules = cssParserScan(parser, 1);
+
+        while (parser->state == css_parser_comment && !parser->failed) {
+            // 输入结束时仍未确认的 "/*" 不是注释, 从 '*' 开始重新扫描
+            parser->state = parser->commentRet;
+            parser->scanPos = parser->commentBegin + 1;
+            rules += cssParserScan(parser, 1);
+        }
+    }
+
+    // 剩余的内容: 未闭合的 {...}, 丢弃
+    int failed = parser->failed;
+    cssParserReset(parser);
+    return failed ? -1 : rules;
+}
@@ -0,0 +1,88 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssparser.h
+ * @brief CSS 流式 (分块推入) 解析
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 18:30:12
+ * @date 2026-10-16 23:48:30
+ *
+ * @note
+ *   输入按任意大小分块推入 (CssParserFeed), 跨块的不完整内容保存在窗口中.
+ *   每当一个带属性的 {...} 闭合, 就把从上一个规则结束到当前 '}' 的内容解析为一个
+ *   CssKeyArray, 通过回调输出. 回调返回后 keys 被释放, 其中的字符串只在回调期间有效.
+ *   规则之间的划分和注释的判定与一次性解析整个输入完全相同. 只有结尾处没有属性的
+ *   class (如 ".a {}") 不会输出.
+ *   同一个 parser 也可以用 CssParserParse() 一次解析整个输入, 解析结果的内存在两次解析之间
+ *   重复使用, 适合反复解析相近的输入 (如编辑中的样式表).
+ */
+#ifndef CSS_PARSER_H__
+#define CSS_PARSER_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#include "cssparse.h"
+
+
+typedef struct CssParserData *CssParser;
+
+
+// 每个闭合的规则调用一次. 返回 0 继续, 返回非 0 停止解析
+typedef int (*CssParserRuleCallback)(const CssKeyArray ruleKeys, void *userData);
+
+
+// windowSize: 窗口最大字节数 (单个规则加上一个分块的上限), 0 表示 CSS_STRING_BSIZE_MAX
+//   只使用 CssParserParse() 时 onRule 可以为 0
+extern CssParser CssParserNew(size_t windowSize, CssParserRuleCallback onRule, void *userData);
+
+extern void CssParserFree(CssParser parser);
+
+// 推入一块输入. 返回本次输出的规则数, 出错或者被回调停止返回 -1
+extern int CssParserFeed(CssParser parser, const char *chunk, size_t len);
+
+// 输入结束, 输出剩余的规则. 返回本次输出的规则数, 出错返回 -1.
+// 之后 parser 可以用于解析新的输入
+extern int CssParserFinish(CssParser parser);
+
+// 一次解析整个 cssBuf, 结果同 CssStringParse(CssStringNew(cssBuf, cssLen)), 不需要回调.
+//   返回的 keys 属于 parser: 不要 CssKeyArrayFree(), 下次 CssParserParse/Feed/Finish 或者
+//   CssParserFree() 之前有效. cssBuf 在返回后可以释放.
+//   输入和结果都在 parser 的 arena 中, 解析大小相近的输入时不再分配内存. 出错返回 0
+extern CssKeyArray CssParserParse(CssParser parser, const char *cssBuf, size_t cssLen);
+
+// parser 为解析结果保留的内存字节数
+extern size_t CssParserGetMemory(const CssParser parser);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CSS_PARSER_H__ */
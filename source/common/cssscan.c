@@ -0,0 +1,299 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssscan.c
+ * @brief CSS 结构字符扫描 (SSE2/AVX2/scalar)
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 10:12:40
+ * @date 2026-10-16 10:12:40
+ *
+ * @note
+ *   x86/x64 上默认使用 SSE2, CPUID 支持时使用 AVX2. 其他平台只用查表.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "cssscan.h"
+#include "cssthread.h"
+
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   define CSS_SCAN_X86  1
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#   if defined(__GNUC__) || defined(__clang__)
+#       define CSS_SCAN_TARGET(isa)  __attribute__((target(isa)))
+#   else
+#       define CSS_SCAN_TARGET(isa)
+#   endif
+#else
+#   define CSS_SCAN_X86  0
+#endif
+
+
+static const char css_scan_chars[] = {
+    '{', '}', ':', ';', '/', '*', '.', '#', '\t', '\r', '\n', '"', '\'', '\0'
+};
+
+#define CSS_SCAN_NUMCHARS  ((int)(sizeof(css_scan_chars) / sizeof(css_scan_chars[0])))
+
+
+// 常量表, 多线程同时解析时不需要初始化
+static const unsigned char css_scan_table[256] = {
+    ['{'] = 1, ['}'] = 1, [':'] = 1, [';'] = 1, ['/'] = 1, ['*'] = 1, ['.'] = 1,
+    ['#'] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['"'] = 1, ['\''] = 1, ['\0'] = 1
+};
+
+
+static uint64_t cssScanMaskScalar(const char *text, int len)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < len; i++) {
+        if (css_scan_table[(unsigned char)text[i]]) {
+            mask |= ((uint64_t)1 << i);
+        }
+    }
+    return mask;
+}
+
+
+static uint64_t cssScanBlockMaskScalar(const char *text, int len)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] == '{' || text[i] == '}' || text[i] == '/') {
+            mask |= ((uint64_t)1 << i);
+        }
+    }
+    return mask;
+}
+
+
+#if CSS_SCAN_X86
+
+CSS_SCAN_TARGET("sse2")
+static uint64_t cssScanMaskSSE2(const char *text)
+{
+    uint64_t mask = 0;
+
+    for (int k = 0; k < 64; k += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + k));
+        __m128i m = _mm_setzero_si128();
+
+        for (int c = 0; c < CSS_SCAN_NUMCHARS; c++) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(css_scan_chars[c])));
+        }
+
+        mask |= ((uint64_t)(uint16_t)_mm_movemask_epi8(m)) << k;
+    }
+    return mask;
+}
+
+
+CSS_SCAN_TARGET("sse2")
+static uint64_t cssScanBlockMaskSSE2(const char *text)
+{
+    uint64_t mask = 0;
+
+    for (int k = 0; k < 64; k += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + k));
+        __m128i m = _mm_or_si128(_mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('{')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+
+        mask |= ((uint64_t)(uint16_t)_mm_movemask_epi8(m)) << k;
+    }
+    return mask;
+}
+
+
+CSS_SCAN_TARGET("avx2")
+static uint64_t cssScanBlockMaskAVX2(const char *text)
+{
+    uint64_t mask = 0;
+
+    for (int k = 0; k < 64; k += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(text + k));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+
+        mask |= ((uint64_t)(uint32_t)_mm256_movemask_epi8(m)) << k;
+    }
+    return mask;
+}
+
+
+// 按高低 4 位查表: (lo[c & 15] & hi[c >> 4]) != 0 表示 c 是结构字符
+//   hi=0: \0 \t \n \r    hi=2: " # ' * . /    hi=3: : ;    hi=7: { }
+CSS_SCAN_TARGET("avx2")
+static uint64_t cssScanMaskAVX2(const char *text)
+{
+    const __m256i lotab = _mm256_setr_epi8(
+        1, 0, 2, 2, 0, 0, 0, 2, 0, 1, 7, 12, 0, 9, 2, 2,
+        1, 0, 2, 2, 0, 0, 0, 2, 0, 1, 7, 12, 0, 9, 2, 2);
+    const __m256i hitab = _mm256_setr_epi8(
+        1, 0, 2, 4, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 0, 2, 4, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    uint64_t mask = 0;
+
+    for (int k = 0; k < 64; k += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(text + k));
+        __m256i lo = _mm256_shuffle_epi8(lotab, _mm256_and_si256(v, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hitab, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i m = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+
+        mask |= ((uint64_t)(uint32_t)~_mm256_movemask_epi8(m)) << k;
+    }
+    return mask;
+}
+
+
+static int cssScanCpuHasAVX2(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return 0;
+    }
+    __cpuid(info, 1);
+    // OSXSAVE + AVX, 并且操作系统保存 YMM 寄存器
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+        return 0;
+    }
+    if ((_xgetbv(0) & 6) != 6) {
+        return 0;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) ? 1 : 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+}
+
+#endif /* CSS_SCAN_X86 */
+
+
+// 第一次使用时选定, 多个线程可能同时读写
+static volatile int32_t css_scan_level = css_scan_auto;
+
+
+CssScanLevel CssScanSetLevel(CssScanLevel level)
+{
+#if CSS_SCAN_X86
+    int hasAVX2 = cssScanCpuHasAVX2();
+
+    if (level == css_scan_auto) {
+        level = hasAVX2 ? css_scan_avx2 : css_scan_sse2;
+    }
+    else if (level == css_scan_avx2 && !hasAVX2) {
+        level = css_scan_sse2;
+    }
+#else
+    level = css_scan_scalar;
+#endif
+
+    CssAtomicStore(&css_scan_level, (int32_t)level);
+    return level;
+}
+
+
+CssScanLevel CssScanGetLevel(void)
+{
+    CssScanLevel level = (CssScanLevel)CssAtomicLoad(&css_scan_level);
+    if (level == css_scan_auto) {
+        return CssScanSetLevel(css_scan_auto);
+    }
+    return level;
+}
+
+
+const char * CssScanLevelName(CssScanLevel level)
+{
+    switch (level) {
+    case css_scan_scalar:
+        return "scalar";
+    case css_scan_sse2:
+        return "sse2";
+    case css_scan_avx2:
+        return "avx2";
+    default:
+        return "auto";
+    }
+}
+
+
+uint64_t CssScanMask64(const char *text, int len)
+{
+    CssScanLevel level = CssScanGetLevel();
+
+    if (len < 64) {
+        return cssScanMaskScalar(text, len);
+    }
+
+#if CSS_SCAN_X86
+    switch (level) {
+    case css_scan_avx2:
+        return cssScanMaskAVX2(text);
+    case css_scan_sse2:
+        return cssScanMaskSSE2(text);
+    default:
+        break;
+    }
+#endif
+
+    return cssScanMaskScalar(text, 64);
+}
+
+
+uint64_t CssScanBlockMask64(const char *text, int len)
+{
+    CssScanLevel level = CssScanGetLevel();
+
+    if (len < 64) {
+        return cssScanBlockMaskScalar(text, len);
+    }
+
+#if CSS_SCAN_X86
+    switch (level) {
+    case css_scan_avx2:
+        return cssScanBlockMaskAVX2(text);
+    case css_scan_sse2:
+        return cssScanBlockMaskSSE2(text);
+    default:
+        break;
+    }
+#endif
+
+    return cssScanBlockMaskScalar(text, 64);
+}
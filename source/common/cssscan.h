@@ -0,0 +1,97 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssscan.h
+ * @brief CSS 结构字符扫描 (SSE2/AVX2/scalar)
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 10:12:40
+ * @date 2026-10-16 10:12:40
+ *
+ * @note
+ *   结构字符: { } : ; / * . # \t \r \n " ' \0
+ *   每次扫描 64 字节, 返回位掩码: 第 i 位为 1 表示 text[i] 是结构字符.
+ */
+#ifndef CSS_SCAN_H__
+#define CSS_SCAN_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+
+typedef enum {
+    css_scan_auto = 0,      // 按 CPUID 自动选择
+    css_scan_scalar = 1,    // 查表, 逐字节
+    css_scan_sse2 = 2,      // 16 字节一次
+    css_scan_avx2 = 3       // 32 字节一次
+} CssScanLevel;
+
+
+// 设置扫描方式, 返回实际使用的方式 (CPU 不支持时降级)
+extern CssScanLevel CssScanSetLevel(CssScanLevel level);
+
+extern CssScanLevel CssScanGetLevel(void);
+
+extern const char * CssScanLevelName(CssScanLevel level);
+
+// 返回 text[0 ... len-1] 的结构字符位掩码, len <= 64
+extern uint64_t CssScanMask64(const char *text, int len);
+
+// 同 CssScanMask64, 只匹配 { } / (并行解析的预扫描只需要这 3 个字符)
+extern uint64_t CssScanBlockMask64(const char *text, int len);
+
+
+// 最低位 1 的位置, mask 不能为 0
+static inline int CssScanFirstBit(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)mask)) {
+        return (int)index;
+    }
+    _BitScanForward(&index, (unsigned long)(mask >> 32));
+    return (int)index + 32;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CSS_SCAN_H__ */
@@ -0,0 +1,328 @@
+/******************************************************************************
+* Copyright © 2024-2035 Light Zhang <mapaware@hotmail.com>, MapAware, Inc.
+* ALL RIGHTS RESERVED.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+******************************************************************************/
+/**
+ * @file cssthread.h
+ * @brief 库内部使用的线程, 互斥锁, 屏障, 原子操作和自旋锁 (Win32 / pthread), 以及名称的 hash
+ *
+ * @author mapaware@hotmail.com
+ * @copyright © 2024-2030 mapaware.top All Rights Reserved.
+ * @version 0.0.1
+ *
+ * @since 2026-10-16 20:05:36
+ * @date 2026-10-16 21:10:08
+ *
+ * @note
+ *   只包含 static inline 函数, 不是公开接口.
+ */
+#ifndef CSS_THREAD_H__
+#define CSS_THREAD_H__
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+
+typedef void (*CssThreadFunc)(void *arg);
+
+
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    CssThreadFunc func;
+    void *arg;
+} CssThread;
+
+
+typedef struct {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} CssThreadMutex;
+
+
+// 所有线程到齐后才一起返回, 可以重复使用
+typedef struct {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE cond;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+    int count;
+    int waiting;
+    unsigned int phase;
+} CssThreadBarrier;
+
+
+#ifdef _WIN32
+static inline DWORD WINAPI CssThreadEntry(LPVOID arg)
+{
+    CssThread *thread = (CssThread *)arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#else
+static inline void * CssThreadEntry(void *arg)
+{
+    CssThread *thread = (CssThread *)arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#endif
+
+
+// 创建线程失败时直接退出
+static inline void CssThreadStart(CssThread *thread, CssThreadFunc func, void *arg)
+{
+    thread->func = func;
+    thread->arg = arg;
+#ifdef _WIN32
+    thread->handle = CreateThread(0, 0, CssThreadEntry, thread, 0, 0);
+    if (!thread->handle) {
+#else
+    if (pthread_create(&thread->handle, 0, CssThreadEntry, thread) != 0) {
+#endif
+        printf("Error: create thread failed\n");
+        abort();
+    }
+}
+
+
+static inline void CssThreadJoin(CssThread *thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, 0);
+#endif
+}
+
+
+static inline void CssThreadMutexInit(CssThreadMutex *mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_init(&mutex->lock, 0);
+#endif
+}
+
+
+static inline void CssThreadMutexUninit(CssThreadMutex *mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+}
+
+
+static inline void CssThreadMutexLock(CssThreadMutex *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+
+static inline void CssThreadMutexUnlock(CssThreadMutex *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+
+static inline void CssThreadBarrierInit(CssThreadBarrier *barrier, int count)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&barrier->lock);
+    InitializeConditionVariable(&barrier->cond);
+#else
+    pthread_mutex_init(&barrier->lock, 0);
+    pthread_cond_init(&barrier->cond, 0);
+#endif
+    barrier->count = count;
+    barrier->waiting = 0;
+    barrier->phase = 0;
+}
+
+
+static inline void CssThreadBarrierUninit(CssThreadBarrier *barrier)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&barrier->lock);
+#else
+    pthread_mutex_destroy(&barrier->lock);
+    pthread_cond_destroy(&barrier->cond);
+#endif
+}
+
+
+static inline void CssThreadBarrierWait(CssThreadBarrier *barrier)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&barrier->lock);
+#else
+    pthread_mutex_lock(&barrier->lock);
+#endif
+    unsigned int phase = barrier->phase;
+
+    if (++barrier->waiting == barrier->count) {
+        barrier->waiting = 0;
+        barrier->phase++;
+#ifdef _WIN32
+        WakeAllConditionVariable(&barrier->cond);
+#else
+        pthread_cond_broadcast(&barrier->cond);
+#endif
+    }
+    else {
+        while (phase == barrier->phase) {
+#ifdef _WIN32
+            SleepConditionVariableCS(&barrier->cond, &barrier->lock, INFINITE);
+#else
+            pthread_cond_wait(&barrier->cond, &barrier->lock);
+#endif
+        }
+    }
+
+#ifdef _WIN32
+    LeaveCriticalSection(&barrier->lock);
+#else
+    pthread_mutex_unlock(&barrier->lock);
+#endif
+}
+
+
+// 原子读 (acquire)
+static inline int32_t CssAtomicLoad(const volatile int32_t *p)
+{
+#ifdef _WIN32
+    return *(const volatile long *)p;
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+// 原子写 (release)
+static inline void CssAtomicStore(volatile int32_t *p, int32_t value)
+{
+#ifdef _WIN32
+    InterlockedExchange((volatile long *)p, (long)value);
+#else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#endif
+}
+
+
+static inline const void * CssAtomicLoadPtr(const void * const volatile *p)
+{
+#ifdef _WIN32
+    return *p;
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+// *p 为 0 时设置为 value. 返回原来的值, 0 表示设置成功
+static inline const void * CssAtomicSetPtr(const void * volatile *p, const void *value)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchangePointer((PVOID volatile *)p, (PVOID)value, 0);
+#else
+    const void *old = 0;
+    __atomic_compare_exchange_n(p, &old, value, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return old;
+#endif
+}
+
+
+// 自旋锁, 0 为未锁定. 只用于很短的临界区
+static inline void CssSpinLock(volatile int32_t *lock)
+{
+#ifdef _WIN32
+    while (InterlockedCompareExchange((volatile long *)lock, 1, 0) != 0) {
+        SwitchToThread();
+    }
+#else
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+#endif
+}
+
+
+static inline void CssSpinUnlock(volatile int32_t *lock)
+{
+#ifdef _WIN32
+    InterlockedExchange((volatile long *)lock, 0);
+#else
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+
+// FNV-1a
+static inline uint32_t CssHashFnv1a(const char *name, int len)
+{
+    uint32_t h = 2166136261U;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619U;
+    }
+    return h;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CSS_THREAD_H__ */
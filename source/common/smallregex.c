@@ -33,7 +33,8 @@
  *   '$'        End anchor, matches end of string
  *   '*'        Asterisk, match zero or more (greedy)
  *   '+'        Plus, match one or more (greedy)
- *   '?'        Question, match zero or one (non-greedy)
+ *   '?'        Question, match zero or one (greedy)
+ *   '*?' '+?' '??' The same but lazy, match as few as possible
  *   '[abc]'    Character class, match if one of {'a', 'b', 'c'}
  *   '[^abc]'   Inverted class, match if NOT one of {'a', 'b', 'c'} -- NOTE: feature is currently broken!
  *   '[a-zA-Z]' Character ranges, the character set of the ranges { a-z | A-Z }
@@ -75,9 +76,47 @@
 
 #else
 
-    #define KMALLOC(_CNT_, _SIZE_) calloc(_CNT_, _SIZE_)
-    #define KREALLOC(_ADDR_, _SIZE_) realloc(_ADDR_, _SIZE_)
-    #define KFREE(_ADDR_) if (_ADDR_ != NULL) free((void*)_ADDR_)
+    // through the allocator of the calling thread, see regex_set_allocator()
+    #define KMALLOC(_CNT_, _SIZE_) __re_calloc(_CNT_, _SIZE_)
+    #define KREALLOC(_ADDR_, _SIZE_) __re_realloc(_ADDR_, _SIZE_)
+    #define KFREE(_ADDR_) if (_ADDR_ != NULL) __re_free((void*)_ADDR_)
+
+    #if defined(_MSC_VER)
+        #define RE_THREAD_LOCAL __declspec(thread)
+    #else
+        #define RE_THREAD_LOCAL __thread
+    #endif
+
+    static RE_THREAD_LOCAL const struct regex_allocator * __re_allocator = NULL;
+
+    static void * __re_calloc(size_t cnt, size_t size)
+    {
+        if (__re_allocator == NULL) {
+            return calloc(cnt, size);
+        }
+        void * ptr = __re_allocator->alloc(__re_allocator->udata, cnt * size);
+        if (ptr != NULL) {
+            memset(ptr, 0, cnt * size);
+        }
+        return ptr;
+    }
+
+    static void * __re_realloc(void * ptr, size_t size)
+    {
+        if (__re_allocator == NULL) {
+            return realloc(ptr, size);
+        }
+        return __re_allocator->realloc(__re_allocator->udata, ptr, size);
+    }
+
+    static void __re_free(void * ptr)
+    {
+        if (__re_allocator == NULL) {
+            free(ptr);
+        } else {
+            __re_allocator->free(__re_allocator->udata, ptr);
+        }
+    }
 
 #endif // _KERNEL
 
@@ -124,170 +163,2030 @@
         DV(GROUPEND,        ")"     )
 
 
-enum {
-    FOREACH_GLOBAL_TYPE(GENERATE_ENUM_ANY)
-};
+enum {
+    FOREACH_GLOBAL_TYPE(GENERATE_ENUM_ANY)
+};
+
+
+// a state of the NFA matcher, built in the match ctx
+struct sstate {
+    int32_t tok;        // the single character node, or RE_NFA_*
+    int32_t out;        // the next state (a dangling edge while building)
+    int32_t out1;       // the second next state of RE_NFA_SPLIT
+    uint32_t mark;      // the last step which added the state
+};
+
+// a thread of the NFA matcher: its state and where its match started
+struct re_thread {
+    int32_t state;
+    int32_t start;
+};
+
+// end of the text: the slice end if there is one, or else the terminating null
+#define TEXT_END(_st_) \
+    ((textend != NULL) ? (text + (_st_) >= textend) : (text[_st_] == '\0'))
+
+
+/**
+ * A structure for grouping instancing
+ */
+struct re_pair_inst {
+    uint32_t trueoff;   // offset for eval true
+    uint32_t failoff;   // offset for eval false
+};
+
+
+/**
+ * Compilation args
+ */
+struct args_reg_compile {
+    struct re_pair_inst *inst;  // start end of groups (offsets)
+    uint32_t objs;          // amount of the objects
+    uint32_t strln;         // the length of the class length
+    uint32_t ecnt;          // the length og the inst
+};
+
+
+#ifdef RE_BUILDWITH_DEBUG
+    static const char* typestr[] = {
+        FOREACH_GLOBAL_TYPE(GENERATE_VAL_STRINGS_VAL)
+    };
+
+    const char* typenames[] = {
+        FOREACH_GLOBAL_TYPE(GENERATE_VAR_NAMES_VAL)
+    };
+#endif
+
+// Private function declarations:
+static int32_t matchcharclass(char c, const char* str);
+static int32_t matchone(const struct small_regex * pattern, struct regex_objs_t p, char c);
+static int32_t matchdigit(char c);
+static int32_t matchalpha(char c);
+static int32_t matchwhitespace(char c);
+static int32_t matchmetachar(char c, const char* str);
+static int32_t matchrange(char c, const char* str);
+static int32_t ismetachar(char c);
+static int32_t __regex_compile_count(const char* pattern, struct args_reg_compile * args);
+static int32_t __check_state_size(uint32_t sp, uint32_t * reacnt, uint32_t default_dep, void ** ptr, size_t structsize, uint32_t max_reallocs);
+static int32_t __ctx_reserve(struct regex_match_ctx * ctx, uint32_t size);
+static int32_t __node_repeat(const struct regex_objs_t * objs, uint32_t i);
+static int32_t __has_top_branch(const struct regex_objs_t * objs);
+static void __regex_compile_prefix(struct small_regex * reg);
+static const char * __next_in_firstset(const uint32_t * firstset, const char * text, const char * textend);
+static const char * __next_candidate(const struct small_regex * reg, const char * text, const char * textend);
+static void __regex_compile_dfa(struct small_regex * reg);
+static int32_t __dfa_match(struct regex_match_ctx * ctx, const struct small_regex * reg, const char * text, const char * textend, int32_t * mend);
+static int32_t __regex_search(struct regex_match_ctx * ctx, const struct small_regex * regx, const char * text, const char * textend, int32_t * mend);
+static int32_t __nfa_search(struct regex_match_ctx * ctx, const struct small_regex * reg, const char * text, const char * textend, int32_t * mend);
+static uint32_t __dfa_nodes(const struct small_regex * reg);
+static int32_t __dfa_prepare(struct regex_match_ctx * ctx, const struct small_regex * const * regs, uint32_t nregs);
+static int32_t __dfa_search(struct re_dfa * dfa, const struct small_regex * reg, const char * text, const char * textend, int32_t * mend, int32_t * mseg);
+static void __dfa_free(struct re_dfa * dfa);
+
+static int32_t __check_state_size(uint32_t sp, uint32_t * reacnt, uint32_t default_dep, void ** ptr, size_t structsize, uint32_t max_reallocs)
+{
+    // check if the stack pointer (SP) went out of range
+    if (( sp >= ( (*reacnt)*default_dep) ) && (max_reallocs != 0)) {
+        if  ( (*reacnt) >= max_reallocs) {
+            LOGERR("%s can't realloc because limit was reached max: %u\r\n", __FUNCTION__, max_reallocs);
+            return 1;
+        } else {
+            void * tmp =  KREALLOC((*ptr), (*reacnt) * default_dep * structsize);
+            if (tmp == NULL) {
+                LOGERR("%s realloc failed\r\n", __FUNCTION__);
+                // KFREE(stack);
+                return 1;
+            }
+
+            DPROBE("reallocating: sp: %u reacnt:%u new size: %lu\r\n", sp, *reacnt, (*reacnt) * default_dep * structsize);
+
+            (*reacnt)++;
+            *ptr = tmp;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * __ctx_reserve
+ *  makes the ctx sstate at least size entries, grows x2
+ *  returns: 0 on success, 1 on error
+ */
+static int32_t __ctx_reserve(struct regex_match_ctx * ctx, uint32_t size)
+{
+    if (size <= ctx->stsize) {
+        return 0;
+    }
+
+    uint32_t newsize = (ctx->stsize != 0) ? ctx->stsize : DEFAULT_STATES_DEP;
+    while (newsize < size) {
+        newsize *= 2;
+    }
+
+    void * tmp = KREALLOC(ctx->sstate, newsize * sizeof(struct sstate));
+    if (tmp == NULL) {
+        LOGERR("%s realloc failed\r\n", __FUNCTION__);
+        return 1;
+    }
+
+    DPROBE("ctx reallocating: size: %u new size: %u\r\n", ctx->stsize, newsize);
+
+    ctx->sstate = (struct sstate *) tmp;
+    ctx->stsize = newsize;
+    ctx->allocs++;
+    return 0;
+}
+
+
+/*
+ * __node_repeat
+ *  reads the quantifiers after the node i (x?+ is (x?)+, still optional),
+ *  a '?' right after a quantifier only makes it lazy (x+? is not optional)
+ *  returns: 0 if there is none, 1 if the node is optional (? or *),
+ *  2 if it is only repeated (+)
+ */
+static int32_t __node_repeat(const struct regex_objs_t * objs, uint32_t i)
+{
+    int32_t r = 0;
+    int32_t quantified = 0;
+
+    for (i++; ; i++) {
+        if ((objs[i].type == QUESTIONMARK) && quantified) {
+            quantified = 0;
+        } else if ((objs[i].type == QUESTIONMARK) || (objs[i].type == STAR)) {
+            r = 1;
+            quantified = 1;
+        } else if (objs[i].type == PLUS) {
+            r = (r == 1) ? 1 : 2;
+            quantified = 1;
+        } else {
+            return r;
+        }
+    }
+}
+
+
+/*
+ * __has_top_branch
+ *  checks for a '|' outside of the groups: then the first node of the
+ *  program is only the first node of the first alternative
+ *  returns: 1 if there is one, 0 otherwise
+ */
+static int32_t __has_top_branch(const struct regex_objs_t * objs)
+{
+    uint32_t depth = 0;
+    uint32_t i;
+
+    for (i = 0; objs[i].type != UNUSED; i++) {
+        if (objs[i].type == GROUPSTART) {
+            depth++;
+        } else if ((objs[i].type == GROUPEND) && (depth > 0)) {
+            depth--;
+        } else if ((objs[i].type == BRANCH) && (depth == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * __regex_compile_prefix
+ *  finds what every unanchored match must start with:
+ *  - the leading CHAR nodes which are not optional give the literal prefix
+ *  - otherwise the first node, if it is not optional, gives the set of the
+ *    first bytes
+ *  a '|' outside of the groups makes every node optional
+ *  returns: void
+ */
+static void __regex_compile_prefix(struct small_regex * reg)
+{
+    const struct regex_objs_t * objs = SECTION_OBJECTS(reg);
+    uint32_t i;
+    int c;
+
+    reg->hasfirstset = 0;
+    reg->prefixlen = 0;
+
+    if (__has_top_branch(objs)) {
+        return;
+    }
+
+    for (i = 0; (reg->prefixlen < RE_PREFIX_MAX) && (objs[i].type == CHAR); i++) {
+        int32_t r = __node_repeat(objs, i);
+        if (r == 1) {
+            break;
+        }
+        reg->prefix[reg->prefixlen++] = (char) objs[i].ch;
+        if (r == 2) {
+            // x+ : the next node is the +
+            break;
+        }
+    }
+
+    if ((reg->prefixlen > 0) || (objs[0].type == UNUSED) || (__node_repeat(objs, 0) == 1)) {
+        return;
+    }
+
+    memset(reg->firstset, 0, sizeof(reg->firstset));
+
+    // '\0' only counts in the slices of regex_find
+    for (c = 0; c < 256; c++) {
+        int32_t r = matchone(reg, objs[0], (char) c);
+        if (r == -1) {
+            // not a single character node
+            return;
+        } else if (r == 1) {
+            reg->firstset[c >> 5] |= (1U << (c & 31));
+        }
+    }
+
+    reg->hasfirstset = 1;
+}
+
+
+/*
+ * __next_in_firstset
+ *  skips the bytes which are not in the firstset
+ *  returns: the first byte in the set or NULL if there is no one
+ */
+static const char * __next_in_firstset(const uint32_t * firstset, const char * text, const char * textend)
+{
+    for (; (textend != NULL) ? (text < textend) : (*text != '\0'); text++) {
+        uint8_t c = (uint8_t) *text;
+        if (firstset[c >> 5] & (1U << (c & 31))) {
+            return text;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * __next_candidate
+ *  skips the positions which can not start a match, the text ends at
+ *  textend if it is not NULL or else at the terminating null
+ *  returns: the first candidate position or NULL if there is no one
+ */
+static const char * __next_candidate(const struct small_regex * reg, const char * text, const char * textend)
+{
+    if (reg->prefixlen > 0) {
+        if (textend == NULL) {
+            // strchr/strncmp stop at the terminating null
+            while ((text = strchr(text, reg->prefix[0])) != NULL) {
+                if (strncmp(text + 1, reg->prefix + 1, reg->prefixlen - 1) == 0) {
+                    return text;
+                }
+                text++;
+            }
+            return NULL;
+        }
+
+        while ((size_t)(textend - text) >= reg->prefixlen) {
+            text = (const char *) memchr(text, reg->prefix[0], (size_t)(textend - text) - reg->prefixlen + 1);
+            if (text == NULL) {
+                return NULL;
+            }
+            if (memcmp(text + 1, reg->prefix + 1, reg->prefixlen - 1) == 0) {
+                return text;
+            }
+            text++;
+        }
+        return NULL;
+    }
+
+    return __next_in_firstset(reg->firstset, text, textend);
+}
+
+
+/*
+ * NFA matcher
+ *
+ *  Runs every program, the lazy DFA only runs the linear ones. The objects
+ *  are the tokens of the pattern in order: alt := seq ('|' seq)*,
+ *  seq := (atom quantifier*)*, atom := node | '(' alt ')'. They are built
+ *  into a Thompson NFA in the match ctx: a state matches one byte (a single
+ *  character node), splits in two (? * + and |), or checks ^ (the start of
+ *  the text) or $ (the end of the text). A quantifier without an atom and a
+ *  ')' without a '(' are skipped.
+ *
+ *  All threads move over the text together, so every alternative of ? * +
+ *  and | is tried and every (state, byte) is visited once: O(n * m) with
+ *  no recursion over the text. The threads are kept in the order of their
+ *  priority, as a backtracker would try them: the earlier start first, then
+ *  the left alternative of '|', one more loop of a greedy quantifier and one
+ *  less of a lazy one ('*?' '+?' '??'). When two of them reach the same
+ *  state the first one stays, it would have been tried first.
+ *  When a thread accepts, the threads after it are dropped and no new
+ *  thread starts. The scan goes on while the threads before it live, one of
+ *  them may still accept and replaces the match: the result is the match a
+ *  backtracker finds first at the leftmost start. A linear program has no
+ *  '|' nor lazy quantifier, there it is the longest match, the same as the
+ *  DFA. A loop around a body that matches empty, as (a*?)*, keeps only the
+ *  first thread of its state and may end where a backtracker would not.
+ */
+
+#define RE_NFA_SPLIT        (-1)    // two epsilon edges: out and out1
+#define RE_NFA_EMPTY        (-2)    // one epsilon edge: out
+#define RE_NFA_BEGIN        (-3)    // ^: out if at the start of the text
+#define RE_NFA_END          (-4)    // $: out if at the end of the text
+#define RE_NFA_MATCH        (-5)    // accepts
+
+// the states of a program with objs objects (the UNUSED included)
+#define RE_NFA_STATES(_objs_)   (2 * (_objs_) + 2)
+
+// the ctx entries: the states, two lists of threads and the closure stack
+#define RE_NFA_ENTRIES(_objs_)  (3 * RE_NFA_STATES(_objs_))
+
+// a part of the NFA being built: the first state and the list of the
+// dangling edges (state * 2 + 1 for out1, -1 ends the list)
+struct re_frag {
+    int32_t start;
+    int32_t out;
+};
+
+struct re_nfa_build {
+    const struct regex_objs_t * objs;
+    struct sstate * st;
+    uint32_t i;                 // the next object
+    uint32_t n;                 // the states built
+};
+
+struct re_nfa {
+    struct sstate * st;
+    struct re_thread * list[2]; // the threads at the current and next byte
+    int32_t * stack;            // the closure stack
+    uint32_t mark;              // the current step
+    int32_t mstart;             // the start of the match, -1 if none
+    int32_t mend;               // the end of the match
+};
+
+
+static int32_t * __nfa_edge(struct sstate * st, int32_t h)
+{
+    return (h & 1) ? &st[h >> 1].out1 : &st[h >> 1].out;
+}
+
+
+/*
+ * __nfa_patch
+ *  points the dangling edges of the list h to the state s
+ */
+static void __nfa_patch(struct sstate * st, int32_t h, int32_t s)
+{
+    while (h >= 0) {
+        int32_t * e = __nfa_edge(st, h);
+        h = *e;
+        *e = s;
+    }
+}
+
+
+/*
+ * __nfa_append
+ *  returns: the list h1 followed by the list h2
+ */
+static int32_t __nfa_append(struct sstate * st, int32_t h1, int32_t h2)
+{
+    int32_t h = h1;
+
+    if (h1 < 0) {
+        return h2;
+    }
+    while (*__nfa_edge(st, h) >= 0) {
+        h = *__nfa_edge(st, h);
+    }
+    *__nfa_edge(st, h) = h2;
+    return h1;
+}
+
+
+static int32_t __nfa_state(struct re_nfa_build * b, int32_t tok, int32_t out, int32_t out1)
+{
+    int32_t s = (int32_t) b->n++;
+
+    b->st[s].tok = tok;
+    b->st[s].out = out;
+    b->st[s].out1 = out1;
+    b->st[s].mark = 0;
+    return s;
+}
+
+
+static struct re_frag __nfa_alt(struct re_nfa_build * b, uint32_t depth);
+
+/*
+ * __nfa_seq
+ *  builds the atoms up to '|', the ')' of the group or the end
+ *  returns: the fragment, an empty state if there is no atom
+ */
+static struct re_frag __nfa_seq(struct re_nfa_build * b, uint32_t depth)
+{
+    struct re_frag f = { -1, -1 };
+
+    for (;;) {
+        uint8_t type = b->objs[b->i].type;
+        struct re_frag g;
+        int32_t s;
+
+        if ((type == UNUSED) || (type == BRANCH) || ((type == GROUPEND) && (depth > 0))) {
+            break;
+        }
+
+        if ((type == GROUPEND) || (type == QUESTIONMARK) || (type == STAR) || (type == PLUS)) {
+            // nothing to close or to repeat
+            b->i++;
+            continue;
+        }
+
+        if (type == GROUPSTART) {
+            b->i++;
+            g = __nfa_alt(b, depth + 1);
+            if (b->objs[b->i].type == GROUPEND) {
+                b->i++;
+            }
+        } else {
+            if (type == BEGIN) {
+                s = __nfa_state(b, RE_NFA_BEGIN, -1, -1);
+            } else if (type == END) {
+                s = __nfa_state(b, RE_NFA_END, -1, -1);
+            } else {
+                s = __nfa_state(b, (int32_t) b->i, -1, -1);
+            }
+            g.start = s;
+            g.out = s * 2;
+            b->i++;
+        }
+
+        for (;;) {
+            type = b->objs[b->i].type;
+            if ((type != STAR) && (type != PLUS) && (type != QUESTIONMARK)) {
+                break;
+            }
+            b->i++;
+
+            // the split follows out first: the atom if greedy, the exit if
+            // lazy (a '?' right after the quantifier)
+            int32_t lazy = (b->objs[b->i].type == QUESTIONMARK);
+            if (lazy) {
+                b->i++;
+                s = __nfa_state(b, RE_NFA_SPLIT, -1, g.start);
+            } else {
+                s = __nfa_state(b, RE_NFA_SPLIT, g.start, -1);
+            }
+            int32_t leave = lazy ? s * 2 : s * 2 + 1;
+
+            if (type == STAR) {
+                __nfa_patch(b->st, g.out, s);
+                g.start = s;
+                g.out = leave;
+            } else if (type == PLUS) {
+                __nfa_patch(b->st, g.out, s);
+                g.out = leave;
+            } else {
+                g.start = s;
+                g.out = __nfa_append(b->st, g.out, leave);
+            }
+        }
+
+        if (f.start < 0) {
+            f = g;
+        } else {
+            __nfa_patch(b->st, f.out, g.start);
+            f.out = g.out;
+        }
+    }
+
+    if (f.start < 0) {
+        f.start = __nfa_state(b, RE_NFA_EMPTY, -1, -1);
+        f.out = f.start * 2;
+    }
+    return f;
+}
+
+
+/*
+ * __nfa_alt
+ *  builds seq ('|' seq)*
+ *  returns: the fragment
+ */
+static struct re_frag __nfa_alt(struct re_nfa_build * b, uint32_t depth)
+{
+    struct re_frag f = __nfa_seq(b, depth);
+
+    while (b->objs[b->i].type == BRANCH) {
+        b->i++;
+        struct re_frag g = __nfa_seq(b, depth);
+        f.start = __nfa_state(b, RE_NFA_SPLIT, f.start, g.start);
+        f.out = __nfa_append(b->st, f.out, g.out);
+    }
+    return f;
+}
+
+
+/*
+ * __nfa_build
+ *  builds the NFA of reg into st (RE_NFA_STATES entries)
+ *  returns: the start state
+ */
+static int32_t __nfa_build(const struct small_regex * reg, struct sstate * st)
+{
+    struct re_nfa_build b = { SECTION_OBJECTS(reg), st, 0, 0 };
+    struct re_frag f = __nfa_alt(&b, 0);
+
+    __nfa_patch(st, f.out, __nfa_state(&b, RE_NFA_MATCH, -1, -1));
+    return f.start;
+}
+
+
+/*
+ * __nfa_add
+ *  adds the thread (s, start) at pos and follows its epsilon edges, out
+ *  before out1, the states already added in this step are skipped
+ */
+static void __nfa_add(struct re_nfa * nfa, struct re_thread * list, uint32_t * n, int32_t s, int32_t start,
+    const char * text, const char * textend, int32_t pos)
+{
+    struct sstate * st = nfa->st;
+    uint32_t sp = 0;
+
+    nfa->stack[sp++] = s;
+    while (sp > 0) {
+        s = nfa->stack[--sp];
+        if (st[s].mark == nfa->mark) {
+            continue;
+        }
+        st[s].mark = nfa->mark;
+
+        switch (st[s].tok) {
+        case RE_NFA_SPLIT:
+            // out is followed first
+            nfa->stack[sp++] = st[s].out1;
+            nfa->stack[sp++] = st[s].out;
+            break;
+
+        case RE_NFA_EMPTY:
+            nfa->stack[sp++] = st[s].out;
+            break;
+
+        case RE_NFA_BEGIN:
+            if (pos == 0) {
+                nfa->stack[sp++] = st[s].out;
+            }
+            break;
+
+        case RE_NFA_END:
+            if (TEXT_END(pos)) {
+                nfa->stack[sp++] = st[s].out;
+            }
+            break;
+
+        default:
+            // a byte to match or RE_NFA_MATCH, in the order of priority
+            list[*n].state = s;
+            list[*n].start = start;
+            (*n)++;
+            break;
+        }
+    }
+}
+
+
+/*
+ * __nfa_search
+ *  searches text up to textend, or up to '\0' if textend is NULL, the ctx
+ *  has RE_NFA_ENTRIES entries reserved
+ *  mend: if not NULL, gets the end of the match
+ *  returns: the start of the match or -1
+ */
+static int32_t __nfa_search(struct regex_match_ctx * ctx, const struct small_regex * reg, const char * text, const char * textend, int32_t * mend)
+{
+    const struct regex_objs_t * objs = SECTION_OBJECTS(reg);
+    uint32_t nstates = RE_NFA_STATES(COUNT_NODES(reg));
+    struct re_nfa nfa;
+    uint32_t n = 0;
+    int32_t pos = 0;
+
+    // ^ first (and no '|' after it): only 0 can start a match
+    int32_t anchored = (objs[0].type == BEGIN) && !__has_top_branch(objs);
+    int32_t skip = !anchored && ((reg->prefixlen > 0) || (reg->hasfirstset == 1));
+    const char * cand = skip ? __next_candidate(reg, text, textend) : text;
+
+    nfa.st = ctx->sstate;
+    nfa.list[0] = (struct re_thread *) (ctx->sstate + nstates);
+    nfa.list[1] = nfa.list[0] + nstates;
+    nfa.stack = (int32_t *) (ctx->sstate + 2 * nstates);
+    nfa.mark = 1;
+    nfa.mstart = -1;
+    nfa.mend = 0;
+
+    int32_t s0 = __nfa_build(reg, nfa.st);
+
+    for (;;) {
+        if ((n == 0) && ((nfa.mstart >= 0) || (anchored && (pos > 0)) || (cand == NULL))) {
+            break;
+        }
+        if ((n == 0) && skip && (text + pos < cand)) {
+            // only the positions which can start a match
+            pos = (int32_t)(cand - text);
+            nfa.mark++;
+        }
+
+        if ((nfa.mstart < 0) && (!anchored || (pos == 0))) {
+            if (skip && (cand != NULL) && (text + pos > cand)) {
+                cand = __next_candidate(reg, text + pos, textend);
+            }
+            if (!skip || ((cand != NULL) && (text + pos == cand))) {
+                // a new thread after the earlier ones
+                __nfa_add(&nfa, nfa.list[0], &n, s0, pos, text, textend, pos);
+            }
+        }
+
+        int32_t end = TEXT_END(pos);
+        char c = end ? '\0' : text[pos];
+        uint32_t nn = 0;
+        uint32_t k;
+
+        nfa.mark++;
+        for (k = 0; k < n; k++) {
+            const struct re_thread * t = &nfa.list[0][k];
+            if (nfa.st[t->state].tok == RE_NFA_MATCH) {
+                // the threads after it have a lower priority
+                nfa.mstart = t->start;
+                nfa.mend = pos;
+                break;
+            }
+            if (!end && (matchone(reg, objs[nfa.st[t->state].tok], c) == 1)) {
+                __nfa_add(&nfa, nfa.list[1], &nn, nfa.st[t->state].out, t->start, text, textend, pos + 1);
+            }
+        }
+        if (end) {
+            break;
+        }
+        pos++;
+
+        struct re_thread * tmp = nfa.list[0];
+        nfa.list[0] = nfa.list[1];
+        nfa.list[1] = tmp;
+        n = nn;
+    }
+
+    if ((nfa.mstart >= 0) && (mend != NULL)) {
+        *mend = nfa.mend;
+    }
+    return nfa.mstart;
+}
+
+
+/*
+ * Lazy DFA
+ *
+ *  Runs the linear programs: [^] (node [*+?])... [$] where every node is a
+ *  single character node. A regex_set runs several of them at once: the
+ *  program of the pattern k is the segment k, its nodes are the positions
+ *  base[k] ... base[k] + n - 1 and the position base[k] + n accepts. A
+ *  position p means "node p is the next". A DFA state is the ordered list
+ *  of the positions of the live threads, the threads started earlier (and
+ *  at the same byte, the threads of the lower segments) come first, so a
+ *  state only keeps the first thread at every position.
+ *
+ *  Forward: a new thread of every segment starts after every byte (unless
+ *  ^). When a thread accepts, it and all threads after it are dropped and
+ *  no new thread starts any more. The scan goes on while the earlier
+ *  threads live, the last accepting byte ends a match of the leftmost start
+ *  and of the lowest segment at that start. The accepting position of a $
+ *  segment is only taken at the end of the text.
+ *  Backward from that end over the reversed segment, the smallest accepting
+ *  position is the start. A single regex with $ only uses the backward scan
+ *  from the end of the text.
+ *
+ *  The states and the transitions are built when they are first needed and
+ *  cached in the match ctx, the cache is flushed when it is full. The bytes
+ *  matched by the same nodes share one class (one transition column).
+ *  '?' is resolved like '*' with at most one match. A lazy quantifier is
+ *  a second quantifier on its node, such a program is not linear and runs
+ *  on the NFA.
+ */
+
+#define RE_DFA_MAX_POS      64  // positions of all segments, bit p of the uint64_t masks
+#define RE_DFA_HASH_SIZE    (RE_DFA_MAX_STATES * 2)
+#define RE_DFA_UNKNOWN      (-1)
+
+// the scans of __dfa_step
+#define RE_DFA_FIRST        0   // forward, unanchored, up to the first match
+#define RE_DFA_BACKWARD     1   // backward over the reversed segments
+#define RE_DFA_LONGEST      2   // forward, anchored, all the matches
+
+struct re_dfa_cache {
+    uint32_t nstates;                                   // interned states
+    int32_t start[RE_SET_MAX_PATTERNS + 1];             // [0]: all segments, [k + 1]: segment k, or -1
+    int32_t startacc;                                   // RE_DFA_FIRST: (segment + 1) accepted by start[0], or 0
+    uint8_t npos[RE_DFA_MAX_STATES];                    // positions of each state
+    uint8_t done[RE_DFA_MAX_STATES];                    // forward: a thread accepted, no new threads
+    uint8_t pos[RE_DFA_MAX_STATES][RE_DFA_MAX_POS];
+    int16_t hash[RE_DFA_HASH_SIZE];                     // state index or -1
+    int32_t * next;                                     // [state * nclasses + class]: (state << 8) | (accepting segment + 1)
+    uint32_t nextsize;                                  // allocated entries in next
+};
+
+struct re_dfa {
+    const struct small_regex * regs[RE_SET_MAX_PATTERNS]; // the regexes this DFA is built for
+    uint32_t nregs;                                     // segments, 0 if not built
+    uint8_t * data;                                     // copy of the data of all regexes, a new regex may get the same address
+    uint32_t datasize;
+    uint32_t datacap;
+    uint32_t npos;                                      // positions of all segments
+    uint32_t begin;                                     // bit k: the segment k has ^
+    uint32_t end;                                       // bit k: the segment k has $
+    uint8_t base[RE_SET_MAX_PATTERNS];                  // the first position of each segment
+    uint8_t segof[RE_DFA_MAX_POS];                      // position -> segment
+    uint8_t quant[RE_DFA_MAX_POS];                      // CHAR (once), STAR, PLUS, QUESTIONMARK or END (accepts)
+    uint8_t rquant[RE_DFA_MAX_POS];                     // every segment reversed in place
+    uint32_t nclasses;
+    uint8_t classof[256];                               // byte -> class
+    uint64_t mask[256];                                 // class -> positions matching it (bit p = position p)
+    uint64_t rmask[256];                                // the same for the reversed segments
+    uint32_t firstset[8];                               // bytes a match of any segment can start with
+    uint8_t hasfirstset;                                // 1 if firstset is valid (a set without ^)
+    struct re_dfa_cache fwd;
+    struct re_dfa_cache rev;
+    struct re_dfa_cache lng;                            // the end of the match for regex_find
+};
+
+
+static int32_t __dfa_single_node(uint8_t type)
+{
+    switch (type) {
+    case DOT:
+    case CHAR:
+    case CHAR_CLASS:
+    case INV_CHAR_CLASS:
+    case DIGIT:
+    case NOT_DIGIT:
+    case ALPHA:
+    case NOT_ALPHA:
+    case WHITESPACE:
+    case NOT_WHITESPACE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+
+/*
+ * __dfa_nodes
+ *  returns: the single character nodes of a linear program, or 0
+ */
+static uint32_t __dfa_nodes(const struct small_regex * reg)
+{
+    const struct regex_objs_t * objs = SECTION_OBJECTS(reg);
+    uint32_t i = 0;
+    uint32_t nodes = 0;
+
+    if (objs[i].type == BEGIN) {
+        i++;
+    }
+    while (__dfa_single_node(objs[i].type)) {
+        i++;
+        nodes++;
+        if ((objs[i].type == STAR) || (objs[i].type == PLUS) || (objs[i].type == QUESTIONMARK)) {
+            i++;
+        }
+    }
+    if (objs[i].type == END) {
+        i++;
+    }
+
+    return (objs[i].type == UNUSED) ? nodes : 0;
+}
+
+
+/*
+ * __regex_compile_dfa
+ *  sets reg->dfa if the program is linear
+ *  returns: void
+ */
+static void __regex_compile_dfa(struct small_regex * reg)
+{
+    uint32_t nodes = __dfa_nodes(reg);
+
+    reg->dfa = ((nodes > 0) && (nodes <= RE_DFA_MAX_NODES)) ? 1 : 0;
+}
+
+
+static void __dfa_free(struct re_dfa * dfa)
+{
+    if (dfa != NULL) {
+        KFREE(dfa->data);
+        KFREE(dfa->fwd.next);
+        KFREE(dfa->rev.next);
+        KFREE(dfa->lng.next);
+        KFREE(dfa);
+    }
+}
+
+
+static void __dfa_flush(struct re_dfa_cache * cache, uint32_t nclasses)
+{
+    uint32_t i;
+
+    cache->nstates = 0;
+    cache->startacc = 0;
+    for (i = 0; i <= RE_SET_MAX_PATTERNS; i++) {
+        cache->start[i] = -1;
+    }
+    for (i = 0; i < RE_DFA_HASH_SIZE; i++) {
+        cache->hash[i] = -1;
+    }
+    for (i = 0; i < RE_DFA_MAX_STATES * nclasses; i++) {
+        cache->next[i] = RE_DFA_UNKNOWN;
+    }
+}
+
+
+/*
+ * __dfa_prepare_cache
+ *  makes the transition table large enough and empties the cache
+ *  returns: 0 on success, 1 on error
+ */
+static int32_t __dfa_prepare_cache(struct regex_match_ctx * ctx, struct re_dfa_cache * cache, uint32_t nclasses)
+{
+    uint32_t size = RE_DFA_MAX_STATES * nclasses;
+
+    if (cache->nextsize < size) {
+        void * tmp = KREALLOC(cache->next, size * sizeof(int32_t));
+        if (tmp == NULL) {
+            LOGERR("%s realloc failed\r\n", __FUNCTION__);
+            return 1;
+        }
+        cache->next = (int32_t *) tmp;
+        cache->nextsize = size;
+        ctx->allocs++;
+    }
+
+    __dfa_flush(cache, nclasses);
+    return 0;
+}
+
+
+/*
+ * __dfa_built_for
+ *  returns: 1 if the DFA is built for the regexes (the same addresses and data)
+ */
+static int32_t __dfa_built_for(struct re_dfa * dfa, const struct small_regex * const * regs, uint32_t nregs, uint32_t datasize)
+{
+    uint32_t off = 0;
+    uint32_t k;
+
+    if ((dfa->nregs != nregs) || (dfa->datasize != datasize)) {
+        return 0;
+    }
+    for (k = 0; k < nregs; k++) {
+        if ((dfa->regs[k] != regs[k]) || (memcmp(dfa->data + off, regs[k]->data, regs[k]->totalsize) != 0)) {
+            return 0;
+        }
+        off += regs[k]->totalsize;
+    }
+    return 1;
+}
+
+
+/*
+ * __dfa_prepare
+ *  builds the segments, the byte classes and empty caches for the linear
+ *  regexes (at most RE_DFA_MAX_POS positions together), nothing is done if
+ *  the ctx DFA is built for them already
+ *  returns: 0 on success, 1 on error
+ */
+static int32_t __dfa_prepare(struct regex_match_ctx * ctx, const struct small_regex * const * regs, uint32_t nregs)
+{
+    struct re_dfa * dfa = ctx->dfa;
+    const struct small_regex * nodereg[RE_DFA_MAX_POS]; // position -> its regex (NULL if it accepts)
+    uint32_t nodeobj[RE_DFA_MAX_POS];               // position -> its node
+    uint8_t rposof[RE_DFA_MAX_POS];                 // position -> the position in the reversed segment
+    uint32_t datasize = 0;
+    uint32_t k, p;
+    int c;
+
+    for (k = 0; k < nregs; k++) {
+        datasize += regs[k]->totalsize;
+    }
+
+    if (dfa == NULL) {
+        dfa = (struct re_dfa *) KMALLOC(1, sizeof(struct re_dfa));
+        if (dfa == NULL) {
+            LOGERR("%s malloc failed\r\n", __FUNCTION__);
+            return 1;
+        }
+        ctx->dfa = dfa;
+        ctx->allocs++;
+    } else if (__dfa_built_for(dfa, regs, nregs, datasize)) {
+        return 0;
+    }
+
+    dfa->nregs = 0;
+
+    if (dfa->datacap < datasize) {
+        void * tmp = KREALLOC(dfa->data, datasize);
+        if (tmp == NULL) {
+            LOGERR("%s realloc failed\r\n", __FUNCTION__);
+            return 1;
+        }
+        dfa->data = (uint8_t *) tmp;
+        dfa->datacap = datasize;
+        ctx->allocs++;
+    }
+
+    // the program, one segment for each regex
+    dfa->npos = 0;
+    dfa->begin = 0;
+    dfa->end = 0;
+    for (k = 0; k < nregs; k++) {
+        const struct regex_objs_t * objs = SECTION_OBJECTS(regs[k]);
+        uint32_t i = 0;
+        uint32_t b = dfa->npos;
+
+        dfa->base[k] = (uint8_t) b;
+        if (objs[i].type == BEGIN) {
+            dfa->begin |= (1U << k);
+            i++;
+        }
+        while (__dfa_single_node(objs[i].type)) {
+            p = dfa->npos++;
+            nodereg[p] = regs[k];
+            nodeobj[p] = i++;
+            dfa->segof[p] = (uint8_t) k;
+            dfa->quant[p] = CHAR;
+            if ((objs[i].type == STAR) || (objs[i].type == PLUS) || (objs[i].type == QUESTIONMARK)) {
+                dfa->quant[p] = objs[i++].type;
+            }
+        }
+        if (objs[i].type == END) {
+            dfa->end |= (1U << k);
+        }
+
+        // the accepting position
+        p = dfa->npos++;
+        nodereg[p] = NULL;
+        dfa->segof[p] = (uint8_t) k;
+        dfa->quant[p] = END;
+
+        for (p = b; p < dfa->npos - 1; p++) {
+            rposof[p] = (uint8_t)(b + (dfa->npos - 2 - p));
+            dfa->rquant[rposof[p]] = dfa->quant[p];
+        }
+        rposof[dfa->npos - 1] = (uint8_t)(dfa->npos - 1);
+        dfa->rquant[dfa->npos - 1] = END;
+    }
+
+    // the byte classes, '\0' only matches in the slices of regex_find
+    dfa->nclasses = 0;
+    for (c = 0; c < 256; c++) {
+        uint64_t mask = 0;
+        uint32_t cls;
+
+        for (p = 0; p < dfa->npos; p++) {
+            if ((nodereg[p] != NULL) && (matchone(nodereg[p], (SECTION_OBJECTS(nodereg[p]))[nodeobj[p]], (char) c) == 1)) {
+                mask |= ((uint64_t) 1 << p);
+            }
+        }
+        for (cls = 0; cls < dfa->nclasses; cls++) {
+            if (dfa->mask[cls] == mask) {
+                break;
+            }
+        }
+        if (cls == dfa->nclasses) {
+            dfa->mask[dfa->nclasses++] = mask;
+        }
+        dfa->classof[c] = (uint8_t) cls;
+    }
+
+    for (k = 0; k < dfa->nclasses; k++) {
+        uint64_t rmask = 0;
+        for (p = 0; p < dfa->npos; p++) {
+            if (dfa->mask[k] & ((uint64_t) 1 << p)) {
+                rmask |= ((uint64_t) 1 << rposof[p]);
+            }
+        }
+        dfa->rmask[k] = rmask;
+    }
+
+    // a set skips to the bytes any segment can start with
+    memset(dfa->firstset, 0, sizeof(dfa->firstset));
+    dfa->hasfirstset = (dfa->begin == 0);
+    for (k = 0; k < nregs; k++) {
+        if (regs[k]->prefixlen > 0) {
+            c = (uint8_t) regs[k]->prefix[0];
+            dfa->firstset[c >> 5] |= (1U << (c & 31));
+        } else if (regs[k]->hasfirstset == 1) {
+            for (p = 0; p < 8; p++) {
+                dfa->firstset[p] |= regs[k]->firstset[p];
+            }
+        } else {
+            dfa->hasfirstset = 0;
+        }
+    }
+
+    if ((__dfa_prepare_cache(ctx, &dfa->fwd, dfa->nclasses) != 0) || (__dfa_prepare_cache(ctx, &dfa->rev, dfa->nclasses) != 0) ||
+        (__dfa_prepare_cache(ctx, &dfa->lng, dfa->nclasses) != 0)) {
+        return 1;
+    }
+
+    for (k = 0, p = 0; k < nregs; k++) {
+        memcpy(dfa->data + p, regs[k]->data, regs[k]->totalsize);
+        p += regs[k]->totalsize;
+        dfa->regs[k] = regs[k];
+    }
+    dfa->datasize = datasize;
+    dfa->nregs = nregs;
+    return 0;
+}
+
+
+/*
+ * __dfa_closure
+ *  appends the position p and the positions reached by skipping the
+ *  following * and ? nodes, a position already in the list is skipped
+ *  returns: void
+ */
+static void __dfa_closure(const uint8_t * quant, uint32_t p, uint8_t * list, uint32_t * n, uint64_t * seen)
+{
+    for (;;) {
+        if ((*seen & ((uint64_t) 1 << p)) == 0) {
+            *seen |= ((uint64_t) 1 << p);
+            list[(*n)++] = (uint8_t) p;
+        }
+        if ((quant[p] != STAR) && (quant[p] != QUESTIONMARK)) {
+            // a node which must match, or the accepting position
+            break;
+        }
+        p++;
+    }
+}
+
+
+/*
+ * __dfa_accept
+ *  RE_DFA_FIRST: cuts the list before the first accepting position, the
+ *                accepting positions of the $ segments stay in the list
+ *                (they only count at the end of the text)
+ *  else: removes all accepting positions
+ *  returns: (segment + 1) of the first accepting position, or 0
+ */
+static int32_t __dfa_accept(struct re_dfa * dfa, uint8_t * list, uint32_t * n, uint32_t first)
+{
+    int32_t acc = 0;
+    uint32_t i;
+    uint32_t j = 0;
+
+    for (i = 0; i < *n; i++) {
+        uint8_t p = list[i];
+
+        if (dfa->quant[p] == END) {
+            if (!first) {
+                if (acc == 0) {
+                    acc = dfa->segof[p] + 1;
+                }
+                continue;
+            }
+            if ((dfa->end & (1U << dfa->segof[p])) == 0) {
+                acc = dfa->segof[p] + 1;
+                break;
+            }
+        }
+        list[j++] = p;
+    }
+
+    *n = j;
+    return acc;
+}
+
+
+/*
+ * __dfa_intern
+ *  returns: the index of the state with the list, or -1 if the cache is full
+ */
+static int32_t __dfa_intern(struct re_dfa_cache * cache, const uint8_t * list, uint32_t n, uint8_t done)
+{
+    uint32_t h = n * 2 + done;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        h = h * 31 + list[i];
+    }
+    h %= RE_DFA_HASH_SIZE;
+
+    while (cache->hash[h] != -1) {
+        int32_t s = cache->hash[h];
+        if ((cache->npos[s] == n) && (cache->done[s] == done) && (memcmp(cache->pos[s], list, n) == 0)) {
+            return s;
+        }
+        h = (h + 1) % RE_DFA_HASH_SIZE;
+    }
+
+    if (cache->nstates == RE_DFA_MAX_STATES) {
+        return -1;
+    }
+
+    int32_t s = (int32_t) cache->nstates++;
+    cache->npos[s] = (uint8_t) n;
+    cache->done[s] = done;
+    memcpy(cache->pos[s], list, n);
+    cache->hash[h] = (int16_t) s;
+    return s;
+}
+
+
+/*
+ * __dfa_start
+ *  seg: the segment, or -1 for all segments (RE_DFA_FIRST, an empty match
+ *       at the start is taken like after a step: see cache->startacc)
+ *  returns: the start state (closure of the first positions)
+ */
+static int32_t __dfa_start(struct re_dfa * dfa, struct re_dfa_cache * cache, const uint8_t * quant, int32_t seg)
+{
+    if (cache->start[seg + 1] < 0) {
+        uint8_t list[RE_DFA_MAX_POS];
+        uint32_t n = 0;
+        uint64_t seen = 0;
+        int32_t acc = 0;
+        uint32_t k;
+
+        for (k = 0; k < dfa->nregs; k++) {
+            if ((seg < 0) || ((uint32_t) seg == k)) {
+                __dfa_closure(quant, dfa->base[k], list, &n, &seen);
+            }
+        }
+        if (seg < 0) {
+            acc = __dfa_accept(dfa, list, &n, 1);
+        }
+
+        int32_t s = __dfa_intern(cache, list, n, (uint8_t)(acc != 0));
+        if (s < 0) {
+            __dfa_flush(cache, dfa->nclasses);
+            s = __dfa_intern(cache, list, n, (uint8_t)(acc != 0));
+        }
+        cache->start[seg + 1] = s;
+        if (seg < 0) {
+            cache->startacc = acc;
+        }
+    }
+    return cache->start[seg + 1];
+}
+
+
+/*
+ * __dfa_step
+ *  moves all threads of the state over a byte of the class cls
+ *  RE_DFA_FIRST: a new thread of every segment without ^ starts until one
+ *                accepts, the threads after the accepting one are dropped
+ *  RE_DFA_BACKWARD, RE_DFA_LONGEST: the accepting threads are dropped,
+ *                the others go on
+ *  returns: (next state << 8) | (segment + 1) if a thread accepted
+ */
+static int32_t __dfa_step(struct re_dfa * dfa, struct re_dfa_cache * cache, uint32_t mode, int32_t state, uint32_t cls)
+{
+    int32_t * slot = &cache->next[(uint32_t) state * dfa->nclasses + cls];
+
+    if (*slot != RE_DFA_UNKNOWN) {
+        return *slot;
+    }
+
+    uint32_t backward = (mode == RE_DFA_BACKWARD);
+    uint32_t first = (mode == RE_DFA_FIRST);
+    const uint8_t * quant = backward ? dfa->rquant : dfa->quant;
+    uint64_t mask = backward ? dfa->rmask[cls] : dfa->mask[cls];
+    uint8_t list[RE_DFA_MAX_POS];
+    uint32_t n = 0;
+    uint64_t seen = 0;
+    int32_t acc;
+    uint8_t done;
+    uint32_t i;
+
+    for (i = 0; i < cache->npos[state]; i++) {
+        uint32_t p = cache->pos[state][i];
+
+        if ((quant[p] != END) && (mask & ((uint64_t) 1 << p))) {
+            if ((quant[p] == STAR) || (quant[p] == PLUS)) {
+                // stay in the loop
+                __dfa_closure(quant, p, list, &n, &seen);
+            }
+            __dfa_closure(quant, p + 1, list, &n, &seen);
+        }
+    }
+
+    if (first && !cache->done[state]) {
+        // the new threads start after all the others
+        for (i = 0; i < dfa->nregs; i++) {
+            if ((dfa->begin & (1U << i)) == 0) {
+                __dfa_closure(quant, dfa->base[i], list, &n, &seen);
+            }
+        }
+    }
+
+    acc = __dfa_accept(dfa, list, &n, first);
+    done = (uint8_t)(first && (cache->done[state] || (acc != 0)));
+
+    int32_t next = __dfa_intern(cache, list, n, done);
+    if (next < 0) {
+        // the cache is full, the current state is gone too
+        __dfa_flush(cache, dfa->nclasses);
+        next = __dfa_intern(cache, list, n, done);
+        return (next << 8) | acc;
+    }
+
+    *slot = (next << 8) | acc;
+    return *slot;
+}
+
+
+/*
+ * __dfa_has_accept
+ *  returns: 1 if the state has an accepting position
+ */
+static int32_t __dfa_has_accept(struct re_dfa * dfa, struct re_dfa_cache * cache, int32_t state)
+{
+    uint32_t i;
+
+    for (i = 0; i < cache->npos[state]; i++) {
+        if (dfa->quant[cache->pos[state][i]] == END) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * __dfa_backward
+ *  scans the segment seg backward from end (not below text)
+ *  returns: the smallest accepting position or -1
+ */
+static int32_t __dfa_backward(struct re_dfa * dfa, int32_t seg, const char * text, const char * end)
+{
+    struct re_dfa_cache * cache = &dfa->rev;
+    int32_t state = __dfa_start(dfa, cache, dfa->rquant, seg);
+    int32_t best = -1;
+
+    if (__dfa_has_accept(dfa, cache, state)) {
+        // all nodes are optional
+        best = (int32_t)(end - text);
+    }
+
+    while ((end > text) && (cache->npos[state] > 0)) {
+        end--;
+        int32_t r = __dfa_step(dfa, cache, RE_DFA_BACKWARD, state, dfa->classof[(uint8_t) *end]);
+        state = r >> 8;
+        if (r & 0xFF) {
+            best = (int32_t)(end - text);
+        }
+    }
+    return best;
+}
+
+
+/*
+ * __dfa_longest
+ *  scans the segment seg forward from text (anchored) up to textend, or
+ *  up to '\0' if textend is NULL
+ *  returns: the largest accepting position or -1
+ */
+static int32_t __dfa_longest(struct re_dfa * dfa, int32_t seg, const char * text, const char * textend)
+{
+    struct re_dfa_cache * cache = &dfa->lng;
+    int32_t state = __dfa_start(dfa, cache, dfa->quant, seg);
+    const char * p = text;
+    int32_t best = -1;
+
+    if (__dfa_has_accept(dfa, cache, state)) {
+        best = 0;
+    }
+
+    while ((cache->npos[state] > 0) && ((textend != NULL) ? (p < textend) : (*p != '\0'))) {
+        int32_t r = __dfa_step(dfa, cache, RE_DFA_LONGEST, state, dfa->classof[(uint8_t) *p]);
+        p++;
+        state = r >> 8;
+        if (r & 0xFF) {
+            best = (int32_t)(p - text);
+        }
+    }
+    return best;
+}
+
+
+/*
+ * __dfa_search
+ *  the leftmost match of all segments, of the lowest segment at that start
+ *  reg: the regex of a single segment (its prefix is used to skip), or NULL
+ *  mend: if not NULL, gets the end of the longest match at the start
+ *  mseg: if not NULL, gets the segment
+ *  returns: the start of the match or -1
+ */
+static int32_t __dfa_search(struct re_dfa * dfa, const struct small_regex * reg, const char * text, const char * textend, int32_t * mend, int32_t * mseg)
+{
+    struct re_dfa_cache * cache = &dfa->fwd;
+    const char * p = text;
+    const char * end = NULL;
+    int32_t prefilter;
+    int32_t seg = -1;
+    int32_t start;
+    int32_t state;
+    uint32_t i;
+
+    if (reg != NULL) {
+        prefilter = (!dfa->begin) && ((reg->prefixlen > 0) || (reg->hasfirstset == 1));
+    } else {
+        prefilter = dfa->hasfirstset;
+    }
+
+    if ((dfa->nregs == 1) && dfa->end) {
+        // $: only the backward scan from the end of the text
+        int32_t len = (int32_t)((textend != NULL) ? (textend - text) : strlen(text));
+
+        start = __dfa_backward(dfa, 0, text, text + len);
+        if (dfa->begin && (start != 0)) {
+            start = -1;
+        }
+        if (start >= 0) {
+            if (mend != NULL) {
+                *mend = len;
+            }
+            if (mseg != NULL) {
+                *mseg = 0;
+            }
+        }
+        return start;
+    }
+
+    state = __dfa_start(dfa, cache, dfa->quant, -1);
+    if (cache->startacc != 0) {
+        // the empty match at 0
+        seg = cache->startacc - 1;
+        end = text;
+    }
+
+    for (;;) {
+        if ((end != NULL) && (dfa->nregs == 1) && ((end == text) || dfa->begin)) {
+            // one segment: nothing starts before 0
+            break;
+        }
+        if (prefilter && (end == NULL) && (state == cache->start[0])) {
+            // only new threads: skip to where they can survive
+            p = (reg != NULL) ? __next_candidate(reg, p, textend) : __next_in_firstset(dfa->firstset, p, textend);
+            if (p == NULL) {
+                return -1;
+            }
+        }
+        if ((textend != NULL) ? (p >= textend) : (*p == '\0')) {
+            // the $ segments still alive match at the end
+            for (i = 0; (dfa->end != 0) && (i < cache->npos[state]); i++) {
+                if (dfa->quant[cache->pos[state][i]] == END) {
+                    seg = dfa->segof[cache->pos[state][i]];
+                    end = p;
+                    break;
+                }
+            }
+            break;
+        }
+
+        int32_t r = __dfa_step(dfa, cache, RE_DFA_FIRST, state, dfa->classof[(uint8_t) *p]);
+        p++;
+        state = r >> 8;
+        if (r & 0xFF) {
+            seg = (r & 0xFF) - 1;
+            end = p;
+        }
+        if (cache->npos[state] == 0) {
+            break;
+        }
+    }
+
+    if (end == NULL) {
+        return -1;
+    }
+
+    if (dfa->begin & (1U << seg)) {
+        start = 0;
+    } else {
+        // the leftmost start of the matches ending at end
+        start = __dfa_backward(dfa, seg, text, end);
+    }
+
+    if (mend != NULL) {
+        if (dfa->end & (1U << seg)) {
+            *mend = (int32_t)(end - text);
+        } else {
+            int32_t len = __dfa_longest(dfa, seg, text + start, textend);
+            *mend = start + ((len > 0) ? len : 0);
+        }
+    }
+    if (mseg != NULL) {
+        *mseg = seg;
+    }
+    return start;
+}
+
+
+/*
+ * __dfa_match
+ *  the DFA version of the __regex_search
+ *  mend: if not NULL, gets the end of the longest match at the start
+ *  returns: 0 or larger on success, -1 if there is no match, -2 on error
+ */
+static int32_t __dfa_match(struct regex_match_ctx * ctx, const struct small_regex * reg, const char * text, const char * textend, int32_t * mend)
+{
+    if (__dfa_prepare(ctx, &reg, 1) != 0) {
+        return -2;
+    }
+
+    return __dfa_search(ctx->dfa, reg, text, textend, mend, NULL);
+}
+
+
+// Public functions
+int32_t regex_validate(const struct small_regex * regex)
+{
+    ASSERT_NULL_R(regex, 1);
+    uint32_t i;
+    uint32_t count = COUNT_NODES(regex);
+
+    //convert pattern
+    const struct regex_objs_t * objs = SECTION_OBJECTS(regex);
+
+    for (i = 0; objs[i].type != UNUSED; ++i) {
+        if ((count != 0) && (i >= count)) {
+            LOGERR("regex_validator: reached end (count: %u) before the UNUSED node was reached\r\n", count);
+            return 1;
+        }
+
+        if (objs[i].trueoffset >= count) {
+            LOGERR("regex_validator: true offset is out of bound has: %u max: %u\r\n", objs[i].trueoffset, count);
+            return 1;
+        } else if (objs[i].falseoffset >= count) {
+            LOGERR("regex_validator: false offset is out of bound has: %u max: %u\r\n", objs[i].falseoffset, count);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void regex_free(struct small_regex * regex)
+{
+    KFREE(regex);
+}
+
+
+#ifndef _KERNEL
+const struct regex_allocator * regex_set_allocator(const struct regex_allocator * allocator)
+{
+    const struct regex_allocator * old = __re_allocator;
+    __re_allocator = allocator;
+    return old;
+}
+#endif
+
+
+int32_t regex_match(const char* pattern, const char* text)
+{
+    int32_t ret = -1;
+    const struct small_regex * reg = regex_cache_get(pattern);
+    if (!reg) {
+        LOGERR("failed at %s:%u\r\n", __FUNCTION__, __LINE__);
+    } else {
+        ret = regex_matchp(reg, text);
+        regex_cache_put(reg);
+    }
+    return ret;
+}
+
+
+/* The pattern cache: RE_CACHE_SIZE entries, each with a reference count.
+ *  A reader takes an entry by incrementing refs: a positive result means the
+ *  entry is not being replaced and its fields stay put until the reader
+ *  decrements refs again. A writer (under __re_cache_lock) replaces an entry
+ *  only after moving refs from 0 to RE_CACHE_LOCKED, readers which increment
+ *  a locked entry see a negative count and back off. */
+#if defined(_MSC_VER)
+    #include <intrin.h>
+    #define RE_ATOMIC_ADD(_P_, _V_) (_InterlockedExchangeAdd((volatile long *)(_P_), (_V_)) + (_V_))
+    #define RE_ATOMIC_ADD64(_P_, _V_) _InterlockedExchangeAdd64((volatile __int64 *)(_P_), (_V_))
+    #define RE_ATOMIC_CAS(_P_, _OLD_, _NEW_) \
+        (_InterlockedCompareExchange((volatile long *)(_P_), (_NEW_), (_OLD_)) == (_OLD_))
+    #define RE_ATOMIC_LOAD(_P_) (*(_P_))
+    #define RE_ATOMIC_STORE(_P_, _V_) (*(_P_) = (_V_))
+    #define RE_CPU_YIELD() _mm_pause()
+#else
+    #define RE_ATOMIC_ADD(_P_, _V_) __atomic_add_fetch((_P_), (_V_), __ATOMIC_ACQ_REL)
+    #define RE_ATOMIC_ADD64(_P_, _V_) __atomic_add_fetch((_P_), (_V_), __ATOMIC_RELAXED)
+    #define RE_ATOMIC_CAS(_P_, _OLD_, _NEW_) \
+        __extension__ ({ int32_t __old = (_OLD_); \
+            __atomic_compare_exchange_n((_P_), &__old, (_NEW_), 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED); })
+    #define RE_ATOMIC_LOAD(_P_) __atomic_load_n((_P_), __ATOMIC_RELAXED)
+    #define RE_ATOMIC_STORE(_P_, _V_) __atomic_store_n((_P_), (_V_), __ATOMIC_RELAXED)
+    #ifdef _KERNEL
+        #define RE_CPU_YIELD() cpu_spinwait()
+    #else
+        #include <sched.h>
+        #define RE_CPU_YIELD() sched_yield()
+    #endif
+#endif
+
+#define RE_CACHE_LOCKED (-0x40000000)
+
+/* the cache outlives any caller, its patterns always use the default allocator */
+#ifdef _KERNEL
+    #define RE_CACHE_ALLOCATOR_BEGIN()
+    #define RE_CACHE_ALLOCATOR_END()
+#else
+    #define RE_CACHE_ALLOCATOR_BEGIN() \
+        const struct regex_allocator * __saved_allocator = __re_allocator; __re_allocator = NULL
+    #define RE_CACHE_ALLOCATOR_END() \
+        __re_allocator = __saved_allocator
+#endif
+
+struct re_cache_entry {
+    volatile int32_t refs;          // readers holding the entry, negative while replaced
+    volatile uint32_t used;         // __re_cache_clock at the last hit
+    volatile uint32_t hash;         // hash of the pattern, 0 if empty
+    char * pattern;                 // copy of the pattern
+    struct small_regex * volatile regex;
+};
+
+static struct re_cache_entry __re_cache[RE_CACHE_SIZE];
+static volatile int32_t __re_cache_lock = 0;
+static volatile uint32_t __re_cache_clock = 0;
+static volatile uint64_t __re_cache_hits = 0;
+static volatile uint64_t __re_cache_misses = 0;
+static volatile uint64_t __re_cache_evictions = 0;
+
+
+/* __re_cache_lock_acquire
+ * The lock is held only to pick and fill an entry (patterns are compiled
+ *  outside of it), give the CPU away if it is taken anyway.
+ */
+static void __re_cache_lock_acquire(void)
+{
+    while (!RE_ATOMIC_CAS(&__re_cache_lock, 0, 1)) {
+        RE_CPU_YIELD();
+    }
+}
+
+
+/* __re_cache_hash
+ * FNV-1a of the pattern, never 0 (0 marks an empty entry)
+ */
+static uint32_t __re_cache_hash(const char * pattern)
+{
+    uint32_t h = 2166136261U;
+    for (; *pattern; pattern++) {
+        h = (h ^ (uint8_t) *pattern) * 16777619U;
+    }
+    return h ? h : 1;
+}
+
+
+/* __re_cache_lookup
+ * Takes the entry of the pattern without any lock.
+ *
+ * returns: the entry (refs taken) or NULL if the pattern is not cached
+ */
+static struct re_cache_entry * __re_cache_lookup(const char * pattern, uint32_t hash)
+{
+    uint32_t i;
+
+    for (i = 0; i < RE_CACHE_SIZE; i++) {
+        struct re_cache_entry * e = &__re_cache[i];
+
+        if (RE_ATOMIC_LOAD(&e->hash) != hash) {
+            continue;
+        }
+        if (RE_ATOMIC_ADD(&e->refs, 1) > 0) {
+            // fields are stable now
+            if (e->hash == hash && e->regex != NULL && strcmp(e->pattern, pattern) == 0) {
+                RE_ATOMIC_STORE(&e->used, RE_ATOMIC_ADD(&__re_cache_clock, 1));
+                return e;
+            }
+        }
+        RE_ATOMIC_ADD(&e->refs, -1);
+    }
+    return NULL;
+}
+
+
+/* __re_cache_victim
+ * Locks an empty entry, or else the least recently used entry nobody holds.
+ *  Called under __re_cache_lock.
+ *
+ * returns: the locked entry or NULL if all entries are held
+ */
+static struct re_cache_entry * __re_cache_victim(void)
+{
+    uint32_t i, tries;
+
+    for (tries = 0; tries < RE_CACHE_SIZE; tries++) {
+        struct re_cache_entry * best = NULL;
+
+        for (i = 0; i < RE_CACHE_SIZE; i++) {
+            struct re_cache_entry * e = &__re_cache[i];
+
+            if (RE_ATOMIC_LOAD(&e->refs) != 0) {
+                continue;
+            }
+            if (e->regex == NULL) {
+                best = e;
+                break;
+            }
+            if (best == NULL || (int32_t)(RE_ATOMIC_LOAD(&e->used) - RE_ATOMIC_LOAD(&best->used)) < 0) {
+                best = e;
+            }
+        }
+        if (best == NULL) {
+            return NULL;
+        }
+        // a reader may take it meanwhile: pick again
+        if (RE_ATOMIC_CAS(&best->refs, 0, RE_CACHE_LOCKED)) {
+            return best;
+        }
+    }
+    return NULL;
+}
+
+
+const struct small_regex * regex_cache_get(const char* pattern)
+{
+    ASSERT_NULL_R(pattern, NULL);
+
+    uint32_t hash = __re_cache_hash(pattern);
+    struct re_cache_entry * e = __re_cache_lookup(pattern, hash);
+
+    if (e != NULL) {
+        RE_ATOMIC_ADD64(&__re_cache_hits, 1);
+        return e->regex;
+    }
+
+    RE_CACHE_ALLOCATOR_BEGIN();
+
+    // compile outside of the lock
+    struct small_regex * reg = regex_compile(pattern);
+    if (reg == NULL) {
+        RE_CACHE_ALLOCATOR_END();
+        return NULL;
+    }
+    size_t patlen = strlen(pattern) + 1;
+    char * copy = (char *) KMALLOC(1, patlen);
+    if (copy == NULL) {
+        // still usable, regex_cache_put frees it
+        RE_CACHE_ALLOCATOR_END();
+        return reg;
+    }
+    memcpy(copy, pattern, patlen);
+
+    __re_cache_lock_acquire();
+
+    // another thread may have added it meanwhile
+    e = __re_cache_lookup(pattern, hash);
+    if (e != NULL) {
+        RE_ATOMIC_ADD(&__re_cache_lock, -1);
+        RE_ATOMIC_ADD64(&__re_cache_hits, 1);
+        KFREE(copy);
+        regex_free(reg);
+        RE_CACHE_ALLOCATOR_END();
+        return e->regex;
+    }
+    RE_ATOMIC_ADD64(&__re_cache_misses, 1);
+
+    e = __re_cache_victim();
+    if (e == NULL) {
+        // every entry is held: not cached
+        RE_ATOMIC_ADD(&__re_cache_lock, -1);
+        KFREE(copy);
+        RE_CACHE_ALLOCATOR_END();
+        return reg;
+    }
+    if (e->regex != NULL) {
+        RE_ATOMIC_ADD64(&__re_cache_evictions, 1);
+        regex_free(e->regex);
+        KFREE(e->pattern);
+    }
+    e->pattern = copy;
+    RE_ATOMIC_STORE(&e->regex, reg);
+    RE_ATOMIC_STORE(&e->hash, hash);
+    RE_ATOMIC_STORE(&e->used, RE_ATOMIC_ADD(&__re_cache_clock, 1));
+
+    // unlock the entry and hold it for the caller
+    RE_ATOMIC_ADD(&e->refs, 1 - RE_CACHE_LOCKED);
+    RE_ATOMIC_ADD(&__re_cache_lock, -1);
+    RE_CACHE_ALLOCATOR_END();
+    return reg;
+}
+
+
+void regex_cache_put(const struct small_regex * regex)
+{
+    uint32_t i;
+
+    if (regex == NULL) {
+        return;
+    }
+    // the caller holds the entry, so no other entry can have the same pointer
+    for (i = 0; i < RE_CACHE_SIZE; i++) {
+        if (RE_ATOMIC_LOAD(&__re_cache[i].regex) == regex) {
+            RE_ATOMIC_ADD(&__re_cache[i].refs, -1);
+            return;
+        }
+    }
+    // was not cached
+    RE_CACHE_ALLOCATOR_BEGIN();
+    KFREE(regex);
+    RE_CACHE_ALLOCATOR_END();
+}
+
+
+void regex_cache_get_stats(struct regex_cache_stats * stats)
+{
+    uint32_t i;
+
+    stats->hits = RE_ATOMIC_ADD64(&__re_cache_hits, 0);
+    stats->misses = RE_ATOMIC_ADD64(&__re_cache_misses, 0);
+    stats->evictions = RE_ATOMIC_ADD64(&__re_cache_evictions, 0);
+    stats->entries = 0;
+    stats->capacity = (uint32_t) RE_CACHE_SIZE;
+
+    for (i = 0; i < RE_CACHE_SIZE; i++) {
+        if (RE_ATOMIC_LOAD(&__re_cache[i].regex) != NULL) {
+            stats->entries++;
+        }
+    }
+}
+
+
+uint32_t regex_cache_clear(void)
+{
+    uint32_t i, held = 0;
 
+    RE_CACHE_ALLOCATOR_BEGIN();
+    __re_cache_lock_acquire();
 
-// stack instance
-struct sstate {
-    uint32_t matchcnt;  //for *+ match count
-    int32_t offset;     //current offset
-    int32_t st0;        //the last st0 accomulator
-    int32_t st;         //current st
-};
+    for (i = 0; i < RE_CACHE_SIZE; i++) {
+        struct re_cache_entry * e = &__re_cache[i];
 
-// push stack
-#define PUSH()      sstate[sp+1].offset = sstate[sp].offset; sstate[sp+1].st = sstate[sp].st; sp++;
+        if (e->regex == NULL) {
+            continue;
+        }
+        if (!RE_ATOMIC_CAS(&e->refs, 0, RE_CACHE_LOCKED)) {
+            held++;
+            continue;
+        }
+        regex_free(e->regex);
+        KFREE(e->pattern);
+        e->pattern = NULL;
+        RE_ATOMIC_STORE(&e->regex, NULL);
+        RE_ATOMIC_STORE(&e->hash, 0);
+        RE_ATOMIC_ADD(&e->refs, -RE_CACHE_LOCKED);
+    }
 
-// pop from stack
-#define POP()       sp--
+    RE_ATOMIC_ADD(&__re_cache_lock, -1);
+    RE_CACHE_ALLOCATOR_END();
+    return held;
+}
 
-// restore (unused)
-#define RESTORE()   sp = 0
 
-// the fast access
-#define SSTP        sstate[sp]
+int32_t regex_matchp(const struct small_regex * regx, const char* text)
+{
+    struct regex_match_ctx ctx;
 
+    // one stack for all starting offsets
+    regex_match_ctx_init(&ctx);
+    int32_t ret = regex_matchp_ctx(&ctx, regx, text);
+    regex_match_ctx_free(&ctx);
 
-/**
- * A structure for grouping instancing
- */
-struct re_pair_inst {
-    uint32_t trueoff;   // offset for eval true
-    uint32_t failoff;   // offset for eval false
-};
+    return ret;
+}
 
 
-/**
- * Compilation args
- */
-struct args_reg_compile {
-    struct re_pair_inst *inst;  // start end of groups (offsets)
-    uint32_t objs;          // amount of the objects
-    uint32_t strln;         // the length of the class length
-    uint32_t ecnt;          // the length og the inst
-    uint32_t stcnt;         // how large the sstate table may be in the worst case
-};
+void regex_match_ctx_init(struct regex_match_ctx * ctx)
+{
+    ASSERT_NULL_R(ctx, );
+
+    ctx->sstate = NULL;
+    ctx->stsize = 0;
+    ctx->allocs = 0;
+    ctx->dfa = NULL;
+    ctx->nodfa = 0;
+}
 
 
-#ifdef RE_BUILDWITH_DEBUG
-    static const char* typestr[] = {
-        FOREACH_GLOBAL_TYPE(GENERATE_VAL_STRINGS_VAL)
-    };
+void regex_match_ctx_free(struct regex_match_ctx * ctx)
+{
+    ASSERT_NULL_R(ctx, );
 
-    const char* typenames[] = {
-        FOREACH_GLOBAL_TYPE(GENERATE_VAR_NAMES_VAL)
-    };
-#endif
+    KFREE(ctx->sstate);
+    ctx->sstate = NULL;
+    ctx->stsize = 0;
 
-// Private function declarations:
-static int32_t matchpattern(struct small_regex * reg, struct regex_objs_t * pattern, const char* text);
-static int32_t matchcharclass(char c, const char* str);
-static int32_t matchone(struct small_regex * pattern, struct regex_objs_t p, char c);
-static int32_t matchdigit(char c);
-static int32_t matchalpha(char c);
-static int32_t matchwhitespace(char c);
-static int32_t matchmetachar(char c, const char* str);
-static int32_t matchrange(char c, const char* str);
-static int32_t ismetachar(char c);
-static int32_t __regex_compile_count(const char* pattern, struct args_reg_compile * args);
-static int32_t __check_state_size(uint32_t sp, uint32_t * reacnt, uint32_t default_dep, void ** ptr, size_t structsize, uint32_t max_reallocs);
+    __dfa_free(ctx->dfa);
+    ctx->dfa = NULL;
+}
 
-static int32_t __check_state_size(uint32_t sp, uint32_t * reacnt, uint32_t default_dep, void ** ptr, size_t structsize, uint32_t max_reallocs)
+
+int32_t regex_matchp_ctx(struct regex_match_ctx * ctx, const struct small_regex * regx, const char* text)
 {
-    // check if the stack pointer (SP) went out of range
-    if (( sp >= ( (*reacnt)*default_dep) ) && (max_reallocs != 0)) {
-        if  ( (*reacnt) >= max_reallocs) {
-            LOGERR("%s can't realloc because limit was reached max: %u\r\n", __FUNCTION__, max_reallocs);
-            return 1;
-        } else {
-            void * tmp =  KREALLOC((*ptr), (*reacnt) * default_dep * structsize);
-            if (tmp == NULL) {
-                LOGERR("%s realloc failed\r\n", __FUNCTION__);
-                // KFREE(stack);
-                return 1;
-            }
+    ASSERT_NULL_R(ctx, -1);
+    ASSERT_NULL_R(regx, -1);
+    ASSERT_NULL_R(text, -1);
 
-            DPROBE("reallocating: sp: %u reacnt:%u new size: %lu\r\n", sp, *reacnt, (*reacnt) * default_dep * structsize);
+    return __regex_search(ctx, regx, text, NULL, NULL);
+}
 
-            (*reacnt)++;
-            *ptr = tmp;
+
+int32_t regex_find(const struct small_regex * regx, const char* text, size_t len, int32_t * start, int32_t * end)
+{
+    struct regex_match_ctx ctx;
+
+    regex_match_ctx_init(&ctx);
+    int32_t ret = regex_find_ctx(&ctx, regx, text, len, start, end);
+    regex_match_ctx_free(&ctx);
+
+    return ret;
+}
+
+
+int32_t regex_find_ctx(struct regex_match_ctx * ctx, const struct small_regex * regx, const char* text, size_t len, int32_t * start, int32_t * end)
+{
+    ASSERT_NULL_R(ctx, -1);
+    ASSERT_NULL_R(regx, -1);
+
+    if ((text == NULL) && (len > 0)) {
+        return -1;
+    }
+    if (len > INT32_MAX) {
+        LOGERR("%s text too long: %lu\r\n", __FUNCTION__, (unsigned long) len);
+        return -1;
+    }
+
+    int32_t mend = 0;
+    int32_t ret = __regex_search(ctx, regx, (text != NULL) ? text : "", (text != NULL) ? text + len : NULL, &mend);
+
+    if (ret >= 0) {
+        if (start != NULL) {
+            *start = ret;
+        }
+        if (end != NULL) {
+            *end = mend;
         }
     }
-    return 0;
+    return ret;
 }
 
 
-// Public functions
-int32_t regex_validate(struct small_regex * regex)
+struct regex_set * regex_set_compile(const char** patterns, uint32_t count)
 {
-    ASSERT_NULL_R(regex, 1);
-    uint32_t i;
-    uint32_t count = COUNT_NODES(regex);
+    ASSERT_NULL_R(patterns, NULL);
 
-    //convert pattern
-    struct regex_objs_t * objs = SECTION_OBJECTS(regex);
+    if ((count == 0) || (count > RE_SET_MAX_PATTERNS)) {
+        LOGERR("%s wrong number of patterns: %u\r\n", __FUNCTION__, count);
+        return NULL;
+    }
 
-    for (i = 0; objs[i].type != UNUSED; ++i) {
-        if ((count != 0) && (i >= count)) {
-            LOGERR("regex_validator: reached end (count: %u) before the UNUSED node was reached\r\n", count);
-            return 1;
+    struct regex_set * set = (struct regex_set *) KMALLOC(1, sizeof(struct regex_set) + count * sizeof(struct small_regex *));
+    if (set == NULL) {
+        LOGERR("%s malloc failed\r\n", __FUNCTION__);
+        return NULL;
+    }
+
+    uint32_t positions = 0;
+    uint32_t k;
+
+    set->count = 0;
+    set->dfa = 1;
+    for (k = 0; k < count; k++) {
+        set->regs[k] = regex_compile(patterns[k]);
+        if (set->regs[k] == NULL) {
+            regex_set_free(set);
+            return NULL;
         }
+        set->count++;
 
-        if (objs[i].trueoffset >= count) {
-            LOGERR("regex_validator: true offset is out of bound has: %u max: %u\r\n", objs[i].trueoffset, count);
-            return 1;
-        } else if (objs[i].falseoffset >= count) {
-            LOGERR("regex_validator: false offset is out of bound has: %u max: %u\r\n", objs[i].falseoffset, count);
-            return 1;
+        // the nodes and the accepting position of the segment
+        positions += __dfa_nodes(set->regs[k]) + 1;
+        if (set->regs[k]->dfa == 0) {
+            set->dfa = 0;
         }
     }
-    return 0;
+
+    if (positions > RE_DFA_MAX_POS) {
+        set->dfa = 0;
+    }
+    return set;
 }
 
 
-void regex_free(struct small_regex * regex)
+void regex_set_free(struct regex_set * set)
 {
-    KFREE(regex);
+    uint32_t k;
+
+    if (set != NULL) {
+        for (k = 0; k < set->count; k++) {
+            regex_free(set->regs[k]);
+        }
+        KFREE(set);
+    }
 }
 
 
-int32_t regex_match(const char* pattern, const char* text)
+int32_t regex_set_find(const struct regex_set * set, const char* text, size_t len, int32_t * start, int32_t * end, int32_t * which)
 {
-    int32_t ret = -1;
-    struct small_regex * reg = regex_compile(pattern);
-    if (!reg) {
-        LOGERR("failed at %s:%u\r\n", __FUNCTION__, __LINE__);
-    } else {
-        ret = regex_matchp(reg, text);
-        KFREE(reg);
-    }
+    struct regex_match_ctx ctx;
+
+    regex_match_ctx_init(&ctx);
+    int32_t ret = regex_set_find_ctx(&ctx, set, text, len, start, end, which);
+    regex_match_ctx_free(&ctx);
+
     return ret;
 }
 
 
-int32_t regex_matchp(struct small_regex * regx, const char* text)
+int32_t regex_set_find_ctx(struct regex_match_ctx * ctx, const struct regex_set * set, const char* text, size_t len, int32_t * start, int32_t * end, int32_t * which)
 {
-    ASSERT_NULL_R(regx, -1);
-    ASSERT_NULL_R(text, -1);
+    ASSERT_NULL_R(ctx, -1);
+    ASSERT_NULL_R(set, -1);
+
+    if ((text == NULL) && (len > 0)) {
+        return -1;
+    }
+    if (len > INT32_MAX) {
+        LOGERR("%s text too long: %lu\r\n", __FUNCTION__, (unsigned long) len);
+        return -1;
+    }
 
-    struct regex_objs_t * objs = SECTION_OBJECTS(regx);
-    int idx = -1;
+    const char * textend = (text != NULL) ? text + len : NULL;
+    int32_t best = -1;
+    int32_t bestend = 0;
+    int32_t bestk = -1;
+    uint32_t k;
+
+    if (text == NULL) {
+        text = "";
+    }
 
-    if (objs[0].type == BEGIN) {
-        // starts from begin ^
-        return ( (matchpattern(regx, objs, text)) ? 0 : -1 );
+    if ((set->dfa == 1) && (ctx->nodfa == 0) && (__dfa_prepare(ctx, (const struct small_regex * const *) set->regs, set->count) == 0)) {
+        // one pass for all patterns
+        best = __dfa_search(ctx->dfa, (set->count == 1) ? set->regs[0] : NULL, text, textend, &bestend, &bestk);
     } else {
-        do {
-            idx += 1;
-            if (matchpattern(regx, objs, text)) {
-                return idx;
+        // one pass for each pattern
+        for (k = 0; (k < set->count) && (best != 0); k++) {
+            int32_t mend = 0;
+            int32_t ret = __regex_search(ctx, set->regs[k], text, textend, &mend);
+
+            if ((ret >= 0) && ((best < 0) || (ret < best))) {
+                best = ret;
+                bestend = mend;
+                bestk = (int32_t) k;
             }
-        } while (*text++ != '\0');
+        }
+    }
+
+    if (best >= 0) {
+        if (start != NULL) {
+            *start = best;
+        }
+        if (end != NULL) {
+            *end = bestend;
+        }
+        if (which != NULL) {
+            *which = bestk;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * __regex_search
+ *  searches text up to textend, or up to '\0' if textend is NULL
+ *  mend: if not NULL, gets the end of the match
+ *  returns: the start of the match or -1
+ */
+static int32_t __regex_search(struct regex_match_ctx * ctx, const struct small_regex * regx, const char * text, const char * textend, int32_t * mend)
+{
+    if ((regx->dfa == 1) && (ctx->nodfa == 0)) {
+        // linear time, the stack is not used
+        int32_t ret = __dfa_match(ctx, regx, text, textend, mend);
+        if (ret != -2) {
+            return ret;
+        }
+        // out of memory: fall back to the NFA matcher
+    }
 
+    // the NFA of the regex, reserved once for all starting offsets
+    if (__ctx_reserve(ctx, regx->pstsize) != 0) {
         return -1;
     }
+
+    return __nfa_search(ctx, regx, text, textend, mend);
 }
 
 
@@ -299,7 +2198,6 @@ static int32_t __regex_compile_count(const char* pattern, struct args_reg_compil
     uint32_t realcnt = 1;   // reallocations
 
     args->ecnt++;
-    args->stcnt = 1;
 
 
     while (pattern[i] != '\0') {
@@ -318,9 +2216,6 @@ static int32_t __regex_compile_count(const char* pattern, struct args_reg_compil
             }
 
             i++;
-        } else if ( (c == '*') || (c == '+') ) {
-            // trying to predict how large the stack will be required
-            args->stcnt++;
         } else if (c == '(') {
             brcnt++;
             args->inst[args->ecnt].trueoff = args->objs;
@@ -375,10 +2270,6 @@ static int32_t __regex_compile_count(const char* pattern, struct args_reg_compil
         return 1;
     }
 
-    if (args->stcnt >= DEFAULT_STATES_DEP * MAX_STATE_REALLOCS) {
-        LOGERR("it seems that in the worst case there will be required more states than it can handle max: %lu have: %d\r\n", DEFAULT_STATES_DEP * MAX_STATE_REALLOCS, args->stcnt);
-    }
-
     // 'UNUSED' is a sentinel used to indicate end-of-pattern
     args->objs++;
 
@@ -409,7 +2300,7 @@ struct small_regex * regex_compile(const char* pattern)
     }
 
     // calculating the length
-    struct args_reg_compile args = {inst, 0,0,0,0};
+    struct args_reg_compile args = {inst, 0,0,0};
 
     if (__regex_compile_count(pattern, &args) != 0) {
         // leave
@@ -428,7 +2319,7 @@ struct small_regex * regex_compile(const char* pattern)
 
     // setting the fields
     re_compiled->objoffset = args.strln;
-    re_compiled->pstsize = args.stcnt;
+    re_compiled->pstsize = RE_NFA_ENTRIES(args.objs);
     re_compiled->totalsize = (uint32_t)(totallen - sizeof(struct small_regex));
 
     DPROBE("objs: %u pstsize: %u total data len: %u\r\n", re_compiled->objoffset, re_compiled->pstsize, re_compiled->totalsize);
@@ -682,6 +2573,9 @@ struct small_regex * regex_compile(const char* pattern)
     // move next, j now indicates the amount of the recs from 0..j-1
     j++;
 
+    __regex_compile_prefix(re_compiled);
+    __regex_compile_dfa(re_compiled);
+
     KFREE(inst);
     return re_compiled;
 
@@ -692,14 +2586,14 @@ re_temp_error:
 }
 
 
-uint32_t regex_get_size(struct small_regex * regex)
+uint32_t regex_get_size(const struct small_regex * regex)
 {
     return (regex? regex->totalsize : 0);
 }
 
 
 #ifdef RE_BUILDWITH_DEBUG
-void regex_print(struct small_regex * pattern)
+void regex_print(const struct small_regex * pattern)
 {
     ASSERT_NULL_R(pattern, );
 
@@ -707,7 +2601,7 @@ void regex_print(struct small_regex * pattern)
     uint32_t count = COUNT_NODES(pattern);
 
     //convert pattern
-    struct regex_objs_t * objs = SECTION_OBJECTS(pattern);
+    const struct regex_objs_t * objs = SECTION_OBJECTS(pattern);
 
     for (i = 0; objs[i].type != UNUSED; ++i) {
         if ((count != 0) && (i >= count)) {
@@ -745,7 +2639,7 @@ void regex_trace(small_regex_t * pattern)
     uint32_t count = COUNT_NODES(pattern);
 
     //convert pattern
-    struct regex_objs_t * objs = SECTION_OBJECTS(pattern);
+    const struct regex_objs_t * objs = SECTION_OBJECTS(pattern);
     uint32_t i = 0;
 
     for ( i = 0; objs[i].type != UNUSED; ++i) {
@@ -769,31 +2663,6 @@ void regex_trace(small_regex_t * pattern)
     return;
 }
 
-
-void regex_printstrlegend(void)
-{
-    printf(DCOLOR_RED"RED - st0"DCOLOR_RESET" / "DCOLOR_GREEN"GREEN - matchcnt"DCOLOR_RESET" / "DCOLOR_BLUE" BLUE - < st"DCOLOR_RESET" / "DCOLOR_YELLOW" YELLOW - =st"DCOLOR_RESET " / WHITE - rest\r\n");
-}
-
-
-void regex_printstr(const char * text, size_t textlen, struct sstate * sstate)
-{
-    for (size_t i = 0; i<textlen; i++) {
-        if (i == sstate->st0) {
-            printf(DCOLOR_RED"%c"DCOLOR_RESET, text[i]);
-        } else if ( ((sstate->st - sstate->matchcnt) < i) && (i < sstate->st) && (sstate->matchcnt != 0) ) {
-            printf(DCOLOR_GREEN"%c"DCOLOR_RESET, text[i]);
-        } else if ( (i != sstate->st0) && (i < sstate->st)) {
-            printf(DCOLOR_BLUE"%c"DCOLOR_RESET, text[i]);
-        } else if (i == sstate->st) {
-            printf(DCOLOR_YELLOW"%c"DCOLOR_RESET, text[i]);
-        } else {
-            printf("%c", text[i]);
-        }
-    }
-    printf("\r\n");
-}
-
 #endif
 
 
@@ -872,6 +2741,11 @@ static int32_t matchmetachar(char c, const char* str)
 
 static int32_t matchcharclass(char c, const char* str)
 {
+    if (c == '\0') {
+        // the terminating null of str is not a member
+        return 0;
+    }
+
     do {
         if (matchrange(c, str)) {
             return 1;
@@ -897,7 +2771,7 @@ static int32_t matchcharclass(char c, const char* str)
 }
 
 
-static int32_t matchone(struct small_regex * pattern, struct regex_objs_t p, char c)
+static int32_t matchone(const struct small_regex * pattern, struct regex_objs_t p, char c)
 {
     switch (p.type) {
     case DOT:
@@ -943,215 +2817,3 @@ static int32_t matchone(struct small_regex * pattern, struct regex_objs_t p, cha
     // SHOULD NOT REACH THIS POINT
     return  (p.ch == c);
 }
-
-
-static int32_t matchpattern(struct small_regex * reg, struct regex_objs_t * pattern, const char* text)
-{
-    uint32_t stackrealcnt = 1;
-
-    if (reg->pstsize == 0) {
-        reg->pstsize = DEFAULT_STATES_DEP;
-    }
-
-    struct sstate * sstate = (struct sstate *) KMALLOC(reg->pstsize, sizeof(struct sstate));
-
-    if (sstate == NULL) {
-        LOGERR("%s malloc failed\r\n", __FUNCTION__);
-        return 0;
-    }
-
-#ifdef RE_BUILDWITH_DEBUG
-    size_t textlen = strlen(text);  // length of the string
-#endif
-
-    uint32_t sp = 0;                // sstate pointer
-    int32_t evalres = 0;            // evaluation result accomulator
-    int32_t evalres0 = 0;           // evaluation result accomulator
-    int32_t brtxcoff = 0;           // used for group+branch
-
-    // reset first intance
-    memset(&SSTP, 0, sizeof(struct sstate));
-    SSTP.st0 = -1;
-
-    // print legend if compiled with the debug
-    regex_printstrlegend();
-
-    for (;;) {
-        regex_printstr(text, textlen, &SSTP);
-
-        switch (pattern[SSTP.offset].type) {
-        case BEGIN:
-            DPROBE("BEGIN\r\n");
-            SSTP.offset = pattern[SSTP.offset].trueoffset;
-            break;
-
-        case UNUSED:
-        case END:
-            if ( (evalres == 0) && (sp > 0)) {
-                POP();
-                DPROBE("returning to [%.4d](%s) sp:%d st:%d st0:%d text[st]:%c\r\n", SSTP.offset, typenames[pattern[SSTP.offset].type], sp, SSTP.st, SSTP.st0, text[SSTP.st]);
-            } else {
-                DPROBE("EXIT\r\n");
-                if (pattern[SSTP.offset].type == END) {
-                    uint32_t est = SSTP.st;
-                    KFREE(sstate);
-                    return (text[est] == '\0') ? evalres : 0;
-                } else {
-                    KFREE(sstate);
-                    return evalres;
-                }
-            }
-            break;
-
-        case QUESTIONMARK:
-            SSTP.offset = pattern[SSTP.offset].trueoffset;
-            evalres = 1; // anyway it is true
-            SSTP.matchcnt = 0;
-            break;
-
-        case STAR:
-        case PLUS:
-            {
-                if ( evalres == 1 ) {
-                    // increent counter
-                    SSTP.matchcnt++;
-                }
-
-                if ( ( evalres == 1 ) && (text[SSTP.st] != '\0') ) {
-                    int32_t offset0 = SSTP.offset + 1;
-                    SSTP.offset = pattern[SSTP.offset].trueoffset;
-
-                    // check further if it matches the next char
-                    if ( ( (pattern[offset0].type != END) && (pattern[offset0].type != UNUSED)) && (pattern[offset0].type != BRANCH) && (SSTP.st0 != SSTP.st) ) {
-                        DPROBE("PROBING FORWARD: offset0: %d text: %c st: %d\r\n", offset0, text[SSTP.st], SSTP.st);
-
-                        // check next character in order to see how likely the + or * should be left
-                        int32_t tr = matchone(reg, pattern[offset0], text[SSTP.st]);
-
-                        switch (tr) {
-                        case -1: //unknown operation
-                        case 1:
-                            DPROBE("PROBING FORWARD: SUCCESS\r\n");
-
-                            // store where we was before the push
-                            SSTP.st0 = SSTP.st;
-
-                            DPROBE("PUSH from [%.4d](%s) sp:%d st:%d st0:%d text[st]:%c\r\n", SSTP.offset, typenames[pattern[SSTP.offset].type], sp, SSTP.st, SSTP.st0, text[SSTP.st]);
-
-                            // push to the stack
-                            PUSH();
-
-                            // check if stack requires to be extended
-                            if (__check_state_size(sp, &stackrealcnt, DEFAULT_STATES_DEP, (void*)&sstate, sizeof(struct sstate), MAX_STATE_REALLOCS) == 1) {
-                                goto somethingwentwrong;
-                            }
-
-                            // reset new instance
-                            // SSTP.offset = offset0;
-                            SSTP.st0 = -1;
-
-                            SSTP.offset = pattern[offset0].trueoffset;
-                            SSTP.st++;// increment current section match
-
-                            DPROBE("PUSH to [%.4d](%s) sp:%d st:%d st0:%d text[st]:%c\r\n", SSTP.offset, typenames[pattern[SSTP.offset].type], sp, SSTP.st, SSTP.st0, text[SSTP.st]);
-                            break;
-                        case 0:
-                            break;
-                        }
-                    }
-                } else {
-                    if ( pattern[SSTP.offset].type == PLUS ) {
-                        if (SSTP.matchcnt > 0) {
-                            // SSTP.txshift++;
-                            evalres = 1;
-                        } else {
-                            evalres = 0;
-                        }
-                    } else if (pattern[SSTP.offset].type == STAR) {
-                        evalres = 1;
-                    }
-
-                    if (evalres == 1) {
-                        SSTP.offset++;
-                    } else {
-                        SSTP.offset = pattern[SSTP.offset].falseoffset;
-                    }
-
-                    SSTP.matchcnt = 0;
-                }
-            }
-            break;
-
-        case GROUPSTART: // entering group
-            DPROBE("ENTERING GROUP from [%.4d](%s) ", SSTP.offset, typenames[pattern[SSTP.offset].type]);
-
-            SSTP.offset++;
-            brtxcoff = SSTP.st; // reset current offset
-
-            DPROBE("nextoffset [%.4d](%s) st: %d brtxcoff: %d\r\n", SSTP.offset, typenames[pattern[SSTP.offset].type], SSTP.st, brtxcoff);
-            break;
-
-        case GROUPEND: // leaving group T: next F: EXIT or next GROUPEND/BRANCH
-            DPROBE("LEAVING GROUP from [%.4d](%s) ", SSTP.offset, typenames[pattern[SSTP.offset].type]);
-            if (evalres == 0) {
-                // restore the st
-                SSTP.st = brtxcoff;
-                SSTP.offset = pattern[SSTP.offset].falseoffset;
-            } else {
-                SSTP.offset = pattern[SSTP.offset].trueoffset;
-                brtxcoff = 0; // reset current offset
-            }
-            DPROBE("nextoffset [%.4d](%s) st: %d brtxcoff: %d\r\n", SSTP.offset, typenames[pattern[SSTP.offset].type], SSTP.st, brtxcoff);
-            break;
-
-        case BRANCH: // BRANCHING
-            {
-                DPROBE("BRANCHING from [%.4d](%s) ", SSTP.offset, typenames[pattern[SSTP.offset].type]);
-                if (evalres == 0) {
-                    // restore the st
-                    SSTP.st = brtxcoff;
-                    SSTP.offset = pattern[SSTP.offset].falseoffset;
-                } else {
-                    SSTP.offset = pattern[SSTP.offset].trueoffset;
-                    brtxcoff = 0; // reset current offset
-                }
-
-                DPROBE("nextoffset [%.4d](%s) st: %d brtxcoff: %d\r\n", SSTP.offset, typenames[pattern[SSTP.offset].type], SSTP.st, brtxcoff);
-            }
-            break;
-
-        default:
-            // call handler
-            if ( /*(evalres == 0) &&*/ (text[SSTP.st] == '\0') ) {
-                SSTP.offset = pattern[SSTP.offset].falseoffset;
-                evalres = 0;
-                continue;
-            }
-
-            // store previous sstate of operation evaluation
-            evalres0 = evalres;
-            evalres = matchone(reg, pattern[SSTP.offset], text[SSTP.st]);
-
-            switch (evalres) {
-            case 1:
-                SSTP.offset = pattern[SSTP.offset].trueoffset;
-                SSTP.st++;// increment current section match
-                break;
-
-            case 0:
-                SSTP.offset = pattern[SSTP.offset].falseoffset;
-                break;
-
-            default:
-            case -1: // unknown operation
-                evalres = evalres0;
-                break;
-            }
-            break;
-        }
-    } // while
-
-somethingwentwrong:
-    KFREE(sstate);
-    return 0;
-}
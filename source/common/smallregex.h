@@ -35,7 +35,8 @@
  *   '$'        End anchor, matches end of string
  *   '*'        Asterisk, match zero or more (greedy)
  *   '+'        Plus, match one or more (greedy)
- *   '?'        Question, match zero or one (non-greedy)
+ *   '?'        Question, match zero or one (greedy)
+ *   '*?' '+?' '??' The same but lazy, match as few as possible
  *   '[abc]'    Character class, match if one of {'a', 'b', 'c'}
  *   '[^abc]'   Inverted class, match if NOT one of {'a', 'b', 'c'} -- NOTE: feature is currently broken!
  *   '[a-zA-Z]' Character ranges, the character set of the ranges { a-z | A-Z }
@@ -72,7 +73,6 @@ extern "C"
  * #define RE_BUILDWITH_DEBUG
  * #define RE_BUILDWITH_PROBES
  * #define BUILD_WITH_ERRORMSG
- * #define RE_BUILDWITH_TRACEMATCH_PROC
  */
 
 // exporting
@@ -91,13 +91,28 @@ extern "C"
 #endif
 
 #ifndef DEFAULT_STATES_DEP
-    // the initial stack length
+    // the initial length of the NFA in the match ctx, grows x2 (16 bytes per entry)
     #define DEFAULT_STATES_DEP     40UL
 #endif
 
-#ifndef MAX_STATE_REALLOCS
-    // maximum stack depth i.e 10 will be 10*DEFAULT_STACK_DEP(40)*sizeof(struct stack i.e 16) = 6.4kB
-    #define MAX_STATE_REALLOCS     10UL
+#ifndef RE_PREFIX_MAX
+    // the longest leading literal stored by the compiler
+    #define RE_PREFIX_MAX          16UL
+#endif
+
+#ifndef RE_DFA_MAX_NODES
+    // the longest program (single character nodes) run by the lazy DFA, up to 32
+    #define RE_DFA_MAX_NODES       32UL
+#endif
+
+#ifndef RE_DFA_MAX_STATES
+    // the DFA cache is flushed when it holds that many states
+    #define RE_DFA_MAX_STATES      128UL
+#endif
+
+#ifndef RE_SET_MAX_PATTERNS
+    // the most patterns in a regex_set, up to 32
+    #define RE_SET_MAX_PATTERNS    32UL
 #endif
 
 
@@ -117,18 +132,25 @@ typedef struct regex_objs_t {
 
 /*
  * struct small_regex
- * An instance of the compiled regex
+ * An instance of the compiled regex. It is not changed after regex_compile (the
+ *  matchers take it const, all match state is in struct regex_match_ctx), so one
+ *  compiled regex can be used by many threads at once, one context per thread.
  */
 typedef struct small_regex {
     uint32_t objoffset;     // indicates the start of the regex objs
     uint32_t totalsize;     // total size of data[]
-    uint32_t pstsize;       // predicted stack size
+    uint32_t pstsize;       // ctx entries used by the NFA matcher
+    uint32_t firstset[8];   // bytes a match can start with (if hasfirstset)
+    uint8_t hasfirstset;    // 1 if firstset is valid
+    uint8_t prefixlen;      // length of the leading literal, 0 if none
+    char prefix[RE_PREFIX_MAX]; // every match starts with it (not null terminated)
+    uint8_t dfa;            // 1 if the program runs on the lazy DFA
     uint8_t data[];         // data
 } small_regex_t;
 
 /* returns the pointer to the struct regex_objs_t instances */
 #define SECTION_OBJECTS(_pat_) \
-    (struct regex_objs_t *) &_pat_->data[_pat_->objoffset]
+    (const struct regex_objs_t *) &_pat_->data[_pat_->objoffset]
 
 /* pointer to the pattern from offset */
 #define OFFSET_TO_PATTERN(_pat_, _off_) \
@@ -141,6 +163,35 @@ typedef struct small_regex {
 #define RE_REGEX_SIZE(_pat_) \
     (sizeof(struct small_regex) + _pat_->totalsize)
 
+struct sstate;
+struct re_dfa;
+
+/*
+ * struct regex_match_ctx
+ *  Caller-owned match state: the NFA matcher and the lazy DFA cache.
+ *  Both are kept between the matches and only grow, so the steady state
+ *  does not allocate. Not thread safe: use one context per thread.
+ */
+typedef struct regex_match_ctx {
+    struct sstate * sstate; // NFA states and threads
+    uint32_t stsize;        // allocated sstate entries
+    uint32_t allocs;        // allocations done by this context (statistics)
+    struct re_dfa * dfa;    // lazy DFA of the last regex (NULL until used)
+    uint8_t nodfa;          // 1: always use the NFA matcher
+} regex_match_ctx_t;
+
+/*
+ * struct regex_set
+ *  Several compiled patterns searched together. When all of them are linear
+ *  and their nodes (plus one for each pattern) are at most 64, they run as
+ *  the segments of one lazy DFA: one left-to-right pass for all.
+ */
+typedef struct regex_set {
+    uint32_t count;         // patterns
+    uint8_t dfa;            // 1 if the patterns run on one lazy DFA
+    struct small_regex * regs[]; // the compiled patterns
+} regex_set_t;
+
 /*
  * regex_validate
  * Validates the offsets to avoid jump out of the scope.
@@ -149,7 +200,7 @@ typedef struct small_regex {
  * regex (struct small_regex*) a valid pointer to the compiled regex pattern
  * returns: 0 on success, 1 on error and LOGERR message
  */
-int32_t regex_validate(struct small_regex * regex);
+int32_t regex_validate(const struct small_regex * regex);
 
 /*
  * regex_free
@@ -167,6 +218,11 @@ void regex_free(struct small_regex * regex);
  * The returned result located in HEAP! use free();
  * The size of the data section is stored in the field totalsize.
  * But, the array can be readed until the instance of struct regex_objs_t field.type == UNUSED
+ * The leading literal (prefix) or the set of the first bytes is stored too,
+ *  regex_matchp skips to the candidate positions with it.
+ * Linear programs (single character nodes with * + ?, optional ^ and $) are
+ *  marked for the lazy DFA, the others run on the NFA matcher. Both are
+ *  O(n * m) at most and give the same matches.
  *
  * pattern (const char*) regex pattern (null terminated string)
  * returns: a valid pointer to the intance or NULL on fail
@@ -181,7 +237,7 @@ struct small_regex * regex_compile(const char* pattern);
  * regex (struct small_regex*) a valid pointer to the compiled regex pattern
  * returns: (uint32_t) totallen in bytes exc size of struct small_regex
  */
-uint32_t regex_get_size(struct small_regex * regex);
+uint32_t regex_get_size(const struct small_regex * regex);
 
 /* regex_matchp
  * Find matches of the compiled pattern inside text.
@@ -191,13 +247,180 @@ uint32_t regex_get_size(struct small_regex * regex);
  * returns: 0 or larger on success, -1 on error
  */
 
-int32_t regex_matchp(struct small_regex * pattern, const char* text);
+int32_t regex_matchp(const struct small_regex * pattern, const char* text);
+
+/* regex_match_ctx_init
+ * Initializes an empty context, nothing is allocated until the first match.
+ *
+ * ctx (struct regex_match_ctx*) a valid pointer to the context
+ * returns: void
+ */
+void regex_match_ctx_init(struct regex_match_ctx * ctx);
+
+/* regex_match_ctx_free
+ * Deallocates the NFA and the DFA cache of the context. The context can be used again.
+ *
+ * ctx (struct regex_match_ctx*) a valid pointer to the context
+ * returns: void
+ */
+void regex_match_ctx_free(struct regex_match_ctx * ctx);
+
+/* regex_matchp_ctx
+ * Same as regex_matchp, the NFA and the DFA cache are taken
+ *  from the ctx. The DFA is used when regex->dfa is set and ctx->nodfa is 0.
+ *
+ * ctx (struct regex_match_ctx*) a valid pointer to the initialized context
+ * regex (struct small_regex*) a valid pointer to the compiled regex pattern
+ * text (const char*) a text on which pattern is applied
+ * returns: 0 or larger on success, -1 on error
+ */
+int32_t regex_matchp_ctx(struct regex_match_ctx * ctx, const struct small_regex * pattern, const char* text);
+
+/* regex_find
+ * Find the first match of the compiled regex in text[0 ... len-1]. The text needs
+ *  no terminating null and '\0' is an ordinary byte, so a slice of a larger
+ *  buffer is searched in place. '$' matches at text + len.
+ *
+ * regex (struct small_regex*) a valid pointer to the compiled regex pattern
+ * text (const char*) the text, may be NULL if len is 0
+ * len (size_t) the length of the text
+ * start (int32_t*) if not NULL, gets the offset of the match
+ * end (int32_t*) if not NULL, gets the offset after the match at start: the
+ *  match a backtracker finds first there, both engines give the same span.
+ *  Greedy quantifiers take as much as they can and lazy ones as little: a.*b
+ *  on "aXbYb" is [0, 5), a.*?b is [0, 3), a|ab on "ab" is [0, 1). The DFA only
+ *  runs the linear programs (no '|' nor lazy quantifier), there it is the
+ *  longest match at start.
+ * returns: the start of the match (0 or larger) on success, -1 on error
+ */
+int32_t regex_find(const struct small_regex * regex, const char* text, size_t len, int32_t * start, int32_t * end);
+
+/* regex_find_ctx
+ * Same as regex_find, the NFA and the DFA cache are taken from the ctx.
+ *
+ * ctx (struct regex_match_ctx*) a valid pointer to the initialized context
+ * returns: the start of the match (0 or larger) on success, -1 on error
+ */
+int32_t regex_find_ctx(struct regex_match_ctx * ctx, const struct small_regex * regex, const char* text, size_t len, int32_t * start, int32_t * end);
+
+/* regex_set_compile
+ * Compiles count patterns (1 ... RE_SET_MAX_PATTERNS) into one set.
+ *
+ * patterns (const char**) the regex patterns (null terminated strings)
+ * count (uint32_t) number of the patterns
+ * returns: a valid pointer to the set or NULL on fail, use regex_set_free()
+ */
+struct regex_set * regex_set_compile(const char** patterns, uint32_t count);
+
+/* regex_set_free
+ * Deallocates the set and its compiled patterns
+ *
+ * set (struct regex_set*) a valid pointer to the set
+ * returns: void
+ */
+void regex_set_free(struct regex_set * set);
+
+/* regex_set_find
+ * Find the leftmost match of any pattern of the set in text[0 ... len-1] (same
+ *  rules as regex_find). At the same start the pattern added first wins, the
+ *  end is the one regex_find gives for that pattern. A
+ *  tokenizer calls it again from the end of the match: the text is scanned
+ *  once for all patterns (set->dfa), or once for each pattern if not.
+ *
+ * set (struct regex_set*) a valid pointer to the set
+ * text (const char*) the text, may be NULL if len is 0
+ * len (size_t) the length of the text
+ * start (int32_t*) if not NULL, gets the offset of the match
+ * end (int32_t*) if not NULL, gets the offset after the match
+ * which (int32_t*) if not NULL, gets the index of the pattern which matched
+ * returns: the start of the match (0 or larger) on success, -1 on error
+ */
+int32_t regex_set_find(const struct regex_set * set, const char* text, size_t len, int32_t * start, int32_t * end, int32_t * which);
+
+/* regex_set_find_ctx
+ * Same as regex_set_find, the NFA and the DFA cache are taken from the ctx.
+ *
+ * ctx (struct regex_match_ctx*) a valid pointer to the initialized context
+ * returns: the start of the match (0 or larger) on success, -1 on error
+ */
+int32_t regex_set_find_ctx(struct regex_match_ctx * ctx, const struct regex_set * set, const char* text, size_t len, int32_t * start, int32_t * end, int32_t * which);
+
+#ifndef _KERNEL
+/* memory functions used instead of calloc/realloc/free, see regex_set_allocator() */
+struct regex_allocator {
+    void * udata;
+    void * (*alloc)(void * udata, size_t size);
+    void * (*realloc)(void * udata, void * ptr, size_t size);
+    void (*free)(void * udata, void * ptr);
+};
+
+/* regex_set_allocator
+ * Sets the allocator of the calling thread: regex_compile, regex_set_compile
+ *  and the match contexts allocate from it (and must be freed under it).
+ *  The pattern cache always uses calloc/free. The allocator must stay valid
+ *  while its memory is in use.
+ *
+ * allocator (const struct regex_allocator*) the allocator, NULL for calloc/realloc/free
+ * returns: the previous allocator (NULL for the default)
+ */
+const struct regex_allocator * regex_set_allocator(const struct regex_allocator * allocator);
+#endif
 
 /* regex_match
- * Find matches of the txt pattern inside text (will compile automatically first).
+ * Find matches of the txt pattern inside text. The pattern is compiled once
+ *  and kept in the pattern cache (regex_cache_get).
  */
 int32_t regex_match(const char* pattern, const char* text);
 
+/* entries in the process-wide pattern cache */
+#ifndef RE_CACHE_SIZE
+    #define RE_CACHE_SIZE 64UL
+#endif
+
+/* counters of the pattern cache, see regex_cache_get_stats() */
+struct regex_cache_stats {
+    uint64_t hits;          // regex_cache_get found the pattern
+    uint64_t misses;        // regex_cache_get compiled the pattern
+    uint64_t evictions;     // least recently used patterns dropped for new ones
+    uint32_t entries;       // patterns in the cache now
+    uint32_t capacity;      // RE_CACHE_SIZE
+};
+
+/* regex_cache_get
+ * Returns the compiled pattern from the process-wide cache, compiling and
+ *  adding it on a miss. A hit takes no lock. The result is shared between
+ *  all callers and threads (it is const) and stays valid until
+ *  regex_cache_put(). When the cache is full the least recently used
+ *  pattern which nobody holds is dropped.
+ *
+ * pattern (const char*) the regex pattern (null terminated string)
+ * returns: the compiled pattern or NULL on fail, use regex_cache_put()
+ */
+const struct small_regex * regex_cache_get(const char* pattern);
+
+/* regex_cache_put
+ * Releases a pattern returned by regex_cache_get().
+ *
+ * regex (const struct small_regex*) the pattern from regex_cache_get()
+ * returns: void
+ */
+void regex_cache_put(const struct small_regex * regex);
+
+/* regex_cache_get_stats
+ * Reads the counters of the pattern cache.
+ *
+ * stats (struct regex_cache_stats*) gets the counters
+ * returns: void
+ */
+void regex_cache_get_stats(struct regex_cache_stats * stats);
+
+/* regex_cache_clear
+ * Frees every cached pattern which is not held by a caller (i.e. before exit).
+ *
+ * returns: number of the patterns which are still held
+ */
+uint32_t regex_cache_clear(void);
+
 
 #ifndef BUILD_WITH_ERRORMSG
     #define LOGERR(...)
@@ -226,24 +449,12 @@ int32_t regex_match(const char* pattern, const char* text);
         #define DPROBE(...)
     #endif
 
-    struct state;
-
     void regex_trace(struct small_regex * pattern);
-    void regex_print(struct small_regex * pattern);
-
-    #ifdef RE_BUILDWITH_TRACEMATCH_PROC
-        void regex_printstrlegend(void);
-        void regex_printstr(const char * text, size_t textlen, struct state * state);
-    #else
-        #define regex_printstr(...)
-        #define regex_printstrlegend(...)
-    #endif
+    void regex_print(const struct small_regex * pattern);
 
 #else
     #define regex_trace(...)
     #define regex_print(...)
-    #define regex_printstr(...)
-    #define regex_printstrlegend(...)
     #define DPROBE(...)
 #endif
 
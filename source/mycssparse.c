@@ -20,13 +20,84 @@
  *
  *    2) 解析字符串输入, 输出结果到终端
  *      $ mycssparse ".polygon { border: 3px solid #ff00ff; fill: 0.5 solid #00f0f0 }"
+ *
+ *    3) 重复解析输入文件 ROUNDS 次, 输出耗时
+ *      $ mycssparse -b 1000 file:///path/to/input1.css
+ *
+ *    4) 指定结构字符扫描方式 (auto, scalar, sse2, avx2)
+ *      $ mycssparse -s scalar file:///path/to/input1.css
+ *
+ *    5) 只读解析 (不复制, 不改写输入)
+ *      $ mycssparse -p buffer file:///path/to/input1.css
+ *
+ *    6) 映射 (mmap) 输入文件并只读解析
+ *      $ mycssparse -p mmap file:///path/to/input1.css
+ *
+ *    7) 从标准输入流式解析, 每个规则闭合时立即输出
+ *      $ cat input1.css | mycssparse -c 4096 stdin://
+ *
+ *    8) SAX 回调解析 (不生成 key 数组), 可以和 -b 一起使用
+ *      $ mycssparse -p sax file:///path/to/input1.css
+ *
+ *    9) 多线程只读解析 (结果与 -p buffer 相同), 可以和 -b 一起使用
+ *      $ mycssparse -t 8 -b 100 file:///path/to/input1.css
+ *
+ *   10) 用 N 个线程批量解析多个文件, 输出每个文件的耗时. -b ROUNDS 重复整批
+ *      $ mycssparse -j 4 file:///path/to/input1.css file:///path/to/input2.css ...
+ *
+ *   11) 用正则 PATTERN 查找输入文件中的全部匹配 ROUNDS 次, 输出每 MB 输入的内存分配次数
+ *      $ mycssparse -r "\\.[a-z]+" -b 100 file:///path/to/input1.css
+ *
+ *   12) 只用 NFA 匹配 PATTERN (不使用 DFA), 比较两种匹配方式的耗时
+ *      $ mycssparse -r "[a-z]+:" -e nfa -b 100 file:///path/to/input1.css
+ *
+ *   13) 多个 -r 组成一个 regex_set, 一遍扫描把输入文件切分成 token, 与每个正则各扫描一遍比较耗时
+ *      $ mycssparse -r "/\\*" -r "[{}]" -r "[a-z-]+:" -b 100 file:///path/to/input1.css
+ *
+ *   14) 把输入文件的每一行当作一个小样式表, 用 regex_match(PATTERN, line) 匹配 ROUNDS 次,
+ *       与每次调用都编译正则比较耗时, 并输出正则缓存的命中次数
+ *      $ mycssparse -r "[a-z-]+:" -e cache -b 100 file:///path/to/input1.css
+ *
+ *   15) 解析使用 bump arena 分配内存, 每轮解析之后一次 CssArenaReset() 全部释放
+ *      $ mycssparse -m arena -b 1000 file:///path/to/input1.css
+ *
+ *   16) 同一个 CssParser 反复 CssParserParse() 输入文件, 第一次之后不再分配内存
+ *      $ mycssparse -p reuse -b 1000 file:///path/to/input1.css
+ *
+ *   17) 把解析结果打包到一块连续内存, 复制映像后直接使用, 比较遍历打包前后 keys 的耗时
+ *      $ mycssparse -p pack -b 1000 file:///path/to/input1.css
+ *
+ *   18) 生成有 CLASSES 个 class 的样式表, CssKeyArrayQueryClass() 查询 LOOKUPS 次 (索引),
+ *       与逐个比较全部 key 的查找比较耗时 (10000 个 class 需要 make WIDE=1).
+ *       同时用 CssKeyArrayQueryClassNodes() 查询每次 64 个名称的组合查询
+ *      $ mycssparse -q 10000 -b 1000000
+ *
+ *   19) 生成有 IDS 个数字 id (#N) 的样式表, 比较 CssKeyArrayQueryId() 按整数查询和按名称查询的耗时
+ *      $ mycssparse -i 1000 -b 10000000
+ *
+ *   20) 比较按名称比较和按 atom switch 分派属性的耗时
+ *      $ mycssparse -p atom -b 1000 file:///path/to/input1.css
+ *
+ *   21) 生成 WORDS 个选择器中的词, 比较以前逐个 strncmp 和完美 hash 识别状态关键字的耗时
+ *      $ mycssparse -f 4096 -b 10000
+ *
+ *  Test:
+ *    比较各种解析和匹配方式结果的检查在 source/test/csstest.c
+ *      $ make test
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include <common/cssparse.h>
+#include <common/cssalloc.h>
+#include <common/cssatom.h>
+#include <common/cssscan.h>
+#include <common/cssparser.h>
+#include <common/cssbatch.h>
+#include <common/smallregex.h>
 
 
 void print_usage(const char *appfile)
@@ -50,10 +121,165 @@ void print_usage(const char *appfile)
     printf("  Usage:\n");
     printf("    $ %s input-css-file <output-css-file>\n", name);
     printf("    $ %s input-css-string <output-css-file>\n", name);
+    printf("    $ %s -b ROUNDS input-css-file\n", name);
+    printf("    $ cat input.css | %s stdin:// <output-css-file>\n", name);
+    printf("    $ %s -j N input-css-file1 input-css-file2 ...\n", name);
+    printf("    $ %s -r PATTERN -b ROUNDS input-css-file\n", name);
+    printf("    $ %s -r PATTERN1 -r PATTERN2 ... -b ROUNDS input-css-file\n", name);
+    printf("    $ %s -m arena -b ROUNDS input-css-file\n", name);
+    printf("    $ %s -q CLASSES -b LOOKUPS\n", name);
+    printf("    $ %s -i IDS -b LOOKUPS\n", name);
+    printf("    $ %s -f WORDS -b ROUNDS\n", name);
+    printf("  Options:\n");
+    printf("    -b ROUNDS   parse input file ROUNDS times and print timing\n");
+    printf("    -s LEVEL    structural scanner: auto, scalar, sse2, avx2\n");
+    printf("    -p MODE     parse mode: string (copy and parse in place), buffer (read-only, zero-copy),\n");
+    printf("                mmap (map input file read-only and parse the mapping),\n");
+    printf("                sax (callbacks from the tokenizer, no key array),\n");
+    printf("                reuse (-b only: CssParserParse with one CssParser for all rounds),\n");
+    printf("                pack (-b only: walk the keys before and after CssKeyArrayPack),\n");
+    printf("                atom (-b only: dispatch properties by name vs by atom)\n");
+    printf("    -q CLASSES  benchmark CssKeyArrayQueryClass on a generated sheet with CLASSES classes\n");
+    printf("    -i IDS      benchmark CssKeyArrayQueryId on generated sheets with IDS numeric ids\n");
+    printf("    -f WORDS    benchmark state keyword (CssBitFlag) recognition on WORDS generated selector words\n");
+    printf("    -m MEMORY   allocator for -b: malloc (default), arena (reset after each parse)\n");
+    printf("    -c CHUNK    chunk size in bytes for stdin:// streaming (default 4096)\n");
+    printf("    -t THREADS  parse with THREADS threads (read-only, same result as -p buffer)\n");
+    printf("    -j N        parse all input files with N worker threads and print per-file timing\n");
+    printf("    -r PATTERN  find all matches of the regex PATTERN in input file and print allocations per MB,\n");
+    printf("                repeat -r to split the input file into tokens with a regex_set (one pass)\n");
+    printf("    -e ENGINE   regex engine for -r: auto (DFA when supported), nfa,\n");
+    printf("                cache (regex_match every line: compile per call vs the pattern cache)\n");
     printf("\n");
 }
 
 
+// -p buffer: 使用 CssBufferParse() 只读解析
+// -p mmap: 输入文件使用 CssFileMapParse(), 输入字符串同 buffer
+// -p sax: 使用 CssBufferParseSax() 回调输出
+static int parse_readonly = 0;
+static int parse_mmap = 0;
+static int parse_sax = 0;
+
+// -p reuse: -b 的每轮使用同一个 CssParser 的 CssParserParse()
+static int parse_reuse = 0;
+
+// -p pack: -b 比较打包前后的遍历
+static int parse_pack = 0;
+static int parse_atom = 0;
+
+// -m arena: -b 的每轮解析从 arena 分配, 之后 CssArenaReset()
+static int parse_arena = 0;
+
+// -t THREADS: 大于 1 时使用 CssBufferParseParallel()
+static int parse_threads = 1;
+
+// -e auto|nfa|cache: 正则匹配方式
+static int regex_nfa = 0;
+static int regex_cache = 0;
+
+
+// SAX 输出: ".a hidden, .b {" 然后是属性
+typedef struct {
+    FILE *outfd;
+    int classes;
+} SaxPrintContext;
+
+
+static int sax_print_rule_begin(void *userData, CssKeyType classType, const char *className, int nameLen, int classFlags)
+{
+    SaxPrintContext *ctx = (SaxPrintContext *)userData;
+    char flags[CSS_KEYINDEX_INVALID_4096];
+
+    CssKeyFlagToString(classFlags, flags, sizeof(flags));
+    fprintf(ctx->outfd, "%s%.*s %s", ctx->classes++ ? ", " : "", nameLen, className, flags);
+    return 0;
+}
+
+
+static int sax_print_declaration(void *userData, const char *key, int keyLen, const char *value, int valueLen)
+{
+    SaxPrintContext *ctx = (SaxPrintContext *)userData;
+    if (ctx->classes) {
+        fprintf(ctx->outfd, "{\n");
+        ctx->classes = 0;
+    }
+    fprintf(ctx->outfd, "  %.*s: %.*s;\n", keyLen, key, valueLen, value);
+    return 0;
+}
+
+
+static int sax_print_rule_end(void *userData)
+{
+    SaxPrintContext *ctx = (SaxPrintContext *)userData;
+    fprintf(ctx->outfd, "%s}\n", ctx->classes ? "{\n" : "");
+    ctx->classes = 0;
+    return 0;
+}
+
+
+static void sax_print_buffer(const char *cssBuf, size_t cssLen, FILE *outfd)
+{
+    SaxPrintContext ctx = { outfd, 0 };
+    CssSaxHandler handler = { &ctx, sax_print_rule_begin, sax_print_declaration, sax_print_rule_end };
+
+    if (CssBufferParseSax(cssBuf, cssLen, &handler) < 0) {
+        printf("Error: CssBufferParseSax() failed\n");
+    }
+}
+
+
+// SAX 计数: 用于 -b 测试
+typedef struct {
+    int classes;
+    int declarations;
+    int rules;
+} SaxCountContext;
+
+
+static int sax_count_rule_begin(void *userData, CssKeyType classType, const char *className, int nameLen, int classFlags)
+{
+    ((SaxCountContext *)userData)->classes++;
+    return 0;
+}
+
+
+static int sax_count_declaration(void *userData, const char *key, int keyLen, const char *value, int valueLen)
+{
+    ((SaxCountContext *)userData)->declarations++;
+    return 0;
+}
+
+
+static int sax_count_rule_end(void *userData)
+{
+    ((SaxCountContext *)userData)->rules++;
+    return 0;
+}
+
+
+static CssKeyArray parse_cssstring(CssString cssString)
+{
+    if (parse_readonly) {
+        // keys 引用 cssString 的内容, 使用完 keys 才能释放 cssString
+        if (parse_threads > 1) {
+            return CssBufferParseParallel(cssString->sbbuf, cssString->sblen, parse_threads);
+        }
+        return CssBufferParse(cssString->sbbuf, cssString->sblen);
+    }
+    return CssStringParse(cssString);
+}
+
+
+static void free_cssstring(CssKeyArray keys, CssString cssString)
+{
+    CssKeyArrayFree(keys);
+    if (parse_readonly || !keys) {
+        CssStringFree(cssString);
+    }
+}
+
+
 int file_exists(const char* filename)
 {
     struct stat buffer;
@@ -65,20 +291,33 @@ void demo_cssparse_string(char* cssStr, FILE* outcssfile)
 {
     printf("parse css string:\n--------\n%s\n--------\n", cssStr);
 
+    if (parse_sax) {
+        sax_print_buffer(cssStr, strlen(cssStr), outcssfile);
+        return;
+    }
+
     CssString cssString = CssStringNew(cssStr, strlen(cssStr));
-    CssKeyArray keys = CssStringParse(cssString);
+    CssKeyArray keys = parse_cssstring(cssString);
     if (keys) {
         CssKeyArrayPrint(keys, outcssfile);
-        CssKeyArrayFree(keys);
-    }
-    else {
-        CssStringFree(cssString);
     }
+    free_cssstring(keys, cssString);
 }
 
 
 void demo_cssparse_file(const char *csspathfile, FILE *cssFileOut)
 {
+    if (parse_mmap) {
+        CssKeyArray keys = CssFileMapParse(csspathfile);
+        if (!keys) {
+            printf("Error: CssFileMapParse() failed. cssfile=%s\n", csspathfile);
+            exit(1);
+        }
+        CssKeyArrayPrint(keys, cssFileOut);
+        CssKeyArrayFree(keys);
+        return;
+    }
+
     FILE* cssfile = fopen(csspathfile, "r");
     if (cssfile) {
         CssString cssString = CssStringNewFromFile(cssfile);
@@ -89,31 +328,1168 @@ void demo_cssparse_file(const char *csspathfile, FILE *cssFileOut)
             exit(1);
         }
 
-        CssKeyArray keys = CssStringParse(cssString);
+        if (parse_sax) {
+            sax_print_buffer(cssString->sbbuf, cssString->sblen, cssFileOut);
+            CssStringFree(cssString);
+            return;
+        }
+
+        CssKeyArray keys = parse_cssstring(cssString);
         if (!keys) {
             printf("Error: CssStringParse() failed\n");
             CssStringFree(cssString);
             exit(1);
         }
 
-        CssKeyArrayPrint(keys, stdout);
+        CssKeyArrayPrint(keys, cssFileOut);
+
+        free_cssstring(keys, cssString);
+    }
+}
+
+
+static int stream_print_rule(const CssKeyArray ruleKeys, void *userData)
+{
+    CssKeyArrayPrint(ruleKeys, (FILE *)userData);
+    return 0;
+}
+
+
+void stream_cssparse_stdin(size_t chunkSize, FILE *cssFileOut)
+{
+    char *chunk = (char *) malloc(chunkSize);
+    if (!chunk) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+
+    CssParser parser = CssParserNew(0, stream_print_rule, cssFileOut);
+
+    size_t len;
+    while ((len = fread(chunk, 1, chunkSize, stdin)) > 0) {
+        if (CssParserFeed(parser, chunk, len) < 0) {
+            printf("Error: CssParserFeed() failed\n");
+            exit(1);
+        }
+    }
+    if (CssParserFinish(parser) < 0) {
+        printf("Error: CssParserFinish() failed\n");
+        exit(1);
+    }
+
+    CssParserFree(parser);
+    free(chunk);
+}
+
+
+static double elapsed_ms(const struct timespec *t0)
+{
+    struct timespec t1;
+    timespec_get(&t1, TIME_UTC);
+    return (t1.tv_sec - t0->tv_sec) * 1000.0 + (t1.tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+
+void bench_cssparse_file(const char *csspathfile, int rounds)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+
+    int numKeys = 0;
+    int sizeKeys = 0;
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+
+    if (parse_sax) {
+        SaxCountContext ctx;
+        CssSaxHandler handler = { &ctx, sax_count_rule_begin, sax_count_declaration, sax_count_rule_end };
+
+        for (int i = 0; i < rounds; i++) {
+            memset(&ctx, 0, sizeof(ctx));
+            if (CssBufferParseSax(source->sbbuf, source->sblen, &handler) < 0) {
+                printf("Error: CssBufferParseSax() failed\n");
+                exit(1);
+            }
+        }
+
+        double ms = elapsed_ms(&t0);
+        printf("%s: %u bytes, %d rules, %d classes, %d declarations, %d rounds: %.3f ms, %.3f us/parse, %.2f MB/s\n",
+            csspathfile, source->sblen, ctx.rules, ctx.classes, ctx.declarations, rounds, ms, ms * 1000.0 / rounds,
+            (double)source->sblen * rounds / (ms / 1000.0) / (1024.0 * 1024.0));
+        printf("key array: none\n");
+
+        CssStringFree(source);
+        return;
+    }
+
+    CssArena arena = parse_arena ? CssArenaNew(0, 0) : 0;
+    size_t arenaUsed = 0;
+
+    CssParser parser = parse_reuse ? CssParserNew(0, 0, 0) : 0;
+    size_t parserMemory = 0;
+
+    for (int i = 0; i < rounds; i++) {
+        CssKeyArray keys;
+        if (arena) {
+            CssSetAllocator(CssArenaGetAllocator(arena));
+        }
+        if (parser) {
+            // 结果属于 parser, 下一轮解析时回收
+            keys = CssParserParse(parser, source->sbbuf, source->sblen);
+        }
+        else if (parse_mmap) {
+            // 每轮都重新映射文件, 包含加载时间
+            keys = CssFileMapParse(csspathfile);
+        }
+        else if (parse_readonly) {
+            // 只读解析, 直接使用原始内容
+            keys = parse_cssstring(source);
+        }
+        else {
+            // 解析会改写输入, 每轮都从原始内容复制
+            keys = CssStringParse(CssStringNew(source->sbbuf, source->sblen));
+        }
+        if (!keys) {
+            printf("Error: CssStringParse() failed\n");
+            exit(1);
+        }
+        numKeys = CssKeyArrayGetUsed(keys);
+        sizeKeys = CssKeyArrayGetSize(keys);
+        if (arena) {
+            arenaUsed = CssArenaGetUsed(arena);
+        }
+        if (parser) {
+            if (i == 0) {
+                parserMemory = CssParserGetMemory(parser);
+            }
+            continue;
+        }
+        CssKeyArrayFree(keys);
+        if (arena) {
+            CssArenaReset(arena);
+            CssSetAllocator(0);
+        }
+    }
+
+    double ms = elapsed_ms(&t0);
+    printf("%s: %u bytes, %d keys, %d rounds: %.3f ms, %.3f us/parse, %.2f MB/s\n",
+        csspathfile, source->sblen, numKeys, rounds, ms, ms * 1000.0 / rounds,
+        (double)source->sblen * rounds / (ms / 1000.0) / (1024.0 * 1024.0));
+
+    // key 数组内存: 已用 / 已分配 (不含数组头)
+    printf("key array: %d bytes/key, used %d bytes, allocated %d bytes\n",
+        CSS_KEYFIELD_BYTES, numKeys * CSS_KEYFIELD_BYTES, sizeKeys * CSS_KEYFIELD_BYTES);
+
+    if (parser) {
+        printf("parser: %lu bytes reserved after the first parse, %lu bytes after %d parses\n",
+            (unsigned long)parserMemory, (unsigned long)CssParserGetMemory(parser), rounds);
+        CssParserFree(parser);
+    }
+
+    if (arena) {
+        printf("arena: %lu bytes/parse, %lu bytes reserved\n", (unsigned long)arenaUsed, (unsigned long)CssArenaGetReserved(arena));
+        CssArenaFree(arena);
+    }
+
+    CssStringFree(source);
+}
+
+
+// 遍历全部 key, 读取每个名称和值的字节
+static unsigned long walk_keys(const CssKeyArray keys)
+{
+    unsigned long sum = 0;
+    int offset, length;
+    int numKeys = CssKeyArrayGetUsed(keys);
+
+    for (int i = 0; i < numKeys; i++) {
+        const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+        length = CssKeyOffsetLength(node, &offset);
+        const char *str = CssKeyArrayGetString(keys, offset);
+        for (int k = 0; k < length; k++) {
+            sum = sum * 31 + (unsigned char)str[k];
+        }
+        sum += CssKeyGetFlag(node) + CssKeyGetType(node);
+    }
+    return sum;
+}
+
+
+// -p pack: 打包后复制映像到新的内存, 比较遍历打包前后 keys 的耗时
+void bench_pack_file(const char *csspathfile, int rounds)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+
+    CssKeyArray keys = CssStringParse(CssStringNew(source->sbbuf, source->sblen));
+    if (!keys) {
+        printf("Error: CssStringParse() failed\n");
+        exit(1);
+    }
+
+    struct timespec t0;
+    double packMs, keysMs, packedMs;
+    CssKeyArray packed = 0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        CssKeyArrayFree(packed);
+        packed = CssKeyArrayPack(keys);
+    }
+    packMs = elapsed_ms(&t0);
+
+    // 映像复制到别处 (相当于写入共享内存或者文件后读出)
+    size_t imageSize = 0;
+    const void *image = CssKeyArrayPackedImage(packed, &imageSize);
+    void *copy = malloc(imageSize);
+    memcpy(copy, image, imageSize);
+    CssKeyArray attached = CssKeyArrayAttachPacked(copy, imageSize);
+    if (!attached) {
+        printf("Error: CssKeyArrayAttachPacked() failed\n");
+        exit(1);
+    }
+
+    unsigned long sum = 0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        sum += walk_keys(keys);
+    }
+    keysMs = elapsed_ms(&t0);
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        sum += walk_keys(attached);
+    }
+    packedMs = elapsed_ms(&t0);
+
+    printf("%s: %u bytes, %d keys, %d rounds, packed image %lu bytes (checksum %lx)\n",
+        csspathfile, source->sblen, CssKeyArrayGetUsed(keys), rounds, (unsigned long)imageSize, sum);
+    printf("  pack:   %.3f us/pack\n", packMs * 1000.0 / rounds);
+    printf("  walk:   %.3f us (keys), %.3f us (copied image)\n",
+        keysMs * 1000.0 / rounds, packedMs * 1000.0 / rounds);
+
+    free(copy);
+    CssKeyArrayFree(packed);
+    CssKeyArrayFree(keys);
+    CssStringFree(source);
+}
+
+
+// 渲染时按属性名称分派: 按名称比较 (以前的做法) 和按 atom 的 switch
+static const char *dispatch_names[] = {
+    "border", "border-color", "border-style", "border-width",
+    "fill", "fill-color", "fill-opacity", "fill-style",
+    "stroke", "stroke-width", "opacity", "visibility"
+};
+
+#define DISPATCH_NAMES  ((int)(sizeof(dispatch_names) / sizeof(dispatch_names[0])))
+
+
+static int dispatch_by_name(const char *name, int len)
+{
+    for (int i = 0; i < DISPATCH_NAMES; i++) {
+        if ((int)strlen(dispatch_names[i]) == len && !strncmp(dispatch_names[i], name, len)) {
+            return i;
+        }
+    }
+    return DISPATCH_NAMES;
+}
+
+
+static int dispatch_by_atom(int atom)
+{
+    switch (atom) {
+    case css_atom_border:       return 0;
+    case css_atom_border_color: return 1;
+    case css_atom_border_style: return 2;
+    case css_atom_border_width: return 3;
+    case css_atom_fill:         return 4;
+    case css_atom_fill_color:   return 5;
+    case css_atom_fill_opacity: return 6;
+    case css_atom_fill_style:   return 7;
+    case css_atom_stroke:       return 8;
+    case css_atom_stroke_width: return 9;
+    case css_atom_opacity:      return 10;
+    case css_atom_visibility:   return 11;
+    default:                    return DISPATCH_NAMES;
+    }
+}
+
+
+// -p atom: 比较按名称和按 atom 两种分派的耗时
+void bench_atom_file(const char *csspathfile, int rounds)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+
+    CssKeyArray keys = CssStringParse(CssStringNew(source->sbbuf, source->sblen));
+    if (!keys) {
+        printf("Error: CssStringParse() failed\n");
+        exit(1);
+    }
+
+    int numKeys = CssKeyArrayGetUsed(keys);
+    int numProps = 0, numUnknown = 0;
+    int offset, length;
+
+    for (int i = 0; i < numKeys; i++) {
+        const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+        if (CssKeyGetType(node) == css_type_key) {
+            numProps++;
+            numUnknown += (CssKeyGetAtom(node) == css_atom_none);
+        }
+    }
+
+    long byName[DISPATCH_NAMES + 1] = { 0 }, byAtom[DISPATCH_NAMES + 1] = { 0 };
+    struct timespec t0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < numKeys; i++) {
+            const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+            if (CssKeyGetType(node) == css_type_key) {
+                length = CssKeyOffsetLength(node, &offset);
+                byName[dispatch_by_name(CssKeyArrayGetString(keys, offset), length)]++;
+            }
+        }
+    }
+    double nameMs = elapsed_ms(&t0);
+
+    timespec_get(&t0, TIME_UTC);
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < numKeys; i++) {
+            const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+            if (CssKeyGetType(node) == css_type_key) {
+                byAtom[dispatch_by_atom(CssKeyGetAtom(node))]++;
+            }
+        }
+    }
+    double atomMs = elapsed_ms(&t0);
+
+    printf("%s: %d keys, %d properties, %d without atom, %d atoms (%d known), %d rounds\n",
+        csspathfile, numKeys, numProps, numUnknown, CssAtomGetCount() - 1, css_atom_known_end - 1, rounds);
+    printf("  dispatch by name: %.3f us/round, %.2f ns/property\n", nameMs * 1000.0 / rounds, nameMs * 1e6 / rounds / (numProps ? numProps : 1));
+    printf("  dispatch by atom: %.3f us/round, %.2f ns/property\n", atomMs * 1000.0 / rounds, atomMs * 1e6 / rounds / (numProps ? numProps : 1));
+
+    CssKeyArrayFree(keys);
+    CssStringFree(source);
+}
+
+
+// 以前的 cssGetKeyBitFlag(): 逐个 strncmp, 长度 4 到 10 的前缀也匹配 ("hidd" 是 hidden)
+static const char *bitflag_names[] = {
+    "readonly", "hidden", "hilight", "pickup", "dragging", "deleting",
+    "fault", "flash", "zoomin", "zoomout", "panning", 0
+};
+
+static int bitflag_strncmp(const char *word, int len)
+{
+    if (len < 4 || len > 10) {
+        return css_bitflag_none;
+    }
+    for (int i = 0; bitflag_names[i] != 0; i++) {
+        if (!strncmp(bitflag_names[i], word, len)) {
+            return 1 << i;
+        }
+    }
+    return css_bitflag_none;
+}
+
+
+// -f WORDS: 选择器中 class 后面的词, 约一半是状态关键字, 1/16 是关键字的前缀, 其他是普通的词.
+//   每 8 个词一组 (空格分开), 比较以前的逐个 strncmp 和 CssKeyFlagFromString()
+void bench_bitflag(int words, int rounds)
+{
+    char (*list)[16] = malloc(sizeof(*list) * words);
+    unsigned int seed = 12345;
+    int numPrefix = 0;
+
+    for (int i = 0; i < words; i++) {
+        seed = seed * 1103515245 + 12345;
+        const char *name = bitflag_names[(seed >> 8) % 11];
+        switch ((seed >> 20) & 15) {
+        case 0:
+            // 前缀, 至少 4 个字符
+            snprintf(list[i], sizeof(list[i]), "%.*s", 4 + (int)((seed >> 4) % (strlen(name) - 4)), name);
+            numPrefix++;
+            break;
+        case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+            snprintf(list[i], sizeof(list[i]), "state%u", (seed >> 4) % 100);
+            break;
+        default:
+            snprintf(list[i], sizeof(list[i]), "%s", name);
+            break;
+        }
+    }
+
+    // 8 个词一组
+    int numGroups = words / 8 > 0 ? words / 8 : 1;
+    char (*groups)[8 * 16] = malloc(sizeof(*groups) * numGroups);
+    int *groupLens = (int *) malloc(sizeof(int) * numGroups);
+    for (int g = 0; g < numGroups; g++) {
+        int len = 0;
+        for (int k = 0; k < 8 && g * 8 + k < words; k++) {
+            len += sprintf(groups[g] + len, k ? " %s" : "%s", list[g * 8 + k]);
+        }
+        groupLens[g] = len;
+    }
+
+    struct timespec t0;
+    long sumOld = 0, sumNew = 0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int r = 0; r < rounds; r++) {
+        for (int g = 0; g < numGroups; g++) {
+            const char *p = groups[g];
+            const char *end = p + groupLens[g];
+            int flags = 0;
+            while (p < end) {
+                const char *q = p;
+                while (q < end && *q != ' ') {
+                    q++;
+                }
+                flags |= bitflag_strncmp(p, (int)(q - p));
+                p = q + 1;
+            }
+            sumOld += flags;
+        }
+    }
+    double oldMs = elapsed_ms(&t0);
+
+    timespec_get(&t0, TIME_UTC);
+    for (int r = 0; r < rounds; r++) {
+        for (int g = 0; g < numGroups; g++) {
+            sumNew += CssKeyFlagFromString(groups[g], groupLens[g]);
+        }
+    }
+    double newMs = elapsed_ms(&t0);
+
+    double numWords = (double)numGroups * 8 * rounds;
+    printf("%d words (%d prefixes of keywords), %d rounds\n", words, numPrefix, rounds);
+    printf("  strncmp loop:         %.3f ms, %.2f ns/word (checksum %lx)\n", oldMs, oldMs * 1e6 / numWords, (unsigned long)sumOld);
+    printf("  CssKeyFlagFromString: %.3f ms, %.2f ns/word (checksum %lx)\n", newMs, newMs * 1e6 / numWords, (unsigned long)sumNew);
+
+    free(groupLens);
+    free(groups);
+    free(list);
+}
+
+
+// 没有索引时 CssKeyArrayQueryClass() 的做法: 对每个名称比较全部 key
+static int query_class_linear(const CssKeyArray keys, CssKeyType classType, const char *name, int nameLen, CssKeyArrayNode classNodes[32])
+{
+    int numKeys = CssKeyArrayGetUsed(keys);
+    int retNodes = 0;
+    int offset;
+
+    for (int i = 0; i < numKeys; i++) {
+        const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+        if (CssKeyGetType(node) == classType && CssKeyOffsetLength(node, &offset) == nameLen &&
+            !strncmp(CssKeyArrayGetString(keys, offset), name, nameLen) && retNodes < 32) {
+            classNodes[retNodes++] = node;
+        }
+    }
+    return retNodes;
+}
+
+
+// -q CLASSES: ".cN {...}" 和 "#iN {...}" 各 classes/2 个, 1/8 的查询名称不存在
+void bench_query_class(int classes, int lookups)
+{
+    size_t cssLen = 0;
+    char *css = (char *) malloc((size_t)classes * 48 + 1);
+    for (int i = 0; i < classes; i++) {
+        cssLen += sprintf(css + cssLen, "%c%c%d { color: #%06x; }\n", (i & 1) ? '#' : '.', (i & 1) ? 'i' : 'c', i / 2, i);
+    }
+
+    if ((size_t)classes * 3 >= CSS_KEYINDEX_INVALID) {
+        printf("Error: %d classes need %d keys, max is %d (build with: make WIDE=1)\n", classes, classes * 3, CSS_KEYINDEX_INVALID - 1);
+        exit(1);
+    }
+
+    CssKeyArray keys = CssStringParse(CssStringNew(css, cssLen));
+    if (!keys) {
+        printf("Error: CssStringParse() failed\n");
+        exit(1);
+    }
+
+    // 查询名称: 随机的 class 或 id (包括前面的 '.' 或 '#')
+    int numNames = 4096;
+    char (*names)[16] = malloc(sizeof(*names) * numNames);
+    CssKeyType *types = (CssKeyType *) malloc(sizeof(CssKeyType) * numNames);
+    unsigned int seed = 12345;
+    for (int i = 0; i < numNames; i++) {
+        seed = seed * 1103515245 + 12345;
+        int k = (int)((seed >> 8) % (unsigned)(classes / 2 + classes / 16 + 1));
+        types[i] = (seed & 0x10000) ? css_type_id : css_type_class;
+        snprintf(names[i], sizeof(names[i]), "%s%d", types[i] == css_type_id ? "#i" : ".c", k);
+    }
+
+    CssKeyArrayNode nodes[32];
+    long found = 0, linearFound = 0;
+    struct timespec t0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < lookups; i++) {
+        const char *name = names[i & (numNames - 1)];
+        found += CssKeyArrayQueryClass(keys, types[i & (numNames - 1)], name, (int)strlen(name), nodes);
+    }
+    double indexMs = elapsed_ms(&t0);
+
+    // 逐个比较太慢, 只查询一部分
+    int linearLookups = lookups / 1000 > numNames ? numNames : (lookups / 1000 > 0 ? lookups / 1000 : 1);
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < linearLookups; i++) {
+        const char *name = names[i];
+        linearFound += query_class_linear(keys, types[i], name, (int)strlen(name), nodes);
+    }
+    double linearMs = elapsed_ms(&t0);
+
+    // 组合查询: 每个查询有 QUERY_NAMES 个空格分开的 class 名称, 超过 CssKeyArrayQueryClass() 的 32 个.
+    //   CssKeyArrayQueryClassNodes() 先用栈上的 nodes, 返回值更大时换成更大的 buffer 再查一次
+    enum { QUERY_NAMES = 64, NUM_QUERIES = 64 };
+    char (*queries)[QUERY_NAMES * 16] = malloc(sizeof(*queries) * NUM_QUERIES);
+    for (int q = 0; q < NUM_QUERIES; q++) {
+        int len = 0;
+        for (int n = 0; n < QUERY_NAMES; n++) {
+            seed = seed * 1103515245 + 12345;
+            len += sprintf(queries[q] + len, n ? " .c%d" : ".c%d", (int)((seed >> 8) % (unsigned)(classes / 2 + 1)));
+        }
+    }
+
+    int maxNodes = 32;
+    CssKeyArrayNode *buffer = nodes;
+    long composedFound = 0, resized = 0;
+    int composedLookups = lookups / QUERY_NAMES > 0 ? lookups / QUERY_NAMES : 1;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < composedLookups; i++) {
+        const char *query = queries[i & (NUM_QUERIES - 1)];
+        int queryLen = (int)strlen(query);
+        int n = CssKeyArrayQueryClassNodes(keys, css_type_class, query, queryLen, buffer, maxNodes);
+        if (n > maxNodes) {
+            buffer = (CssKeyArrayNode *) (buffer == nodes ? malloc(sizeof(buffer[0]) * n) : realloc(buffer, sizeof(buffer[0]) * n));
+            maxNodes = n;
+            resized++;
+            n = CssKeyArrayQueryClassNodes(keys, css_type_class, query, queryLen, buffer, maxNodes);
+        }
+        composedFound += n;
+    }
+    double composedMs = elapsed_ms(&t0);
+
+    printf("%d classes, %d keys, %d lookups, %ld found\n", classes, CssKeyArrayGetUsed(keys), lookups, found);
+    printf("  index:  %.3f ms, %.3f us/lookup (index built by the first lookup)\n", indexMs, indexMs * 1000.0 / lookups);
+    printf("  linear: %d lookups, %.3f us/lookup, %ld found\n", linearLookups, linearMs * 1000.0 / linearLookups, linearFound);
+    printf("  composed: %d queries x %d names, %.3f us/query, %ld found, buffer resized %ld times\n",
+        composedLookups, QUERY_NAMES, composedMs * 1000.0 / composedLookups, composedFound, resized);
+
+    if (buffer != nodes) {
+        free(buffer);
+    }
+    free(queries);
+    free(types);
+    free(names);
+    CssKeyArrayFree(keys);
+    free(css);
+}
+
+
+// -i IDS: "#N {...}" 共 ids 个, 分别使用连续的 N (数组) 和随机的 32 位 N (开放寻址表).
+//   CssKeyArrayQueryId() 按整数查询, 与 CssKeyArrayQueryClass() 按名称 "#N" 查询比较耗时
+void bench_query_id(int ids, int lookups)
+{
+    if ((size_t)ids * 3 >= CSS_KEYINDEX_INVALID) {
+        printf("Error: %d ids need %d keys, max is %d (build with: make WIDE=1)\n", ids, ids * 3, CSS_KEYINDEX_INVALID - 1);
+        exit(1);
+    }
+
+    uint32_t *idList = (uint32_t *) malloc(sizeof(uint32_t) * ids);
+    char *css = (char *) malloc((size_t)ids * 40 + 1);
+    int numQueries = 4096;
+    uint32_t *queryIds = (uint32_t *) malloc(sizeof(uint32_t) * numQueries);
+    char (*queryNames)[16] = malloc(sizeof(*queryNames) * numQueries);
+
+    for (int layout = 0; layout < 2; layout++) {
+        unsigned int seed = 12345;
+        size_t cssLen = 0;
+        for (int i = 0; i < ids; i++) {
+            seed = seed * 1103515245 + 12345;
+            idList[i] = layout ? (seed ^ (seed >> 13) * 2654435769U) : (uint32_t)i;
+            cssLen += sprintf(css + cssLen, "#%u { color: #%06x; }\n", idList[i], i & 0xFFFFFF);
+        }
+
+        // 1/8 的查询 id 不存在
+        for (int q = 0; q < numQueries; q++) {
+            seed = seed * 1103515245 + 12345;
+            queryIds[q] = (q & 7) ? idList[(seed >> 8) % (unsigned)ids] : idList[(seed >> 8) % (unsigned)ids] + (uint32_t)ids;
+            snprintf(queryNames[q], sizeof(queryNames[q]), "#%u", queryIds[q]);
+        }
+
+        CssKeyArray keys = CssStringParse(CssStringNew(css, cssLen));
+        if (!keys) {
+            printf("Error: CssStringParse() failed\n");
+            exit(1);
+        }
+
+        CssKeyArrayNode nodes[32];
+        long found = 0;
+        struct timespec t0;
+
+        // 第一次查询创建索引, 不计时
+        CssKeyArrayQueryId(keys, 0);
+
+        timespec_get(&t0, TIME_UTC);
+        for (int i = 0; i < lookups; i++) {
+            found += CssKeyArrayQueryId(keys, queryIds[i & (numQueries - 1)]) != 0;
+        }
+        double idMs = elapsed_ms(&t0);
+
+        long nameFound = 0;
+        timespec_get(&t0, TIME_UTC);
+        for (int i = 0; i < lookups; i++) {
+            const char *name = queryNames[i & (numQueries - 1)];
+            nameFound += CssKeyArrayQueryClass(keys, css_type_id, name, (int)strlen(name), nodes) > 0;
+        }
+        double nameMs = elapsed_ms(&t0);
+
+        printf("%s ids: %d ids, %d lookups, %ld found\n", layout ? "random" : "dense", ids, lookups, found);
+        printf("  CssKeyArrayQueryId:    %.3f ms, %.1f ns/lookup\n", idMs, idMs * 1e6 / lookups);
+        printf("  CssKeyArrayQueryClass: %.3f ms, %.1f ns/lookup, %ld found\n", nameMs, nameMs * 1e6 / lookups, nameFound);
 
         CssKeyArrayFree(keys);
     }
+
+    free(queryNames);
+    free(queryIds);
+    free(css);
+    free(idList);
+}
+
+
+// -r PATTERN: 查找全部匹配, 比较 regex_matchp() 和复用 regex_match_ctx 的内存分配次数
+//   offsets: 尝试匹配的起始位置数 (旧实现每个位置 malloc 一次)
+//   wrapper: regex_matchp(), 每次调用使用新的 ctx
+//   ctx:     所有调用使用同一个 ctx
+void bench_regex_file(const char *csspathfile, const char *pattern, int rounds)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+
+    struct small_regex *regex = regex_compile(pattern);
+    if (!regex) {
+        printf("Error: regex_compile() failed: %s\n", pattern);
+        exit(1);
+    }
+
+    const char *text = source->sbbuf;
+    size_t textLen = strlen(text);
+
+    long matches = 0, offsets = 0;
+    unsigned long wrapperAllocs = 0, ctxAllocs = 0;
+    double wrapperMs, ctxMs;
+    struct timespec t0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        const char *p = text;
+        for (;;) {
+            struct regex_match_ctx ctx;
+            regex_match_ctx_init(&ctx);
+            ctx.nodfa = (uint8_t) regex_nfa;
+            int32_t at = regex_matchp_ctx(&ctx, regex, p);
+            wrapperAllocs += ctx.allocs;
+            regex_match_ctx_free(&ctx);
+
+            offsets += (at < 0) ? (long)strlen(p) + 1 : at + 1;
+            if (at < 0 || p[at] == '\0') {
+                break;
+            }
+            matches++;
+            p += at + 1;
+        }
+    }
+    wrapperMs = elapsed_ms(&t0);
+
+    struct regex_match_ctx ctx;
+    regex_match_ctx_init(&ctx);
+    ctx.nodfa = (uint8_t) regex_nfa;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        const char *p = text;
+        for (;;) {
+            int32_t at = regex_matchp_ctx(&ctx, regex, p);
+            if (at < 0 || p[at] == '\0') {
+                break;
+            }
+            p += at + 1;
+        }
+    }
+    ctxMs = elapsed_ms(&t0);
+    ctxAllocs = ctx.allocs;
+    regex_match_ctx_free(&ctx);
+
+    double mb = (double)textLen * rounds / (1024.0 * 1024.0);
+    printf("%s: %lu bytes, pattern \"%s\", %ld matches, %d rounds\n",
+        csspathfile, (unsigned long)textLen, pattern, matches / rounds, rounds);
+    printf("  offsets: %ld, %.1f allocs/MB (one malloc per offset before regex_match_ctx)\n",
+        offsets, offsets / mb);
+    printf("  wrapper: %lu allocs, %.1f allocs/MB, %.3f ms\n", wrapperAllocs, wrapperAllocs / mb, wrapperMs);
+    printf("  ctx:     %lu allocs, %.1f allocs/MB, %.3f ms\n", ctxAllocs, ctxAllocs / mb, ctxMs);
+
+    regex_free(regex);
+    CssStringFree(source);
+}
+
+
+// -r PATTERN -e cache: 每一行调用一次 regex_match()
+//   compile: 每次调用都 regex_compile() 和 regex_free() (regex_match 以前的做法)
+//   cache:   regex_match() 从正则缓存中取得编译好的正则
+void bench_regex_cache_file(const char *csspathfile, const char *pattern, int rounds)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+
+    // 按行切开 (就地改写)
+    int lines = 0;
+    for (char *p = source->sbbuf; *p; p++) {
+        if (*p == '\n') {
+            *p = '\0';
+            lines++;
+        }
+    }
+    char *textEnd = source->sbbuf + source->sblen;
+    long matches = 0, cachedMatches = 0;
+    double compileMs, cacheMs;
+    struct timespec t0;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        for (char *line = source->sbbuf; line < textEnd; line += strlen(line) + 1) {
+            struct small_regex *regex = regex_compile(pattern);
+            if (!regex) {
+                printf("Error: regex_compile() failed: %s\n", pattern);
+                exit(1);
+            }
+            matches += (regex_matchp(regex, line) >= 0);
+            regex_free(regex);
+        }
+    }
+    compileMs = elapsed_ms(&t0);
+
+    struct regex_cache_stats before, after;
+    regex_cache_get_stats(&before);
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        for (char *line = source->sbbuf; line < textEnd; line += strlen(line) + 1) {
+            cachedMatches += (regex_match(pattern, line) >= 0);
+        }
+    }
+    cacheMs = elapsed_ms(&t0);
+    regex_cache_get_stats(&after);
+
+    printf("%s: %d lines, pattern \"%s\", %ld matching lines, %d rounds\n",
+        csspathfile, lines, pattern, matches / rounds, rounds);
+    printf("  compile: %.3f ms (regex_compile per call)\n", compileMs);
+    printf("  cache:   %.3f ms, %llu hits, %llu misses, %llu evictions, %u/%u entries, %ld matching lines\n",
+        cacheMs,
+        (unsigned long long)(after.hits - before.hits),
+        (unsigned long long)(after.misses - before.misses),
+        (unsigned long long)(after.evictions - before.evictions),
+        after.entries, after.capacity, cachedMatches / rounds);
+
+    regex_cache_clear();
+    CssStringFree(source);
+}
+
+
+// 多个 -r: 把 pos 之后最左边的匹配作为一个 token, 从 token 之后继续 (空匹配前进 1 字节).
+//   一遍扫描找到所有正则的 token, 与每个正则各扫描一遍 (各自的 regex_match_ctx) 比较
+void bench_regex_set_file(const char *csspathfile, const char **patterns, int count, int rounds)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+
+    struct regex_set *set = regex_set_compile(patterns, (uint32_t)count);
+    if (!set) {
+        printf("Error: regex_set_compile() failed\n");
+        exit(1);
+    }
+
+    const char *text = source->sbbuf;
+    size_t textLen = strlen(text);
+
+    long tokens[RE_SET_MAX_PATTERNS] = {0};
+    long alone[RE_SET_MAX_PATTERNS] = {0};
+    double setMs, separateMs;
+    struct timespec t0;
+
+    struct regex_match_ctx ctx;
+    regex_match_ctx_init(&ctx);
+    ctx.nodfa = (uint8_t) regex_nfa;
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        size_t pos = 0;
+        int32_t start, end, which;
+
+        while (pos <= textLen && regex_set_find_ctx(&ctx, set, text + pos, textLen - pos, &start, &end, &which) >= 0) {
+            if (i == 0) {
+                tokens[which]++;
+            }
+            pos += (end > start) ? end : start + 1;
+        }
+    }
+    setMs = elapsed_ms(&t0);
+    regex_match_ctx_free(&ctx);
+
+    // 每个正则各扫描一遍
+    struct regex_match_ctx ctxs[RE_SET_MAX_PATTERNS];
+    for (int k = 0; k < count; k++) {
+        regex_match_ctx_init(&ctxs[k]);
+        ctxs[k].nodfa = (uint8_t) regex_nfa;
+    }
+
+    timespec_get(&t0, TIME_UTC);
+    for (int i = 0; i < rounds; i++) {
+        for (int k = 0; k < count; k++) {
+            size_t pos = 0;
+            int32_t start, end;
+
+            while (pos <= textLen && regex_find_ctx(&ctxs[k], set->regs[k], text + pos, textLen - pos, &start, &end) >= 0) {
+                if (i == 0) {
+                    alone[k]++;
+                }
+                pos += (end > start) ? end : start + 1;
+            }
+        }
+    }
+    separateMs = elapsed_ms(&t0);
+
+    for (int k = 0; k < count; k++) {
+        regex_match_ctx_free(&ctxs[k]);
+    }
+
+    printf("%s: %lu bytes, %d patterns, %d rounds\n", csspathfile, (unsigned long)textLen, count, rounds);
+    printf("  set:      %d pass (%s), %.3f ms\n", set->dfa ? 1 : count, set->dfa ? "one DFA" : "one search per pattern", setMs);
+    printf("  separate: %d passes, %.3f ms\n", count, separateMs);
+    for (int k = 0; k < count; k++) {
+        printf("    [%d] \"%s\": %ld tokens, %ld matches alone\n", k, patterns[k], tokens[k], alone[k]);
+    }
+
+    regex_set_free(set);
+    CssStringFree(source);
+}
+
+
+// -j N: 批量解析多个文件
+void batch_cssparse_files(int numFiles, char *files[], int jobs, int rounds)
+{
+    const char **paths = (const char **) malloc(sizeof(char *) * numFiles);
+    CssBatchResult *results = (CssBatchResult *) malloc(sizeof(CssBatchResult) * numFiles);
+    if (!paths || !results) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < numFiles; i++) {
+        if (strstr(files[i], "file://") != files[i]) {
+            printf("Error: input must be file://: %s\n", files[i]);
+            exit(1);
+        }
+        paths[i] = files[i] + 7;
+    }
+
+    int numParsed = 0;
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+
+    for (int r = 0; r < rounds; r++) {
+        if (r > 0) {
+            for (int i = 0; i < numFiles; i++) {
+                CssKeyArrayFree(results[i].keys);
+            }
+        }
+        numParsed = CssParseBatch(paths, numFiles, jobs, results);
+    }
+
+    double ms = elapsed_ms(&t0);
+
+    double sumMs = 0;
+    for (int i = 0; i < numFiles; i++) {
+        printf("%s: %d keys, %.3f ms, thread %d\n", paths[i], CssKeyArrayGetUsed(results[i].keys), results[i].elapsedMs, results[i].thread);
+        sumMs += results[i].elapsedMs;
+        CssKeyArrayFree(results[i].keys);
+    }
+    printf("%d/%d files, %d threads, %d rounds: %.3f ms, %.3f ms/batch, per-file sum %.3f ms (last batch)\n",
+        numParsed, numFiles, jobs, rounds, ms, ms / rounds, sumMs);
+
+    free(results);
+    free(paths);
 }
 
 
 int main(int argc, char * argv[])
 {
-    if (argc == 1) {
+    int argi = 1;
+    int rounds = 0;
+    int chunkSize = 4096;
+    int jobs = 0;
+    const char *regexPattern = 0;
+    const char *regexPatterns[RE_SET_MAX_PATTERNS];
+    int regexCount = 0;
+    int queryClasses = 0;
+    int queryIds = 0;
+    int bitflagWords = 0;
+
+    // 选项: -b ROUNDS, -q CLASSES, -i IDS, -f WORDS, -m malloc|arena, -s auto|scalar|sse2|avx2, -p string|buffer|mmap|sax|reuse|pack|atom, -c CHUNK, -t THREADS, -j N, -r PATTERN, -e auto|nfa|cache
+    while (argi + 1 < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-b")) {
+            rounds = atoi(argv[argi + 1]);
+            if (rounds <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-s")) {
+            CssScanLevel level = css_scan_auto;
+            while (level <= css_scan_avx2 && strcmp(argv[argi + 1], CssScanLevelName(level))) {
+                level++;
+            }
+            if (level > css_scan_avx2) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            level = CssScanSetLevel(level);
+            printf("scan: %s\n", CssScanLevelName(level));
+        }
+        else if (!strcmp(argv[argi], "-m")) {
+            if (!strcmp(argv[argi + 1], "arena")) {
+                parse_arena = 1;
+            }
+            else if (strcmp(argv[argi + 1], "malloc")) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-c")) {
+            chunkSize = atoi(argv[argi + 1]);
+            if (chunkSize <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-q")) {
+            queryClasses = atoi(argv[argi + 1]);
+            if (queryClasses <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-i")) {
+            queryIds = atoi(argv[argi + 1]);
+            if (queryIds <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-f")) {
+            bitflagWords = atoi(argv[argi + 1]);
+            if (bitflagWords <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-j")) {
+            jobs = atoi(argv[argi + 1]);
+            if (jobs <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-r")) {
+            if (regexCount == RE_SET_MAX_PATTERNS) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            regexPatterns[regexCount++] = argv[argi + 1];
+            regexPattern = regexPatterns[0];
+        }
+        else if (!strcmp(argv[argi], "-e")) {
+            if (!strcmp(argv[argi + 1], "nfa")) {
+                regex_nfa = 1;
+            }
+            else if (!strcmp(argv[argi + 1], "cache")) {
+                regex_cache = 1;
+            }
+            else if (strcmp(argv[argi + 1], "auto")) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-t")) {
+            parse_threads = atoi(argv[argi + 1]);
+            if (parse_threads <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (parse_threads > 1) {
+                parse_readonly = 1;
+            }
+        }
+        else if (!strcmp(argv[argi], "-p")) {
+            if (!strcmp(argv[argi + 1], "buffer")) {
+                parse_readonly = 1;
+            }
+            else if (!strcmp(argv[argi + 1], "mmap")) {
+                parse_readonly = 1;
+                parse_mmap = 1;
+            }
+            else if (!strcmp(argv[argi + 1], "reuse")) {
+                parse_reuse = 1;
+            }
+            else if (!strcmp(argv[argi + 1], "pack")) {
+                parse_pack = 1;
+            }
+            else if (!strcmp(argv[argi + 1], "atom")) {
+                parse_atom = 1;
+            }
+            else if (!strcmp(argv[argi + 1], "sax")) {
+                parse_readonly = 1;
+                parse_sax = 1;
+            }
+            else if (strcmp(argv[argi + 1], "string")) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+        argi += 2;
+    }
+
+    if (queryClasses > 0) {
+        bench_query_class(queryClasses, rounds > 0 ? rounds : 1000000);
+        return 0;
+    }
+
+    if (queryIds > 0) {
+        bench_query_id(queryIds, rounds > 0 ? rounds : 1000000);
+        return 0;
+    }
+
+    if (bitflagWords > 0) {
+        bench_bitflag(bitflagWords, rounds > 0 ? rounds : 1000);
+        return 0;
+    }
+
+    if (argi == argc) {
         print_usage(argv[0]);
         return 1;
     }
 
+    // 多于 2 个输入 (没有输出文件) 或者指定了 -j 时批量解析
+    if (jobs > 0 || argc - argi > 2) {
+        batch_cssparse_files(argc - argi, argv + argi, jobs > 0 ? jobs : 1, rounds > 0 ? rounds : 1);
+        return 0;
+    }
+
+    if (regexPattern && regex_cache) {
+        if (strstr(argv[argi], "file://") != argv[argi]) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        bench_regex_cache_file(argv[argi] + 7, regexPattern, rounds > 0 ? rounds : 1);
+        return 0;
+    }
+
+    if (rounds > 0) {
+        if (strstr(argv[argi], "file://") != argv[argi]) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (regexCount > 1) {
+            bench_regex_set_file(argv[argi] + 7, regexPatterns, regexCount, rounds);
+            return 0;
+        }
+        if (regexPattern) {
+            bench_regex_file(argv[argi] + 7, regexPattern, rounds);
+            return 0;
+        }
+        if (parse_pack) {
+            bench_pack_file(argv[argi] + 7, rounds);
+            return 0;
+        }
+        if (parse_atom) {
+            bench_atom_file(argv[argi] + 7, rounds);
+            return 0;
+        }
+        bench_cssparse_file(argv[argi] + 7, rounds);
+        return 0;
+    }
+
     FILE* cssFileOut = 0;
 
-    if (argc == 3 && strstr(argv[2], "file://") == argv[2]) {
-        const char* outcssfile = argv[2] + 7;
+    if (argi + 1 < argc && strstr(argv[argi + 1], "file://") == argv[argi + 1]) {
+        const char* outcssfile = argv[argi + 1] + 7;
 
         if (file_exists(outcssfile)) {
             printf("Error: output css file existed: %s\n", outcssfile);
@@ -126,10 +1502,13 @@ int main(int argc, char * argv[])
         }
     }
 
-    if (strstr(argv[1], "file://") == argv[1]) {
-        demo_cssparse_file(argv[1] + 7, cssFileOut);
+    if (!strcmp(argv[argi], "stdin://")) {
+        stream_cssparse_stdin((size_t)chunkSize, cssFileOut ? cssFileOut : stdout);
+    }
+    else if (strstr(argv[argi], "file://") == argv[argi]) {
+        demo_cssparse_file(argv[argi] + 7, cssFileOut ? cssFileOut : stdout);
     } else {
-        demo_cssparse_string(argv[1], cssFileOut);
+        demo_cssparse_string(argv[argi], cssFileOut ? cssFileOut : stdout);
     }
 
     if (cssFileOut) {
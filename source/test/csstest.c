@@ -0,0 +1,1483 @@
+/**
+ * @file csstest.c
+ *
+ * @brief cssparse 和 smallregex 的检查, make test 运行
+ *
+ * @copyright Copyright (c) 2024, mapaware.top
+ * @author 350137278@qq.com
+ *
+ * @since 2024-10-15 02:14:01
+ * @date 2024-10-15 02:14:01
+ * @version 0.1.6
+ *
+ * @note
+ *  Compile and run:
+ *     $ make test
+ *
+ *  Usage:
+ *     $ csstest file:///path/to/input1.css file:///path/to/input2.css ...
+ *
+ *  每个输入文件:
+ *    1) CPU 支持的每种扫描方式, 多线程和批量解析的结果 (key 数组逐字节相同), 都使用调用者的分配器
+ *    2) 正则的 DFA, NFA 和回溯的参考实现 (包括非贪婪的模式): 每一行的每个后缀的匹配和跨度相同,
+ *       regex_set 与逐个正则相同
+ *    3) 32 个线程共享编译好的正则, 结果与单线程相同, 编译好的正则不被改写
+ *    4) regex_match() 的正则缓存与每次编译的结果相同
+ *    5) 打包前后和复制的映像遍历结果相同
+ *    6) 属性 key 的 atom 对应它的名称, 解析不修改动态表
+ *  以及生成的输入:
+ *    7) 以注释开始的约 200 KB 样式表 (同 1)
+ *    8) 空的 {}: 选择器的 class 没有属性, 可以查询
+ *    9) CssKeyArrayQueryClass() 和逐个比较的查找, 组合查询和逐个名称查询
+ *   10) CssKeyArrayQueryId() 和按名称 "#N" 查询
+ *   11) CssKeyFlagFromString() 和以前的逐个 strncmp
+ *   12) 生成的正则 (非贪婪和叠加的量词) 在生成的文本上, NFA 和 DFA 的跨度与参考实现相同
+ *  任何一项不同则返回 1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/cssparse.h>
+#include <common/cssalloc.h>
+#include <common/cssbatch.h>
+#include <common/cssatom.h>
+#include <common/cssscan.h>
+#include <common/smallregex.h>
+#include <common/cssthread.h>
+
+
+// 每个输入文件都检查的正则: 线性的 (DFA 和 NFA 比较) 和只用 NFA 的 (非贪婪, '|'), 都与参考实现比较
+static const char *regex_patterns[] = {
+    "[a-z]+:", "[a-z-]+:?", "\\.[a-z]+", "^\\s*[a-z-]+", "#[0-9a-fA-F]+;$", "o.*r",
+    "{.*?}", "/\\*.*?\\*/", ":.*?;", "[a-z-]+?:", "\\d+?(px|em)|;", 0
+};
+
+// regex_set 的模式, 以及 32 个线程共享的正则
+static const char *regex_set_patterns[] = { "/\\*", "[{}]", "[a-z-]+:" };
+
+#define REGEX_SET_PATTERNS  ((int)(sizeof(regex_set_patterns) / sizeof(regex_set_patterns[0])))
+
+#define STRESS_THREADS  32
+#define STRESS_ROUNDS   20
+
+
+static CssString read_css_file(const char *csspathfile)
+{
+    FILE* cssfile = fopen(csspathfile, "r");
+    if (!cssfile) {
+        printf("Error: open file failed: %s\n", csspathfile);
+        exit(1);
+    }
+    CssString source = CssStringNewFromFile(cssfile);
+    fclose(cssfile);
+    if (!source) {
+        printf("Error: CssStringNewFromFile() failed. cssfile=%s\n", csspathfile);
+        exit(1);
+    }
+    return source;
+}
+
+
+// 两个 keys 的 key 数组完全相同 (逐字节) 返回 1
+static int same_keys(const CssKeyArray a, const CssKeyArray b)
+{
+    if (!a || !b) {
+        return !a && !b;
+    }
+    int numKeys = CssKeyArrayGetUsed(a);
+    return numKeys == CssKeyArrayGetUsed(b) &&
+        (numKeys == 0 || !memcmp(CssKeyArrayGetNode(a, 0), CssKeyArrayGetNode(b, 0), (size_t)numKeys * CSS_KEYFIELD_BYTES));
+}
+
+
+// 计数的分配器, 多个线程可以同时使用
+typedef struct {
+    CssThreadMutex lock;
+    long allocs;
+    long frees;
+} CountingHeap;
+
+
+static void counting_add(CountingHeap *heap, long *counter)
+{
+    CssThreadMutexLock(&heap->lock);
+    (*counter)++;
+    CssThreadMutexUnlock(&heap->lock);
+}
+
+
+static void * counting_alloc(void *userData, size_t size)
+{
+    CountingHeap *heap = (CountingHeap *)userData;
+    counting_add(heap, &heap->allocs);
+    return malloc(size);
+}
+
+
+static void * counting_realloc(void *userData, void *ptr, size_t size)
+{
+    CountingHeap *heap = (CountingHeap *)userData;
+    if (!ptr) {
+        counting_add(heap, &heap->allocs);
+    }
+    return realloc(ptr, size);
+}
+
+
+static void counting_free(void *userData, void *ptr)
+{
+    CountingHeap *heap = (CountingHeap *)userData;
+    if (ptr) {
+        counting_add(heap, &heap->frees);
+    }
+    free(ptr);
+}
+
+
+// 用 CPU 支持的每种扫描方式解析 cssBuf (只读, 原地和多线程只读), key 数组必须与 scalar 只读解析的完全相同.
+//   返回不同结果的数目
+static int check_scan_buffer(const char *name, const char *cssBuf, size_t cssLen)
+{
+    CssScanLevel saved = CssScanGetLevel();
+    int different = 0;
+
+    CssScanSetLevel(css_scan_scalar);
+    CssKeyArray refBuffer = CssBufferParse(cssBuf, cssLen);
+    CssKeyArray refString = CssStringParse(CssStringNew(cssBuf, cssLen));
+    printf("%s: %lu bytes, %d keys\n", name, (unsigned long)cssLen, refBuffer ? CssKeyArrayGetUsed(refBuffer) : -1);
+
+    for (CssScanLevel level = css_scan_scalar; level <= css_scan_avx2; level++) {
+        if (CssScanSetLevel(level) != level) {
+            printf("  %-6s not supported by this CPU, skipped\n", CssScanLevelName(level));
+            continue;
+        }
+        CssKeyArray keys = CssBufferParse(cssBuf, cssLen);
+        int sameBuffer = same_keys(refBuffer, keys);
+        CssKeyArrayFree(keys);
+
+        keys = CssStringParse(CssStringNew(cssBuf, cssLen));
+        int sameString = same_keys(refString, keys);
+        CssKeyArrayFree(keys);
+
+        // 多线程: 输入足够长时切分为多个 slice
+        int sameParallel = 1;
+        for (int threads = 2; threads <= 4; threads++) {
+            keys = CssBufferParseParallel(cssBuf, cssLen, threads);
+            sameParallel &= same_keys(refBuffer, keys);
+            CssKeyArrayFree(keys);
+        }
+
+        printf("  %-6s buffer %s, string %s, parallel %s\n", CssScanLevelName(level),
+            sameBuffer ? "same" : "DIFFERENT", sameString ? "same" : "DIFFERENT", sameParallel ? "same" : "DIFFERENT");
+        different += !sameBuffer + !sameString + !sameParallel;
+    }
+
+    CssKeyArrayFree(refString);
+    CssKeyArrayFree(refBuffer);
+    CssScanSetLevel(saved);
+    return different;
+}
+
+
+// 多线程解析: 每个线程的 keys, 合并结果和 job 都从调用者的分配器分配, 释放之后全部归还
+static int check_parallel_allocator(const char *cssBuf, size_t cssLen)
+{
+    CountingHeap heap = { 0 };
+    CssAllocator allocator = { &heap, counting_alloc, counting_realloc, counting_free };
+    const int threads = 3;  // 每个线程至少 64 KB
+
+    CssThreadMutexInit(&heap.lock);
+    const CssAllocator *old = CssSetAllocator(&allocator);
+    CssKeyArray keys = CssBufferParseParallel(cssBuf, cssLen, threads);
+    CssSetAllocator(old);
+
+    long allocs = heap.allocs;
+    CssKeyArrayFree(keys);
+
+    int different = !keys || allocs < threads + 2 || heap.frees != heap.allocs;
+    printf("parallel allocator: %d threads, %ld allocs, %ld frees, %s\n", threads, heap.allocs, heap.frees, different ? "DIFFERENT" : "same");
+
+    CssThreadMutexUninit(&heap.lock);
+    return different;
+}
+
+
+// 生成的输入: 以注释开始, 选择器和属性中间都有注释, 长度足够多线程解析 (约 200 KB, 不超过 4095 个 key)
+static int check_scan_generated(void)
+{
+    size_t cssSize = 200 * 1024;
+    char *css = (char *) malloc(cssSize + 256);
+    size_t cssLen = (size_t)sprintf(css, "/* header */\n");
+
+    for (int i = 0; cssLen < cssSize; i++) {
+        cssLen += (size_t)sprintf(css + cssLen,
+            ".c%d /* state */ hidden { fill-color: #%06X; /* x */ border-width: %dpx; }\n/* rule %0200d */\n",
+            i, i & 0xFFFFFF, i % 10, i);
+    }
+
+    // 大小正好的内存, 越界读可以被 ASAN 发现
+    char *cssBuf = (char *) malloc(cssLen);
+    memcpy(cssBuf, css, cssLen);
+    free(css);
+
+    int different = check_scan_buffer("generated", cssBuf, cssLen);
+    different += check_parallel_allocator(cssBuf, cssLen);
+    free(cssBuf);
+    return different;
+}
+
+
+// 输入文件复制到大小正好的内存中 (越界读可以被 ASAN 发现) 再比较
+static int check_scan_file(const char *csspathfile)
+{
+    CssString source = read_css_file(csspathfile);
+
+    char *cssBuf = (char *) malloc(source->sblen ? source->sblen : 1);
+    memcpy(cssBuf, source->sbbuf, source->sblen);
+
+    int different = check_scan_buffer(csspathfile, cssBuf, source->sblen);
+
+    free(cssBuf);
+    CssStringFree(source);
+    return different;
+}
+
+
+// 批量解析: 同一个文件解析 4 次, 结果与 CssStringParse() 相同,
+//   每个线程的 CssString, keys 和 job 都从调用者的分配器分配, 释放之后全部归还
+static int check_batch_file(const char *csspathfile)
+{
+    const char *paths[4] = { csspathfile, csspathfile, csspathfile, csspathfile };
+    CssBatchResult results[4];
+    CountingHeap heap = { 0 };
+    CssAllocator allocator = { &heap, counting_alloc, counting_realloc, counting_free };
+    const int threads = 2;
+
+    CssKeyArray expect = CssStringParse(read_css_file(csspathfile));
+
+    CssThreadMutexInit(&heap.lock);
+    const CssAllocator *old = CssSetAllocator(&allocator);
+    int parsed = CssParseBatch(paths, 4, threads, results);
+    CssSetAllocator(old);
+
+    long allocs = heap.allocs;
+    int different = (parsed != 4);
+    for (int k = 0; k < 4; k++) {
+        different += !same_keys(expect, results[k].keys);
+        CssKeyArrayFree(results[k].keys);
+    }
+    different += allocs < 4 * 2 + 1 || heap.frees != heap.allocs;
+
+    printf("%s: batch %d files, %d threads, %ld allocs, %ld frees, %s\n", csspathfile, parsed, threads, heap.allocs, heap.frees,
+        different ? "DIFFERENT" : "same");
+
+    CssThreadMutexUninit(&heap.lock);
+    CssKeyArrayFree(expect);
+    return different;
+}
+
+
+// 空的 {}: 选择器的 class 保留, 没有属性, 也不取得后面规则的属性
+static int check_empty_rule(void)
+{
+    static const char css[] = ".a{color:red} .b{} .c .d{x:y} .e { } .f{}";
+    static const struct {
+        const char *name;
+        int keyIndex;       // CssClassGetKeyIndex(), 没有属性为 -1
+    } expect[] = {
+        { ".a", 1 }, { ".b", -1 }, { ".c", 6 }, { ".d", 6 }, { ".e", -1 }, { ".f", -1 }
+    };
+    int different = 0;
+
+    // 只读和原地解析的 key 数组相同
+    CssKeyArray keys = CssBufferParse(css, sizeof(css) - 1);
+    CssKeyArray inplace = CssStringParse(CssStringNew(css, sizeof(css) - 1));
+    different += !keys || !same_keys(keys, inplace);
+
+    for (int i = 0; keys && i < (int)(sizeof(expect) / sizeof(expect[0])); i++) {
+        CssKeyArrayNode nodes[32];
+        int n = CssKeyArrayQueryClass(keys, css_type_class, expect[i].name, (int)strlen(expect[i].name), nodes);
+        if (n != 1 || CssClassGetKeyIndex(nodes[0]) != expect[i].keyIndex) {
+            printf("empty rule: %s found %d, key index %d, expected %d\n",
+                expect[i].name, n, n ? CssClassGetKeyIndex(nodes[0]) : 0, expect[i].keyIndex);
+            different++;
+        }
+    }
+    printf("empty rule: %s\n", different ? "DIFFERENT" : "same");
+
+    CssKeyArrayFree(inplace);
+    CssKeyArrayFree(keys);
+    return different;
+}
+
+
+// 参考实现: 直接按模式字符串回溯 (不使用编译好的程序), 与 NFA 和 DFA 比较.
+//   支持 . [a-z] \d \D \w \W \s \S ^ $ ( ) | 和 * + ? (其后的 ? 表示非贪婪).
+//   最左的起点; 起点处取回溯第一个找到的匹配: 贪婪的先多循环一次, 非贪婪的先少循环一次, '|' 先左边.
+//   与 NFA 相同, * 和 + 的空循环不再继续 (+ 的第一次空循环只能退出)
+#define REF_NODES_MAX   256
+#define REF_STEPS_MAX   200000
+
+enum { ref_node_set, ref_node_begin, ref_node_end, ref_node_empty, ref_node_seq, ref_node_alt, ref_node_repeat };
+
+typedef struct {
+    int kind;
+    int a, b;                   // ref_node_seq, ref_node_alt: 两个子节点. ref_node_repeat: a 为子节点
+    int min, max;               // ref_node_repeat: max 为 -1 表示不限
+    int lazy;
+    unsigned char set[256];     // ref_node_set: 匹配的字节
+} RefNode;
+
+typedef struct {
+    RefNode nodes[REF_NODES_MAX];
+    int numNodes;
+    int root;
+    int overflow;
+    const char *pattern;        // 解析的位置
+    const char *text;
+    int len;
+    long steps;
+} RefRegex;
+
+// 匹配之后继续: 匹配节点 node (count 为 -1), 或者重复节点 node 的第 count 次循环结束于此
+typedef struct RefCont {
+    int node;
+    int count;
+    int from;                   // 这次循环的起点
+    const struct RefCont *next;
+} RefCont;
+
+
+static int ref_new(RefRegex *re, int kind)
+{
+    if (re->numNodes == REF_NODES_MAX) {
+        re->overflow = 1;
+        return 0;
+    }
+    RefNode *n = &re->nodes[re->numNodes];
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    return re->numNodes++;
+}
+
+
+static void ref_set_escape(unsigned char *set, char e)
+{
+    for (int c = 1; c < 256; c++) {
+        int digit = (c >= '0' && c <= '9');
+        int word = digit || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        int space = (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v');
+        switch (e) {
+        case 'd': set[c] |= digit; break;
+        case 'D': set[c] |= !digit; break;
+        case 'w': set[c] |= word; break;
+        case 'W': set[c] |= !word; break;
+        case 's': set[c] |= space; break;
+        case 'S': set[c] |= !space; break;
+        default: set[c] |= (c == (unsigned char)e); break;
+        }
+    }
+}
+
+
+// . [...] \x 或者一个字符
+static int ref_parse_set(RefRegex *re)
+{
+    int k = ref_new(re, ref_node_set);
+    unsigned char *set = re->nodes[k].set;
+    const char *p = re->pattern;
+
+    if (*p == '.') {
+        memset(set, 1, 256);
+        set['\n'] = set['\r'] = 0;
+        p++;
+    }
+    else if (*p == '\\' && p[1]) {
+        ref_set_escape(set, p[1]);
+        p += 2;
+    }
+    else if (*p == '[') {
+        // 与 matchcharclass() 相同: 第一个不是转义的 '-' 之后不再加入 '-', 它只在开头或者结尾时是字符
+        const char *first = ++p;
+        int dashed = 0;
+        for (; *p && *p != ']'; p++) {
+            if (*p == '\\' && p[1]) {
+                unsigned char dash = set['-'];
+                ref_set_escape(set, *++p);
+                if (dashed) {
+                    set['-'] = dash;
+                }
+            }
+            else if (*p == '-') {
+                if (!dashed) {
+                    set['-'] |= (p == first || p[1] == ']');
+                    dashed = 1;
+                }
+            }
+            else if (p[1] == '-' && p[2] && p[2] != ']') {
+                for (int c = (unsigned char)*p; c <= (unsigned char)p[2]; c++) {
+                    set[c] |= (c != '-');
+                }
+            }
+            else {
+                set[(unsigned char)*p] = 1;
+            }
+        }
+        if (*p == ']') {
+            p++;
+        }
+    }
+    else {
+        set[(unsigned char)*p++] = 1;
+    }
+    re->pattern = p;
+    return k;
+}
+
+
+static int ref_parse_alt(RefRegex *re, int depth);
+
+// 到 '|', 组的 ')' 或者结尾. 没有可以重复的节点时忽略量词, 没有对应 '(' 的 ')' 也忽略
+static int ref_parse_seq(RefRegex *re, int depth)
+{
+    int seq = -1;
+
+    for (;;) {
+        char c = *re->pattern;
+        int atom;
+
+        if (!c || c == '|' || (c == ')' && depth > 0)) {
+            break;
+        }
+        if (c == ')' || c == '*' || c == '+' || c == '?') {
+            re->pattern++;
+            continue;
+        }
+
+        if (c == '(') {
+            re->pattern++;
+            atom = ref_parse_alt(re, depth + 1);
+            if (*re->pattern == ')') {
+                re->pattern++;
+            }
+        }
+        else if (c == '^' || c == '$') {
+            atom = ref_new(re, (c == '^') ? ref_node_begin : ref_node_end);
+            re->pattern++;
+        }
+        else {
+            atom = ref_parse_set(re);
+        }
+
+        while ((c = *re->pattern) == '*' || c == '+' || c == '?') {
+            int k = ref_new(re, ref_node_repeat);
+            re->nodes[k].a = atom;
+            re->nodes[k].min = (c == '+');
+            re->nodes[k].max = (c == '?') ? 1 : -1;
+            if (*++re->pattern == '?') {
+                re->nodes[k].lazy = 1;
+                re->pattern++;
+            }
+            atom = k;
+        }
+
+        if (seq < 0) {
+            seq = atom;
+        }
+        else {
+            int k = ref_new(re, ref_node_seq);
+            re->nodes[k].a = seq;
+            re->nodes[k].b = atom;
+            seq = k;
+        }
+    }
+    return (seq < 0) ? ref_new(re, ref_node_empty) : seq;
+}
+
+
+static int ref_parse_alt(RefRegex *re, int depth)
+{
+    int alt = ref_parse_seq(re, depth);
+
+    while (*re->pattern == '|') {
+        re->pattern++;
+        int k = ref_new(re, ref_node_alt);
+        re->nodes[k].a = alt;
+        re->nodes[k].b = ref_parse_seq(re, depth);
+        alt = k;
+    }
+    return alt;
+}
+
+
+// 节点太多返回 0
+static int ref_compile(RefRegex *re, const char *pattern)
+{
+    re->numNodes = 0;
+    re->overflow = 0;
+    re->pattern = pattern;
+    re->root = ref_parse_alt(re, 0);
+    return !re->overflow;
+}
+
+
+static int ref_match(RefRegex *re, int node, int pos, const RefCont *cont);
+
+static int ref_repeat(RefRegex *re, int node, int count, int pos, const RefCont *cont);
+
+
+// 返回匹配的结尾, 没有返回 -1, 超出步数返回 -2
+static int ref_next(RefRegex *re, int pos, const RefCont *cont)
+{
+    if (!cont) {
+        return pos;
+    }
+    if (cont->count < 0) {
+        return ref_match(re, cont->node, pos, cont->next);
+    }
+
+    const RefNode *n = &re->nodes[cont->node];
+    if (pos == cont->from && n->max != 1) {
+        // 空循环: 只有 + 的第一次可以退出
+        return (cont->count == 1 && n->min == 1) ? ref_next(re, pos, cont->next) : -1;
+    }
+    return ref_repeat(re, cont->node, cont->count, pos, cont->next);
+}
+
+
+// 已经循环 count 次
+static int ref_repeat(RefRegex *re, int node, int count, int pos, const RefCont *cont)
+{
+    const RefNode *n = &re->nodes[node];
+    RefCont loop = { node, count + 1, pos, cont };
+    int more = (n->max < 0 || count < n->max);
+    int done = (count >= n->min);
+    int r = -1;
+
+    if (n->lazy && done) {
+        r = ref_next(re, pos, cont);
+        if (r != -1) {
+            return r;
+        }
+    }
+    if (more) {
+        r = ref_match(re, n->a, pos, &loop);
+        if (r != -1) {
+            return r;
+        }
+    }
+    if (!n->lazy && done) {
+        r = ref_next(re, pos, cont);
+    }
+    return r;
+}
+
+
+static int ref_match(RefRegex *re, int node, int pos, const RefCont *cont)
+{
+    const RefNode *n = &re->nodes[node];
+
+    if (++re->steps > REF_STEPS_MAX) {
+        return -2;
+    }
+
+    switch (n->kind) {
+    case ref_node_set:
+        return (pos < re->len && n->set[(unsigned char)re->text[pos]]) ? ref_next(re, pos + 1, cont) : -1;
+    case ref_node_begin:
+        return (pos == 0) ? ref_next(re, pos, cont) : -1;
+    case ref_node_end:
+        return (pos == re->len) ? ref_next(re, pos, cont) : -1;
+    case ref_node_empty:
+        return ref_next(re, pos, cont);
+    case ref_node_seq: {
+        RefCont then = { n->b, -1, 0, cont };
+        return ref_match(re, n->a, pos, &then);
+    }
+    case ref_node_alt: {
+        int r = ref_match(re, n->a, pos, cont);
+        return (r != -1) ? r : ref_match(re, n->b, pos, cont);
+    }
+    default:
+        return ref_repeat(re, node, 0, pos, cont);
+    }
+}
+
+
+// 同 regex_find(): 返回起点, 没有返回 -1, 超出步数 (不比较) 返回 -2
+static int ref_find(RefRegex *re, const char *text, int len, int *end)
+{
+    re->text = text;
+    re->len = len;
+    re->steps = 0;
+
+    for (int start = 0; start <= len; start++) {
+        int r = ref_match(re, re->root, start, 0);
+        if (r == -2) {
+            return -2;
+        }
+        if (r >= 0) {
+            *end = r;
+            return start;
+        }
+    }
+    return -1;
+}
+
+
+// 生成的模式和文本, 伪随机数固定种子
+static unsigned ref_random(unsigned *seed, unsigned n)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 16) & 0x7FFF) % n;
+}
+
+
+static int ref_gen_alt(unsigned *seed, char *p, int depth);
+
+// 返回是否可以匹配空串.
+//   循环体可以为空的循环 (如 (a*?)*, a?*) 中 NFA 的同一状态只保留优先的线程, 结尾可能与回溯的不同,
+//   所以量词只加在不能为空的部分上
+static int ref_gen_seq(unsigned *seed, char *p, int depth)
+{
+    static const char *atoms[] = { "a", "b", "c", ".", "[ab]", "[a-c]", "\\d", "\\w", "b" };
+    static const char *quants[] = { "*", "+", "?", "*?", "+?", "??" };
+    int nullable = 1;
+
+    for (int n = 1 + (int)ref_random(seed, 3); n > 0; n--) {
+        int empty = 0;
+        if (depth < 2 && ref_random(seed, 4) == 0) {
+            strcat(p, "(");
+            empty = ref_gen_alt(seed, p, depth + 1);
+            strcat(p, ")");
+        }
+        else {
+            strcat(p, atoms[ref_random(seed, sizeof(atoms) / sizeof(atoms[0]))]);
+        }
+        // 量词可以叠加 (如 a+*)
+        while (!empty && ref_random(seed, 5) < 2) {
+            const char *q = quants[ref_random(seed, sizeof(quants) / sizeof(quants[0]))];
+            strcat(p, q);
+            empty = (*q != '+');
+        }
+        nullable = nullable && empty;
+    }
+    return nullable;
+}
+
+
+static int ref_gen_alt(unsigned *seed, char *p, int depth)
+{
+    int nullable = ref_gen_seq(seed, p, depth);
+    while (ref_random(seed, 4) == 0) {
+        strcat(p, "|");
+        nullable |= ref_gen_seq(seed, p, depth);
+    }
+    return nullable;
+}
+
+
+// 生成的模式在生成的文本上: NFA 和自动选择的引擎 (线性的用 DFA) 的跨度与参考实现相同.
+//   返回不同结果的数目
+static int check_regex_generated(int patterns, int texts)
+{
+    static RefRegex ref;
+    unsigned seed = 20261016;
+    int compared = 0, skipped = 0, diffs = 0;
+
+    for (int i = 0; i < patterns; i++) {
+        char pattern[1024] = "";
+        if (ref_random(&seed, 8) == 0) {
+            strcat(pattern, "^");
+        }
+        ref_gen_alt(&seed, pattern, 0);
+        if (ref_random(&seed, 8) == 0) {
+            strcat(pattern, "$");
+        }
+
+        struct small_regex *regex = regex_compile(pattern);
+        if (!regex || !ref_compile(&ref, pattern)) {
+            // 超出编译器的限制
+            regex_free(regex);
+            skipped++;
+            continue;
+        }
+
+        for (int j = 0; j < texts; j++) {
+            char text[16];
+            int len = (int)ref_random(&seed, sizeof(text));
+            for (int k = 0; k < len; k++) {
+                text[k] = "abcab1_x"[ref_random(&seed, 8)];
+            }
+
+            int32_t rend = 0;
+            int32_t r = ref_find(&ref, text, len, &rend);
+            if (r == -2) {
+                skipped++;
+                continue;
+            }
+
+            for (int nodfa = 0; nodfa < 2; nodfa++) {
+                struct regex_match_ctx ctx;
+                regex_match_ctx_init(&ctx);
+                ctx.nodfa = (uint8_t) nodfa;
+
+                int32_t end = 0;
+                int32_t s = regex_find_ctx(&ctx, regex, text, (size_t)len, 0, &end);
+                if (s != r || (s >= 0 && end != rend)) {
+                    if (diffs++ < 10) {
+                        printf("pattern \"%s\" on \"%.*s\" (%s): find [%d, %d), reference [%d, %d)\n",
+                            pattern, len, text, nodfa ? "nfa" : (regex->dfa ? "dfa" : "auto"), s, end, r, rend);
+                    }
+                }
+                regex_match_ctx_free(&ctx);
+            }
+            compared++;
+        }
+        regex_free(regex);
+    }
+
+    printf("%d generated patterns, %d texts compared with the reference, %d skipped, %d different\n",
+        patterns, compared, skipped, diffs);
+    return diffs;
+}
+
+
+// 两个引擎都必须给出的结果 (曾经不一致或者回溯不结束的模式)
+static const struct {
+    const char *pattern;
+    const char *text;
+    int start;
+    int end;            // 最左起点处回溯最先找到的匹配的结尾 (线性的模式为最长的匹配)
+} regex_cases[] = {
+    { "[a-c]?b", "b", 0, 1 },
+    { "([a-c]?b)", "b", 0, 1 },
+    { "[a-c]?b|zz", "b", 0, 1 },
+    { "[a-c]?b|zz", "xzz", 1, 3 },
+    { "[a-c]?b", "xyz", -1, 0 },
+    { "a*ab", "aaab", 0, 4 },
+    { "a.*b", "aXbYb", 0, 5 },
+    { "(a.*b)", "aXbYb", 0, 5 },
+    { "[a-z]+:?", "ab:c", 0, 3 },
+    { "(a|ab)c", "xabc", 1, 4 },
+    { "abc|d", "xd", 1, 2 },
+    { "^ab|cd$", "xcd", 1, 3 },
+    { "x?x?x?xxx", "xxx", 0, 3 },
+    { "(a*)*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaac", -1, 0 },
+    { "(a|aa)+$", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", -1, 0 },
+    // 非贪婪的量词和 '|' 不是最长的匹配
+    { "{.*?}", "{a} {b}", 0, 3 },
+    { "/\\*.*?\\*/", "/* a */ b /* c */", 0, 7 },
+    { ":.*?;", "x:1; y:2;", 1, 4 },
+    { "{.*}", "{a} {b}", 0, 7 },
+    { "a+?", "aaa", 0, 1 },
+    { "a??a", "aa", 0, 1 },
+    { "a|ab", "ab", 0, 1 },
+    { "(a|ab)(c|bcd)", "abcd", 0, 4 }
+};
+
+
+// 每个模式用两个引擎, 分别作为字符串和片段匹配, 以及参考实现
+static int check_regex_cases(void)
+{
+    int diffs = 0;
+
+    for (size_t i = 0; i < sizeof(regex_cases) / sizeof(regex_cases[0]); i++) {
+        struct small_regex *regex = regex_compile(regex_cases[i].pattern);
+        if (!regex) {
+            printf("Error: regex_compile() failed: %s\n", regex_cases[i].pattern);
+            exit(1);
+        }
+
+        for (int nodfa = 0; nodfa < 2; nodfa++) {
+            struct regex_match_ctx ctx;
+            regex_match_ctx_init(&ctx);
+            ctx.nodfa = (uint8_t) nodfa;
+
+            int32_t end = 0;
+            int32_t a = regex_matchp_ctx(&ctx, regex, regex_cases[i].text);
+            int32_t c = regex_find_ctx(&ctx, regex, regex_cases[i].text, strlen(regex_cases[i].text), 0, &end);
+            if (a != regex_cases[i].start || c != regex_cases[i].start || (c >= 0 && end != regex_cases[i].end)) {
+                printf("pattern \"%s\" on \"%s\" (%s): match %d, find [%d, %d), expected [%d, %d)\n",
+                    regex_cases[i].pattern, regex_cases[i].text, nodfa ? "nfa" : "auto", a, c, end, regex_cases[i].start, regex_cases[i].end);
+                diffs++;
+            }
+            regex_match_ctx_free(&ctx);
+        }
+        regex_free(regex);
+
+        static RefRegex ref;
+        int32_t rend = 0;
+        int32_t r = ref_compile(&ref, regex_cases[i].pattern) ? ref_find(&ref, regex_cases[i].text, (int)strlen(regex_cases[i].text), &rend) : -2;
+        // 回溯不结束的模式不比较
+        if (r != -2 && (r != regex_cases[i].start || (r >= 0 && rend != regex_cases[i].end))) {
+            printf("pattern \"%s\" on \"%s\" (reference): find [%d, %d), expected [%d, %d)\n",
+                regex_cases[i].pattern, regex_cases[i].text, r, rend, regex_cases[i].start, regex_cases[i].end);
+            diffs++;
+        }
+    }
+
+    printf("%d regex cases, %d different\n", (int)(sizeof(regex_cases) / sizeof(regex_cases[0])), diffs);
+    return diffs;
+}
+
+
+// 输入文件的每一行 (以及每一行的每个后缀) 都用 DFA, NFA 和 regex_find 片段查找各匹配一次,
+//   跨度再与参考实现比较, 输出不同的结果. DFA 不支持的模式两次都是 NFA.
+//   返回不同结果的数目, 0 表示完全相同
+static int check_regex_file(const char *csspathfile, const char *pattern)
+{
+    CssString source = read_css_file(csspathfile);
+
+    struct small_regex *regex = regex_compile(pattern);
+    if (!regex) {
+        printf("Error: regex_compile() failed: %s\n", pattern);
+        exit(1);
+    }
+
+    static RefRegex ref;
+    if (!ref_compile(&ref, pattern)) {
+        printf("Error: ref_compile() failed: %s\n", pattern);
+        exit(1);
+    }
+
+    struct regex_match_ctx dfa, nfa;
+    regex_match_ctx_init(&dfa);
+    regex_match_ctx_init(&nfa);
+    nfa.nodfa = 1;
+
+    int lines = 0, texts = 0, matches = 0, diffs = 0;
+
+    // 按行切分 (改写 source)
+    char *line = source->sbbuf;
+    while (line) {
+        char *next = strchr(line, '\n');
+        char *end = next ? next : line + strlen(line);
+        if (next) {
+            *next++ = '\0';
+        }
+        lines++;
+
+        for (char *text = line; ; text++) {
+            int32_t a = regex_matchp_ctx(&dfa, regex, text);
+            int32_t b = regex_matchp_ctx(&nfa, regex, text);
+            // 同样的字节作为不以 '\0' 结尾的片段查找
+            // 两个引擎的跨度 [start, end) 相同
+            int32_t cend = 0, dend = 0;
+            int32_t c = regex_find_ctx(&dfa, regex, text, (size_t)(end - text), 0, &cend);
+            int32_t d = regex_find_ctx(&nfa, regex, text, (size_t)(end - text), 0, &dend);
+            // 超出步数时不比较
+            int32_t rend = 0;
+            int32_t r = ref_find(&ref, text, (int)(end - text), &rend);
+            if (r == -2) {
+                r = c;
+                rend = cend;
+            }
+            texts++;
+            matches += (a >= 0);
+            if (a != b || a != c || c != d || c != r || (c >= 0 && (cend != dend || cend != rend))) {
+                if (diffs++ < 10) {
+                    printf("line %d offset %d: dfa %d, nfa %d, find [%d, %d) and [%d, %d), reference [%d, %d): %s\n",
+                        lines, (int)(text - line), a, b, c, cend, d, dend, r, rend, text);
+                }
+            }
+            if (*text == '\0') {
+                break;
+            }
+        }
+        line = next;
+    }
+
+    printf("%s: pattern \"%s\" (%s), %d lines, %d texts, %d matches, %d different\n",
+        csspathfile, pattern, regex->dfa ? "dfa" : "nfa", lines, texts, matches, diffs);
+
+    regex_match_ctx_free(&dfa);
+    regex_match_ctx_free(&nfa);
+    regex_free(regex);
+    CssStringFree(source);
+    return diffs;
+}
+
+
+// 每一行的每个位置都比较 regex_set_find() 和逐个正则 regex_find() 取最左边的结果.
+//   返回不同结果的数目, 0 表示完全相同
+static int check_regex_set_file(const char *csspathfile, const char **patterns, int count)
+{
+    CssString source = read_css_file(csspathfile);
+
+    struct regex_set *set = regex_set_compile(patterns, (uint32_t)count);
+    if (!set) {
+        printf("Error: regex_set_compile() failed\n");
+        exit(1);
+    }
+
+    struct regex_match_ctx ctx;
+    struct regex_match_ctx ctxs[RE_SET_MAX_PATTERNS];
+    regex_match_ctx_init(&ctx);
+    for (int k = 0; k < count; k++) {
+        regex_match_ctx_init(&ctxs[k]);
+    }
+
+    int lines = 0, texts = 0, matches = 0, diffs = 0;
+
+    const char *line = source->sbbuf;
+    while (line) {
+        const char *next = strchr(line, '\n');
+        const char *end = next ? next : line + strlen(line);
+        lines++;
+
+        for (const char *text = line; text <= end; text++) {
+            size_t len = (size_t)(end - text);
+            int32_t a = -1, aend = -1, awhich = -1;
+            int32_t b = -1, bend = -1, bwhich = -1;
+
+            regex_set_find_ctx(&ctx, set, text, len, &a, &aend, &awhich);
+
+            for (int k = 0; k < count; k++) {
+                int32_t s, e;
+                if (regex_find_ctx(&ctxs[k], set->regs[k], text, len, &s, &e) >= 0 && (b < 0 || s < b)) {
+                    b = s;
+                    bend = e;
+                    bwhich = k;
+                }
+            }
+
+            texts++;
+            matches += (a >= 0);
+            if (a != b || aend != bend || awhich != bwhich) {
+                if (diffs++ < 10) {
+                    printf("line %d offset %d: set [%d %d) #%d, each [%d %d) #%d: %.*s\n",
+                        lines, (int)(text - line), a, aend, awhich, b, bend, bwhich, (int)len, text);
+                }
+            }
+        }
+        line = next ? next + 1 : 0;
+    }
+
+    printf("%s: %d patterns (%s), %d lines, %d texts, %d matches, %d different\n",
+        csspathfile, count, set->dfa ? "one DFA" : "one search per pattern", lines, texts, matches, diffs);
+
+    regex_match_ctx_free(&ctx);
+    for (int k = 0; k < count; k++) {
+        regex_match_ctx_free(&ctxs[k]);
+    }
+    regex_set_free(set);
+    CssStringFree(source);
+    return diffs;
+}
+
+
+// 所有线程共享同一个编译好的 regex_set (只有一个模式时直接使用其中的正则),
+//   每个线程使用自己的 regex_match_ctx, 奇数轮使用不带 ctx 的 regex_find/regex_set_find
+typedef struct {
+    const struct regex_set *set;
+    const char *text;
+    size_t textLen;
+    int rounds;
+    int index;
+    int nodfa;
+    unsigned long long expect;  // 单线程的 token 校验和
+    int mismatches;
+    CssThread thread;
+} RegexStressWorker;
+
+
+static unsigned long long regex_tokenize(struct regex_match_ctx *ctx, const struct regex_set *set, const char *text, size_t textLen, long *tokens)
+{
+    unsigned long long sum = 0;
+    size_t pos = 0;
+    int32_t start, end, which = 0;
+    int32_t at;
+
+    *tokens = 0;
+    while (pos <= textLen) {
+        if (set->count == 1) {
+            at = ctx ? regex_find_ctx(ctx, set->regs[0], text + pos, textLen - pos, &start, &end)
+                     : regex_find(set->regs[0], text + pos, textLen - pos, &start, &end);
+        } else {
+            at = ctx ? regex_set_find_ctx(ctx, set, text + pos, textLen - pos, &start, &end, &which)
+                     : regex_set_find(set, text + pos, textLen - pos, &start, &end, &which);
+        }
+        if (at < 0) {
+            break;
+        }
+        sum = sum * 31 + (pos + start) * 7 + (pos + end) * 3 + which;
+        (*tokens)++;
+        pos += (end > start) ? end : start + 1;
+    }
+    return sum;
+}
+
+
+static void regex_stress_run(void *arg)
+{
+    RegexStressWorker *w = (RegexStressWorker *)arg;
+    struct regex_match_ctx ctx;
+    long tokens;
+
+    regex_match_ctx_init(&ctx);
+    ctx.nodfa = (uint8_t) w->nodfa;
+
+    for (int i = 0; i < w->rounds; i++) {
+        if (regex_tokenize(((w->index + i) & 1) ? 0 : &ctx, w->set, w->text, w->textLen, &tokens) != w->expect) {
+            w->mismatches++;
+        }
+    }
+    regex_match_ctx_free(&ctx);
+}
+
+
+// THREADS 个线程切分输入文件 ROUNDS 次, 结果必须与单线程相同, 编译好的正则不能被改写.
+//   返回不同结果和被改写的正则的数目
+static int stress_regex_file(const char *csspathfile, const char **patterns, int count, int nodfa, int threads, int rounds)
+{
+    CssString source = read_css_file(csspathfile);
+
+    struct regex_set *set = regex_set_compile(patterns, (uint32_t)count);
+    if (!set) {
+        printf("Error: regex_set_compile() failed\n");
+        exit(1);
+    }
+
+    // 编译结果的副本, 全部线程结束后逐字节比较
+    size_t compiledSize = 0;
+    for (int k = 0; k < count; k++) {
+        compiledSize += RE_REGEX_SIZE(set->regs[k]);
+    }
+    char *compiled = (char *) malloc(compiledSize);
+    size_t off = 0;
+    for (int k = 0; k < count; k++) {
+        memcpy(compiled + off, set->regs[k], RE_REGEX_SIZE(set->regs[k]));
+        off += RE_REGEX_SIZE(set->regs[k]);
+    }
+
+    const char *text = source->sbbuf;
+    size_t textLen = strlen(text);
+    long tokens;
+
+    struct regex_match_ctx ctx;
+    regex_match_ctx_init(&ctx);
+    ctx.nodfa = (uint8_t) nodfa;
+    unsigned long long expect = regex_tokenize(&ctx, set, text, textLen, &tokens);
+    regex_match_ctx_free(&ctx);
+
+    RegexStressWorker *workers = (RegexStressWorker *) calloc(threads, sizeof(RegexStressWorker));
+
+    for (int k = 0; k < threads; k++) {
+        workers[k].set = set;
+        workers[k].text = text;
+        workers[k].textLen = textLen;
+        workers[k].rounds = rounds;
+        workers[k].index = k;
+        workers[k].nodfa = nodfa;
+        workers[k].expect = expect;
+        CssThreadStart(&workers[k].thread, regex_stress_run, &workers[k]);
+    }
+
+    int mismatches = 0;
+    for (int k = 0; k < threads; k++) {
+        CssThreadJoin(&workers[k].thread);
+        mismatches += workers[k].mismatches;
+    }
+
+    int changed = 0;
+    off = 0;
+    for (int k = 0; k < count; k++) {
+        changed += (memcmp(compiled + off, set->regs[k], RE_REGEX_SIZE(set->regs[k])) != 0);
+        off += RE_REGEX_SIZE(set->regs[k]);
+    }
+
+    printf("%s: %d patterns (%s), %ld tokens, %d threads x %d rounds, %d mismatches, %d compiled regex changed\n",
+        csspathfile, count, nodfa ? "nfa" : "auto", tokens, threads, rounds, mismatches, changed);
+
+    free(workers);
+    free(compiled);
+    regex_set_free(set);
+    CssStringFree(source);
+    return mismatches + changed;
+}
+
+
+// 每一行调用一次 regex_match() (正则缓存), 与每次编译的 regex_matchp() 比较
+static int check_regex_cache_file(const char *csspathfile, const char *pattern)
+{
+    CssString source = read_css_file(csspathfile);
+
+    struct small_regex *regex = regex_compile(pattern);
+    if (!regex) {
+        printf("Error: regex_compile() failed: %s\n", pattern);
+        exit(1);
+    }
+
+    // 按行切开 (就地改写)
+    int lines = 0, diffs = 0;
+    for (char *p = source->sbbuf; *p; p++) {
+        if (*p == '\n') {
+            *p = '\0';
+            lines++;
+        }
+    }
+    char *textEnd = source->sbbuf + source->sblen;
+
+    // 两遍: 第一遍放入缓存, 第二遍命中
+    for (int i = 0; i < 2; i++) {
+        for (char *line = source->sbbuf; line < textEnd; line += strlen(line) + 1) {
+            diffs += regex_match(pattern, line) != regex_matchp(regex, line);
+        }
+    }
+
+    printf("%s: pattern \"%s\", %d lines, regex_match %d different\n", csspathfile, pattern, lines, diffs);
+
+    regex_cache_clear();
+    regex_free(regex);
+    CssStringFree(source);
+    return diffs;
+}
+
+
+// 遍历全部 key, 读取每个名称和值的字节
+static unsigned long walk_keys(const CssKeyArray keys)
+{
+    unsigned long sum = 0;
+    int offset, length;
+    int numKeys = CssKeyArrayGetUsed(keys);
+
+    for (int i = 0; i < numKeys; i++) {
+        const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+        length = CssKeyOffsetLength(node, &offset);
+        const char *str = CssKeyArrayGetString(keys, offset);
+        for (int k = 0; k < length; k++) {
+            sum = sum * 31 + (unsigned char)str[k];
+        }
+        sum += CssKeyGetFlag(node) + CssKeyGetType(node);
+    }
+    return sum;
+}
+
+
+// 打包后复制映像到新的内存, 遍历结果必须与打包之前相同
+static int check_pack_file(const char *csspathfile)
+{
+    CssString source = read_css_file(csspathfile);
+
+    CssKeyArray keys = CssStringParse(CssStringNew(source->sbbuf, source->sblen));
+    if (!keys) {
+        printf("Error: CssStringParse() failed\n");
+        exit(1);
+    }
+    CssKeyArray packed = CssKeyArrayPack(keys);
+
+    // 映像复制到别处 (相当于写入共享内存或者文件后读出)
+    size_t imageSize = 0;
+    const void *image = packed ? CssKeyArrayPackedImage(packed, &imageSize) : 0;
+    void *copy = malloc(imageSize ? imageSize : 1);
+    memcpy(copy, image, imageSize);
+    CssKeyArray attached = packed ? CssKeyArrayAttachPacked(copy, imageSize) : 0;
+
+    unsigned long sum = walk_keys(keys);
+    int different = !packed || (walk_keys(packed) != sum) || !attached || (walk_keys(attached) != sum);
+
+    printf("%s: %d keys, packed image %lu bytes, %s\n",
+        csspathfile, CssKeyArrayGetUsed(keys), (unsigned long)imageSize, different ? "DIFFERENT" : "same");
+
+    free(copy);
+    CssKeyArrayFree(packed);
+    CssKeyArrayFree(keys);
+    CssStringFree(source);
+    return different;
+}
+
+
+// 每个属性 key 的 atom 必须对应它的名称, 其他 key 没有 atom, 解析不修改动态表
+static int check_atom_file(const char *csspathfile)
+{
+    CssString source = read_css_file(csspathfile);
+
+    CssKeyArray keys = CssStringParse(CssStringNew(source->sbbuf, source->sblen));
+    if (!keys) {
+        printf("Error: CssStringParse() failed\n");
+        exit(1);
+    }
+
+    int numKeys = CssKeyArrayGetUsed(keys);
+    int numProps = 0, numUnknown = 0, different = 0;
+    int offset, length, atomLen;
+
+    for (int i = 0; i < numKeys; i++) {
+        const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+        if (CssKeyGetType(node) != css_type_key) {
+            different += (CssKeyGetAtom(node) != css_atom_none);
+            continue;
+        }
+        numProps++;
+        length = CssKeyOffsetLength(node, &offset);
+        different += (CssKeyGetFlag(node) != css_bitflag_none);
+        const char *atomName = CssAtomGetName(CssKeyGetAtom(node), &atomLen);
+        if (!atomName) {
+            numUnknown++;
+            different += (CssAtomFindKnown(CssKeyArrayGetString(keys, offset), length) != css_atom_none);
+            continue;
+        }
+        different += (atomLen != length) || strncmp(atomName, CssKeyArrayGetString(keys, offset), length) ||
+            CssAtomFind(CssKeyArrayGetString(keys, offset), length) != CssKeyGetAtom(node);
+    }
+    different += (CssAtomGetCount() != css_atom_known_end);
+
+    printf("%s: %d keys, %d properties, %d without atom, %s\n",
+        csspathfile, numKeys, numProps, numUnknown, different ? "DIFFERENT" : "same");
+
+    CssKeyArrayFree(keys);
+    CssStringFree(source);
+    return different;
+}
+
+
+// 没有索引时 CssKeyArrayQueryClass() 的做法: 对每个名称比较全部 key
+static int query_class_linear(const CssKeyArray keys, CssKeyType classType, const char *name, int nameLen, CssKeyArrayNode classNodes[32])
+{
+    int numKeys = CssKeyArrayGetUsed(keys);
+    int retNodes = 0;
+    int offset;
+
+    for (int i = 0; i < numKeys; i++) {
+        const CssKeyArrayNode node = CssKeyArrayGetNode(keys, i);
+        if (CssKeyGetType(node) == classType && CssKeyOffsetLength(node, &offset) == nameLen &&
+            !strncmp(CssKeyArrayGetString(keys, offset), name, nameLen) && retNodes < 32) {
+            classNodes[retNodes++] = node;
+        }
+    }
+    return retNodes;
+}
+
+
+// ".cN {...}" 和 "#iN {...}" 各 classes/2 个, 1/8 的查询名称不存在.
+//   索引查询与逐个比较相同, 64 个名称的组合查询与逐个名称查询相同
+static int check_query_class(int classes)
+{
+    size_t cssLen = 0;
+    char *css = (char *) malloc((size_t)classes * 48 + 1);
+    for (int i = 0; i < classes; i++) {
+        cssLen += sprintf(css + cssLen, "%c%c%d { color: #%06x; }\n", (i & 1) ? '#' : '.', (i & 1) ? 'i' : 'c', i / 2, i);
+    }
+
+    CssKeyArray keys = CssStringParse(CssStringNew(css, cssLen));
+    if (!keys) {
+        printf("Error: CssStringParse() failed\n");
+        exit(1);
+    }
+
+    // 查询名称: 随机的 class 或 id (包括前面的 '.' 或 '#')
+    int numNames = 4096;
+    CssKeyArrayNode nodes[32], expect[32];
+    unsigned int seed = 12345;
+    char name[16];
+    long different = 0;
+
+    for (int i = 0; i < numNames; i++) {
+        seed = seed * 1103515245 + 12345;
+        int k = (int)((seed >> 8) % (unsigned)(classes / 2 + classes / 16 + 1));
+        CssKeyType type = (seed & 0x10000) ? css_type_id : css_type_class;
+        int nameLen = snprintf(name, sizeof(name), "%s%d", type == css_type_id ? "#i" : ".c", k);
+        int n = query_class_linear(keys, type, name, nameLen, expect);
+        different += (n != CssKeyArrayQueryClass(keys, type, name, nameLen, nodes)) ||
+            memcmp(nodes, expect, sizeof(expect[0]) * n);
+    }
+
+    // 组合查询: 每个查询有 QUERY_NAMES 个空格分开的 class 名称, 超过 CssKeyArrayQueryClass() 的 32 个
+    enum { QUERY_NAMES = 64, NUM_QUERIES = 64 };
+    char query[QUERY_NAMES * 16];
+    int maxNodes = 0;
+    CssKeyArrayNode *buffer = 0;
+    long composedDifferent = 0;
+
+    for (int q = 0; q < NUM_QUERIES; q++) {
+        int queryLen = 0;
+        for (int n = 0; n < QUERY_NAMES; n++) {
+            seed = seed * 1103515245 + 12345;
+            queryLen += sprintf(query + queryLen, n ? " .c%d" : ".c%d", (int)((seed >> 8) % (unsigned)(classes / 2 + 1)));
+        }
+
+        // 先查询需要的 nodes 数目, buffer 不够时换成更大的
+        int n = CssKeyArrayQueryClassNodes(keys, css_type_class, query, queryLen, 0, 0);
+        if (n > maxNodes) {
+            buffer = (CssKeyArrayNode *) realloc(buffer, sizeof(buffer[0]) * n);
+            maxNodes = n;
+        }
+        composedDifferent += CssKeyArrayQueryClassNodes(keys, css_type_class, query, queryLen, buffer, maxNodes) != n;
+
+        const char *p = query;
+        int k = 0;
+        while (*p) {
+            int nameLen = (int)strcspn(p, " ");
+            int m = query_class_linear(keys, css_type_class, p, nameLen, expect);
+            composedDifferent += (k + m > n) || memcmp(buffer + k, expect, sizeof(expect[0]) * m);
+            k += m;
+            p += nameLen + (p[nameLen] ? 1 : 0);
+        }
+        composedDifferent += (k != n);
+    }
+
+    printf("query class: %d classes, %d keys, %d lookups, %ld different, %d composed queries x %d names, %ld different\n",
+        classes, CssKeyArrayGetUsed(keys), numNames, different, NUM_QUERIES, QUERY_NAMES, composedDifferent);
+
+    free(buffer);
+    CssKeyArrayFree(keys);
+    free(css);
+    return (int)(different + composedDifferent);
+}
+
+
+// "#N {...}" 共 ids 个, 分别使用连续的 N (数组) 和随机的 32 位 N (开放寻址表).
+//   CssKeyArrayQueryId() 按整数查询必须与 CssKeyArrayQueryClass() 按名称 "#N" 查询相同
+static int check_query_id(int ids)
+{
+    uint32_t *idList = (uint32_t *) malloc(sizeof(uint32_t) * ids);
+    char *css = (char *) malloc((size_t)ids * 40 + 1);
+    int numQueries = 4096;
+    CssKeyArrayNode nodes[32];
+    char name[16];
+    long different = 0;
+
+    for (int layout = 0; layout < 2; layout++) {
+        unsigned int seed = 12345;
+        size_t cssLen = 0;
+        for (int i = 0; i < ids; i++) {
+            seed = seed * 1103515245 + 12345;
+            idList[i] = layout ? (seed ^ (seed >> 13) * 2654435769U) : (uint32_t)i;
+            cssLen += sprintf(css + cssLen, "#%u { color: #%06x; }\n", idList[i], i & 0xFFFFFF);
+        }
+
+        CssKeyArray keys = CssStringParse(CssStringNew(css, cssLen));
+        if (!keys) {
+            printf("Error: CssStringParse() failed\n");
+            exit(1);
+        }
+
+        // 1/8 的查询 id 不存在
+        for (int q = 0; q < numQueries; q++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t id = (q & 7) ? idList[(seed >> 8) % (unsigned)ids] : idList[(seed >> 8) % (unsigned)ids] + (uint32_t)ids;
+            int nameLen = snprintf(name, sizeof(name), "#%u", id);
+            int n = CssKeyArrayQueryClass(keys, css_type_id, name, nameLen, nodes);
+            different += (n ? nodes[0] : 0) != CssKeyArrayQueryId(keys, id) ||
+                n != CssKeyArrayQueryIdNodes(keys, id, 0, 0);
+        }
+
+        CssKeyArrayFree(keys);
+    }
+
+    printf("query id: %d ids, dense and random, %d lookups, %ld different\n", ids, numQueries, different);
+
+    free(css);
+    free(idList);
+    return (int)different;
+}
+
+
+// 以前的 cssGetKeyBitFlag(): 逐个 strncmp, 长度 4 到 10 的前缀也匹配 ("hidd" 是 hidden)
+static const char *bitflag_names[] = {
+    "readonly", "hidden", "hilight", "pickup", "dragging", "deleting",
+    "fault", "flash", "zoomin", "zoomout", "panning", 0
+};
+
+static int bitflag_strncmp(const char *word, int len)
+{
+    if (len < 4 || len > 10) {
+        return css_bitflag_none;
+    }
+    for (int i = 0; bitflag_names[i] != 0; i++) {
+        if (!strncmp(bitflag_names[i], word, len)) {
+            return 1 << i;
+        }
+    }
+    return css_bitflag_none;
+}
+
+
+// 约一半是状态关键字, 1/16 是关键字的前缀, 其他是普通的词.
+//   每个词: 精确匹配的结果与逐个 strncmp 相同, 前缀不再匹配. 8 个词一组 (空格分开) 的结果是各个词的并
+static int check_bitflag(int words)
+{
+    unsigned int seed = 12345;
+    char word[16], group[8 * 16];
+    int groupLen = 0, groupFlags = 0;
+    int different = 0;
+
+    for (int i = 0; i < words; i++) {
+        seed = seed * 1103515245 + 12345;
+        const char *name = bitflag_names[(seed >> 8) % 11];
+        switch ((seed >> 20) & 15) {
+        case 0:
+            // 前缀, 至少 4 个字符
+            snprintf(word, sizeof(word), "%.*s", 4 + (int)((seed >> 4) % (strlen(name) - 4)), name);
+            break;
+        case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+            snprintf(word, sizeof(word), "state%u", (seed >> 4) % 100);
+            break;
+        default:
+            snprintf(word, sizeof(word), "%s", name);
+            break;
+        }
+
+        int len = (int)strlen(word);
+        int expect = bitflag_strncmp(word, len);
+        if (expect && (int)strlen(bitflag_names[CssScanFirstBit((uint64_t)expect)]) != len) {
+            expect = css_bitflag_none;
+        }
+        different += CssKeyFlagFromString(word, len) != expect;
+
+        groupLen += sprintf(group + groupLen, groupLen ? " %s" : "%s", word);
+        groupFlags |= expect;
+        if ((i & 7) == 7) {
+            different += CssKeyFlagFromString(group, groupLen) != groupFlags;
+            groupLen = groupFlags = 0;
+        }
+    }
+
+    printf("bitflag: %d words, %d different\n", words, different);
+    return different;
+}
+
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    // 生成的输入
+    failed += check_scan_generated() != 0;
+    failed += check_empty_rule() != 0;
+    failed += check_regex_cases() != 0;
+    failed += check_regex_generated(4000, 8) != 0;
+    failed += check_query_class(1000) != 0;
+    failed += check_query_id(1000) != 0;
+    failed += check_bitflag(4096) != 0;
+
+    for (int argi = 1; argi < argc; argi++) {
+        if (strstr(argv[argi], "file://") != argv[argi]) {
+            printf("Usage: %s file:///path/to/input1.css ...\n", argv[0]);
+            return 1;
+        }
+        const char *csspathfile = argv[argi] + 7;
+
+        failed += check_scan_file(csspathfile) != 0;
+        failed += check_batch_file(csspathfile) != 0;
+
+        for (int k = 0; regex_patterns[k]; k++) {
+            failed += check_regex_file(csspathfile, regex_patterns[k]) != 0;
+        }
+        failed += check_regex_set_file(csspathfile, regex_set_patterns, REGEX_SET_PATTERNS) != 0;
+
+        for (int nodfa = 0; nodfa < 2; nodfa++) {
+            failed += stress_regex_file(csspathfile, regex_set_patterns + 2, 1, nodfa, STRESS_THREADS, STRESS_ROUNDS) != 0;
+            failed += stress_regex_file(csspathfile, regex_set_patterns, REGEX_SET_PATTERNS, nodfa, STRESS_THREADS, STRESS_ROUNDS) != 0;
+        }
+        failed += check_regex_cache_file(csspathfile, regex_patterns[0]) != 0;
+
+        failed += check_pack_file(csspathfile) != 0;
+        failed += check_atom_file(csspathfile) != 0;
+    }
+
+    printf("%s: %d checks failed\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}